@@ -33,6 +33,7 @@
 #include <haproxy/xref-t.h>
 
 #include <nuster/common.h>
+#include <nuster/waiter.h>
 
 /* flags for appctx->state */
 #define APPLET_WANT_DIE     0x01  /* applet was running and requested to die */
@@ -80,17 +81,29 @@ struct appctx {
 				struct {
 					struct nst_memory_object  *obj;
 					struct nst_memory_item    *item;
+					struct nst_memory_item    *last;      /* the last item sent */
+					int                        follow;    /* obj is still being filled */
+					struct nst_waiter          waiter;    /* parked at the end of obj */
 				} memory;
 				struct {
 					int       fd;
 					int       header_len;
 					uint64_t  payload_len;
 					uint64_t  offset;
+					uint64_t  start;        /* offset of the head */
+					uint64_t  end;          /* end of the object, 0 if unknown */
+					int       splice;       /* -1 once it cannot splice */
+					struct buffer   *head;
+					struct nst_aio  *aio;
+					struct nst_pcache  *pcache;   /* disk-direct */
+					uint64_t  id;           /* object id of the pcache */
+					uint64_t  hits;
 				} disk;
 			} store;
 			struct {
 				struct nst_dict  *dict;
 				uint64_t          idx;
+				uint64_t          version;
 				struct buffer     buf;
 				struct ist        name;
 				struct ist        host;
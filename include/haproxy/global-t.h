@@ -190,11 +190,25 @@ struct global {
 			uint64_t data_size;              /* max memory used by data, in bytes */
 
 			int dict_cleaner;                /* the number of entries checked once */
+			int dict_locks;                  /* the number of dict lock stripes */
 			int data_cleaner;                /* the number of data checked once */
 			int disk_cleaner;                /* the number of files checked once */
 			int disk_loader;                 /* the number of files load once */
 			int disk_saver;                  /* the number of entries checked once for persist_async */
 			int clean_temp;                  /* clean temp file or not */
+			int disk_aio;                    /* disk read engine, NST_AIO_ENGINE_* */
+			int io_threads;                  /* threads running the disk passes */
+			int disk_engine;                 /* disk store layout, NST_DISK_ENGINE_* */
+			int disk_index;                  /* seconds between index snapshots, 0: off */
+			int loader_threads;              /* threads loading the disk at startup */
+			uint64_t disk_direct;            /* page cache size of disk-direct, 0: off */
+			int disk_sync;                   /* NST_DISK_SYNC_*, or seconds between syncs */
+			int evict;                       /* evict cold data when memory is full */
+			int evict_high_water;            /* start evicting at this percent of memory used */
+			int hugepage;                    /* back the memory zone with huge pages */
+			int prefault;                    /* touch the memory zone at startup */
+			int numa;                        /* -1: off, -2: interleave, >= 0: bind to node */
+			int pack_size;                   /* pack objects up to this size in one chunk */
 
 			struct ist root;                 /* disk root directory */
 
@@ -207,11 +221,19 @@ struct global {
 			uint64_t data_size;              /* max memory used by data, in bytes */
 
 			int dict_cleaner;                /* the number of entries checked once */
+			int dict_locks;                  /* the number of dict lock stripes */
 			int data_cleaner;                /* the number of data checked once */
 			int disk_cleaner;                /* the number of files checked once */
 			int disk_loader;                 /* the number of files load once */
 			int disk_saver;                  /* the number of entries checked once for persist_async */
 			int clean_temp;                  /* clean temp file or not */
+			int disk_aio;                    /* disk read engine, NST_AIO_ENGINE_* */
+			int io_threads;                  /* threads running the disk passes */
+			int disk_engine;                 /* disk store layout, NST_DISK_ENGINE_* */
+			int disk_index;                  /* seconds between index snapshots, 0: off */
+			int loader_threads;              /* threads loading the disk at startup */
+			uint64_t disk_direct;            /* page cache size of disk-direct, 0: off */
+			int disk_sync;                   /* NST_DISK_SYNC_*, or seconds between syncs */
 
 			struct ist root;                 /* disk root directory */
 
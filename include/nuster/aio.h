@@ -0,0 +1,82 @@
+/*
+ * include/nuster/aio.h
+ * This file defines everything related to nuster asynchronous disk reads.
+ *
+ * Copyright (C) Jiang Wenyuan, < koubunen AT gmail DOT com >
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef _NUSTER_AIO_H
+#define _NUSTER_AIO_H
+
+#include <sys/uio.h>
+
+#include <nuster/common.h>
+
+
+/* returned by nst_aio_read while the read is in progress */
+#define NST_AIO_PENDING                 -2
+
+/* size of the pool used when io_uring is unavailable */
+#define NST_AIO_THREADS                 4
+
+/* entries of the io_uring of each thread, also the max reads in flight */
+#define NST_AIO_URING_ENTRIES           256
+
+enum {
+    NST_AIO_ENGINE_NONE         = 0,    /* blocking reads */
+    NST_AIO_ENGINE_URING,               /* io_uring, or threads if unavailable */
+    NST_AIO_ENGINE_THREADS,             /* pool of NST_AIO_THREADS threads */
+};
+
+enum {
+    NST_AIO_STATE_IDLE          = 0,
+    NST_AIO_STATE_PENDING,
+    NST_AIO_STATE_DONE,
+    NST_AIO_STATE_ORPHAN,               /* released while pending */
+};
+
+/*
+ * A nst_aio is the read context of a disk applet, it owns the buffer the
+ * data are read to. A read is submitted by the applet's thread, which parks
+ * the applet, and completed on the same thread which wakes it up.
+ */
+typedef struct nst_aio {
+    struct nst_aio             *next;
+
+    hpx_appctx_t               *appctx;
+    int                         tid;
+    int                         engine;
+    int                         state;
+
+    int                         fd;
+    int                         ret;            /* bytes read or -1 */
+    uint64_t                    offset;
+    uint64_t                    start;          /* submit time in us */
+    uint64_t                   *latency;        /* histogram of read latencies */
+
+    struct iovec                iov;
+    char                        buf[0];         /* global.tune.bufsize */
+} nst_aio_t;
+
+
+void nst_aio_init();
+const char *nst_aio_engine(int engine);
+nst_aio_t *nst_aio_new(hpx_appctx_t *appctx, int engine, uint64_t *latency);
+void nst_aio_free(nst_aio_t *aio);
+int nst_aio_read(nst_aio_t *aio, int fd, char **buf, int len, uint64_t offset);
+
+#endif /* _NUSTER_AIO_H */
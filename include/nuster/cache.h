@@ -25,6 +25,9 @@
 #include <nuster/common.h>
 
 
+/* ms after which a parked request checks its entry again, had it missed a wake */
+#define NST_CACHE_WAIT_RECHECK          1000
+
 extern hpx_flt_ops_t  nst_cache_filter_ops;
 extern const char    *nst_cache_flt_id;
 
@@ -87,10 +87,14 @@ typedef struct nst_core                 nst_core_t;
 #define NST_DEFAULT_DICT_SIZE           NST_DEFAULT_SIZE
 #define NST_DEFAULT_DATA_SIZE           NST_DEFAULT_SIZE
 #define NST_DEFAULT_DICT_CLEANER        1000
+#define NST_DEFAULT_DICT_LOCKS          64
 #define NST_DEFAULT_DATA_CLEANER        1000
 #define NST_DEFAULT_DISK_CLEANER        100
 #define NST_DEFAULT_DISK_LOADER         100
 #define NST_DEFAULT_DISK_SAVER          100
+#define NST_DEFAULT_IO_THREADS          1
+#define NST_DEFAULT_LOADER_THREADS      1
+#define NST_DEFAULT_EVICT_HIGH_WATER    90
 #define NST_DEFAULT_KEY                "method.scheme.host.uri"
 #define NST_DEFAULT_CODE               "200"
 
@@ -191,6 +195,7 @@ typedef struct nst_rule_config {
     int                        last_modified; /* last_modified on|off */
     int                        wait;          /* -1: not wait, 0: wait forever, > 0, wait seconds */
     int                        inactive;      /* 0: disabled, > 0: inactive seconds */
+    int                        admission;     /* admission on|off */
 
     /*
      *  -1: do not use stale
@@ -232,6 +237,7 @@ typedef struct nst_rule_prop {
     int                        wait;
     int                        inactive;
     int                        stale;
+    int                        admission;
     int                        status_code;
 } nst_rule_prop_t;
 
@@ -277,6 +283,16 @@ nst_time_now_ns() {
     return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
 }
 
+/* get monotonic time in microseconds, for durations */
+static inline uint64_t
+nst_time_now_us() {
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+}
+
 const char *nst_parse_size(const char *text, uint64_t *ret);
 int nst_parse_time(const char *text, int len, uint32_t *ret);
 
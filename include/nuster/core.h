@@ -27,6 +27,9 @@
 #include <nuster/http.h>
 #include <nuster/key.h>
 #include <nuster/dict.h>
+#include <nuster/sketch.h>
+#include <nuster/io.h>
+#include <nuster/waiter.h>
 
 
 enum {
@@ -64,10 +67,15 @@ typedef struct nst_ctx {
 
     uint64_t                    ctime;
 
+    nst_waiter_t                waiter;         /* parked while another request fills the entry */
+
     struct {
         struct {
             nst_memory_obj_t   *obj;
             nst_memory_item_t  *item;
+            hpx_buffer_t        pack;
+            nst_memory_obj_t   *fill;           /* obj, published to followers */
+            int                 follow;         /* obj is still being filled */
         } memory;
         struct {
             nst_disk_obj_t      obj;
@@ -89,6 +97,12 @@ struct nst_core {
 
     nst_dict_t                  dict;
     nst_store_t                 store;
+
+    nst_sketch_t                sketch;         /* admission, cache only */
+
+    nst_io_t                    io;             /* disk passes, master only */
+
+    nst_waiters_t              *waiters;        /* collapsed requests, cache only */
 };
 
 
@@ -25,8 +25,21 @@
 #include <nuster/common.h>
 #include <nuster/http.h>
 #include <nuster/key.h>
+#include <nuster/disk.h>
 
 
+/* grow the dict once the number of entries exceeds length * factor */
+#define NST_DICT_LOAD_FACTOR            1
+
+/* max number of buckets moved to the new table during one iteration */
+#define NST_DICT_REHASH_STEPS           1000
+
+/* max number of slots checked by one eviction */
+#define NST_DICT_EVICT_SCAN             8192
+
+/* max number of slots checked to find the next victim */
+#define NST_DICT_VICTIM_SCAN            64
+
 enum {
     NST_DICT_ENTRY_STATE_INIT      = 0,
     NST_DICT_ENTRY_STATE_VALID,
@@ -43,6 +56,7 @@ typedef struct nst_dict_entry {
     struct nst_dict_entry      *next;
 
     int                         state;
+    int                         pinned;         /* being saved to disk, not freed */
 
     nst_key_t                   key;
 
@@ -59,6 +73,7 @@ typedef struct nst_dict_entry {
     uint64_t                    expire;
     uint64_t                    ctime;
     uint64_t                    atime;
+    uint64_t                    htime;          /* when the eviction hand last passed */
 
     nst_rule_prop_t             prop;
 
@@ -72,34 +87,134 @@ typedef struct nst_dict_entry {
         struct {
             nst_memory_obj_t   *obj;
             nst_memory_item_t  *item;
+            nst_memory_obj_t   *fill;           /* being filled, only read in INIT state */
+            int                 fill_pid;       /* process of the filler */
         } memory;
         struct {
             char               *file;
+            uint64_t            base;           /* offset of the object in file */
+            uint64_t            size;           /* record size, log engine */
+            uint64_t            id;             /* object id, see nst_pcache_t */
         } disk;
     } store;
 } nst_dict_entry_t;
 
+/*
+ * A nst_dict_lock protects a stripe of nst_dict buckets
+ */
+typedef struct nst_dict_lock {
+#if defined NUSTER_USE_PTHREAD || defined USE_PTHREAD_PSHARED
+    pthread_mutex_t             mutex;
+#else
+    unsigned int                waiters;
+#endif
+} nst_dict_lock_t;
+
+/*
+ * A nst_dict_table is a bucket array split into segments of one shmem block,
+ * so that a new table can be allocated at runtime.
+ */
+typedef struct nst_dict_table {
+    nst_dict_entry_t         ***seg;
+    uint64_t                    size;           /* number of buckets */
+} nst_dict_table_t;
+
 typedef struct nst_dict {
     nst_shmem_t                *shmem;
 
-    nst_dict_entry_t          **entry;
-    uint64_t                    size;           /* number of entries */
+    /*
+     * table[1] is only used while rehashing: new entries are added to
+     * table[1], buckets of table[0] are moved to table[1] by housekeeping,
+     * then table[1] becomes table[0].
+     */
+    nst_dict_table_t            table[2];
+    uint64_t                    segs;           /* max number of segments of a table */
+    int                         seg_shift;      /* number of buckets of a segment, log2 */
+
     uint64_t                    used;           /* number of used entries */
 
     uint64_t                    cleanup_idx;
 
-    uint64_t                    sync_idx;
+    uint64_t                    sync_idx;       /* only used by the disk saver */
+    uint64_t                    sync_version;   /* dict->rehash.version of sync_idx */
+    uint64_t                    sync_lock_us;   /* time the disk saver held the locks */
+    uint64_t                    sync_saved;     /* entries saved by the disk saver */
 
-    nst_store_t                *store;
+    /* CLOCK eviction of memory objects, see nst_dict_evict */
+    struct {
+        uint64_t                idx;            /* clock hand, a slot */
 
 #if defined NUSTER_USE_PTHREAD || defined USE_PTHREAD_PSHARED
-    pthread_mutex_t             mutex;
+        pthread_mutex_t         mutex;
 #else
-    unsigned int                waiters;
+        unsigned int            waiters;
 #endif
+    } evict;
+
+    struct {
+        uint64_t                idx;            /* next bucket of table[0] to move */
+        uint64_t                version;        /* increased when tables are switched */
+        uint64_t                retry;          /* do not grow again before, in ms */
+    } rehash;
+
+    nst_store_t                *store;
+
+    nst_dict_lock_t            *lock;           /* lock stripes */
+    uint64_t                    locks;          /* number of lock stripes, power of 2 */
 } nst_dict_t;
 
 
+static inline nst_dict_entry_t **
+nst_dict_bucket(nst_dict_t *dict, nst_dict_table_t *table, uint64_t idx) {
+    return &table->seg[idx >> dict->seg_shift][idx & ((1ULL << dict->seg_shift) - 1)];
+}
+
+/*
+ * Passes walking the whole dict see the buckets of table[0] followed by
+ * those of table[1] as slots.
+ */
+static inline uint64_t
+nst_dict_slots(nst_dict_t *dict) {
+    return dict->table[0].size + dict->table[1].size;
+}
+
+static inline nst_dict_entry_t **
+nst_dict_slot(nst_dict_t *dict, uint64_t idx) {
+
+    if(idx < dict->table[0].size) {
+        return nst_dict_bucket(dict, &dict->table[0], idx);
+    }
+
+    return nst_dict_bucket(dict, &dict->table[1], idx - dict->table[0].size);
+}
+
+/*
+ * Bucket idx is protected by stripe idx & (locks - 1). As the size of both
+ * tables is a multiple of dict->locks, a key always maps to the stripe of its
+ * buckets, so the key hash or a slot can be used in place of the bucket index.
+ */
+static inline nst_dict_lock_t *
+nst_dict_stripe(nst_dict_t *dict, uint64_t idx) {
+    return &dict->lock[idx & (dict->locks - 1)];
+}
+
+static inline void
+nst_dict_lock(nst_dict_t *dict, uint64_t idx) {
+    nst_shctx_lock(nst_dict_stripe(dict, idx));
+}
+
+static inline void
+nst_dict_unlock(nst_dict_t *dict, uint64_t idx) {
+    nst_shctx_unlock(nst_dict_stripe(dict, idx));
+}
+
+
+/* accesses of an entry, the page cache keeps the blocks of hot ones longer */
+static inline uint64_t
+nst_dict_entry_hits(nst_dict_entry_t *entry) {
+    return entry->access[0] + entry->access[1] + entry->access[2] + entry->access[3];
+}
+
 static inline int
 nst_dict_entry_expired(nst_dict_entry_t *entry) {
 
@@ -162,15 +277,23 @@ nst_dict_entry_valid(nst_dict_entry_t *entry) {
     return 0;
 }
 
-int nst_dict_init(nst_dict_t *dict, nst_store_t *store, nst_shmem_t *shmem, uint64_t dict_size);
+int nst_dict_init(nst_dict_t *dict, nst_store_t *store, nst_shmem_t *shmem, uint64_t dict_size,
+        int locks);
 void nst_dict_cleanup(nst_dict_t *dict);
+void nst_dict_rehash(nst_dict_t *dict);
+uint64_t nst_dict_evict(nst_dict_t *dict, uint64_t size);
+int nst_dict_victim(nst_dict_t *dict, uint64_t *hash);
 
 nst_dict_entry_t *nst_dict_get(nst_dict_t *dict, nst_key_t *key);
 nst_dict_entry_t *nst_dict_set(nst_dict_t *dict, nst_key_t *key, nst_http_txn_t *txn,
         nst_rule_prop_t *prop);
 
 int nst_dict_set_from_disk(nst_dict_t *dict, hpx_buffer_t *buf, nst_key_t *key, nst_http_txn_t *txn,
-        nst_rule_prop_t *prop, char *file, uint64_t expire);
+        nst_rule_prop_t *prop, char *file, uint64_t base, uint64_t size, uint64_t id,
+        uint64_t expire);
+void nst_dict_entry_set_disk(nst_dict_t *dict, nst_dict_entry_t *entry, nst_disk_obj_t *obj);
+nst_dict_entry_t *nst_dict_get_disk(nst_dict_t *dict, nst_key_t *key, char *file,
+        uint64_t base);
 
 void nst_dict_record_access(nst_dict_entry_t *entry);
 
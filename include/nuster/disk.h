@@ -22,8 +22,15 @@
 #ifndef _NUSTER_DISK_H
 #define _NUSTER_DISK_H
 
+#define XXH_STATIC_LINKING_ONLY
+#include <import/xxhash.h>
+
+#include <haproxy/chunk.h>
+#include <haproxy/pipe-t.h>
+
 #include <nuster/common.h>
 #include <nuster/key.h>
+#include <nuster/pcache.h>
 
 
 #define NST_DISK_VERSION  6
@@ -45,7 +52,8 @@
    8 * 11              8                       last-modified: on|off: 4, length: 4
    8 * 12              8                       ttl: 4, extend: 4
    8 * 13              8                       stale: 4, inactive: 4
-   8 * 14              20                      reserved
+   8 * 14              8                       object id, 0: unknown
+   8 * 15              8                       reserved
    NST_DISK_META_SIZE  key_len                 key
    + key_len           proxy_len               proxy
    + proxy_len         rule_len                rule
@@ -75,12 +83,141 @@
 #define NST_DISK_META_POS_TTL_EXTEND            8 * 12
 #define NST_DISK_META_POS_STALE                 8 * 13
 #define NST_DISK_META_POS_INACTIVE              8 * 13 + 4
+#define NST_DISK_META_POS_ID                    8 * 14
 
 #define NST_DISK_META_SIZE                      8 * 16
 #define NST_DISK_POS_KEY                        NST_DISK_META_SIZE
 
 #define NST_DISK_FILE_LEN                       NST_KEY_UUID_LEN * 2
 
+/*
+ * a hit reads the first NST_DISK_HEAD_SIZE bytes of an object at once, which
+ * usually covers the meta, the key, the validators and the serialized header,
+ * the applet then starts from them instead of reading them again
+ */
+#define NST_DISK_HEAD_SIZE                      4096
+
+/* at most this is spliced to the response pipe at once */
+#define NST_DISK_SPLICE_MAX                     (1 << 30)
+
+/*
+ * the small appends of an object being written are combined in a buffer of
+ * this size, larger ones are written directly
+ */
+#define NST_DISK_WBUF_SIZE                      (32 * 1024)
+
+/* disk-sync, or else the seconds between two syncs of the filesystem */
+#define NST_DISK_SYNC_NONE                      0
+#define NST_DISK_SYNC_ALWAYS                    -1
+
+enum {
+    NST_DISK_ENGINE_FILE     = 0,           /* one file per object */
+    NST_DISK_ENGINE_LOG,                    /* objects appended to segments */
+};
+
+/*
+ * log engine, root/log/<8-hex segment id>
+ *
+ * segment header, written to root/.tmp, synced then renamed, so a segment
+ * either does not exist or starts with a complete header:
+   Offset              Length(bytes)           Content
+   0                   8                       NUSTLOG
+   8                   4                       version
+   8 + 4               4                       reserved
+   8 * 2               8                       segment id
+   8 * 3               8                       creation time
+   8 * 4               24                      reserved
+   8 * 7               8                       XXH64 of the above
+ *
+ * record header, followed by an object in the layout above, is written
+ * after the object, the loader stops at the first incomplete record:
+   Offset              Length(bytes)           Content
+   0                   4                       magic
+   4                   4                       state: live|dead
+   8 * 1               8                       object length
+   8 * 2               8                       hash
+   8 * 3               8                       XXH64 of length and hash
+ */
+
+#define NST_DISK_LOG_VERSION                    1
+#define NST_DISK_LOG_MAGIC                      0x5254534e      /* NSTR */
+#define NST_DISK_LOG_HEADER_SIZE                8 * 8
+#define NST_DISK_LOG_RECORD_SIZE                8 * 4
+#define NST_DISK_LOG_HEADER_POS_VERSION         8
+#define NST_DISK_LOG_HEADER_POS_ID              8 * 2
+#define NST_DISK_LOG_HEADER_POS_CTIME           8 * 3
+#define NST_DISK_LOG_HEADER_POS_CHECK           8 * 7
+#define NST_DISK_LOG_RECORD_POS_STATE           4
+#define NST_DISK_LOG_RECORD_POS_LEN             8 * 1
+#define NST_DISK_LOG_RECORD_POS_HASH            8 * 2
+#define NST_DISK_LOG_RECORD_POS_CHECK           8 * 3
+
+/* max number of segments, and the size a segment is sealed at */
+#define NST_DISK_LOG_SEGMENTS                   4096
+#define NST_DISK_LOG_SEGMENT_SIZE               (64 * 1024 * 1024)
+
+/* a sealed segment is compacted once this percent of it is dead */
+#define NST_DISK_LOG_COMPACT_RATIO              50
+
+enum {
+    NST_DISK_LOG_RECORD_LIVE = 1,
+    NST_DISK_LOG_RECORD_DEAD,
+};
+
+enum {
+    NST_DISK_SEGMENT_FREE    = 0,
+    NST_DISK_SEGMENT_ACTIVE,                /* appended to */
+    NST_DISK_SEGMENT_SEALED,
+    NST_DISK_SEGMENT_COMPACTING,
+};
+
+/*
+ * index snapshot of the file engine, root/index, written to root/.tmp then
+ * renamed, so that the loader does not open every file:
+   Offset              Length(bytes)           Content
+   0                   8                       NSTINDEX
+   8                   4                       version
+   8 + 4               4                       reserved
+   8 * 2               8                       object count
+   8 * 3               8                       start time of the snapshot, ms
+   8 * 4               8                       records length
+   8 * 5               8                       XXH64 of the records
+   8 * 6               8                       reserved
+   8 * 7               8                       XXH64 of the above
+ *
+ * followed by the records, each padded to 8 bytes:
+   Offset              Length(bytes)           Content
+   0                   4                       record length
+   4                   4                       reserved
+   8                   40                      file name
+   8 + 40              pos_header              meta, key, ..., last-modified
+ */
+
+#define NST_DISK_INDEX_VERSION                  1
+#define NST_DISK_INDEX_HEADER_SIZE              8 * 8
+#define NST_DISK_INDEX_RECORD_SIZE              8 + NST_DISK_FILE_LEN
+#define NST_DISK_INDEX_HEADER_POS_VERSION       8
+#define NST_DISK_INDEX_HEADER_POS_COUNT         8 * 2
+#define NST_DISK_INDEX_HEADER_POS_START         8 * 3
+#define NST_DISK_INDEX_HEADER_POS_LEN           8 * 4
+#define NST_DISK_INDEX_HEADER_POS_BODY_CHECK    8 * 5
+#define NST_DISK_INDEX_HEADER_POS_CHECK         8 * 7
+#define NST_DISK_INDEX_RECORD_POS_FILE          8
+
+/* records are written out once this much is buffered */
+#define NST_DISK_INDEX_BUFSIZE                  (1024 * 1024)
+
+/*
+ * files modified this many seconds before the snapshot started are still
+ * loaded by the directory scan, they may have been published after their
+ * bucket was walked
+ */
+#define NST_DISK_INDEX_MARGIN                   60
+
+/* objects read by a loader thread before they are added to the dict */
+#define NST_DISK_LOAD_BATCH                     64
+#define NST_DISK_LOADERS_MAX                    64
+
 enum {
     NST_DISK_APPLET_ERROR    = -1,
     NST_DISK_APPLET_DONE     =  0,
@@ -94,18 +231,92 @@ typedef struct nst_disk_object {
     char               *file;               /* disk file */
     int                 fd;
     uint64_t            offset;
+    uint64_t            base;               /* offset of the object in the file */
+    uint64_t            size;               /* record size, log engine */
+    uint64_t            end;                /* end of the object once known */
+    hpx_buffer_t       *head;               /* bytes after the meta, hits */
+    nst_pcache_t       *pcache;             /* disk-direct, hits */
+    uint64_t            id;                 /* object id, from the entry */
+    uint64_t            hits;               /* accesses of the entry */
+    char               *wbuf;               /* appends not written yet */
+    int                 wlen;
+    uint64_t            wpos;               /* offset of wbuf in the file */
+    uint64_t            writes;             /* write syscalls */
+    uint64_t            written;            /* bytes written */
     char                meta[NST_DISK_META_SIZE];
 } nst_disk_obj_t;
 
+typedef struct nst_disk_segment {
+    char               *file;               /* constant for a given id */
+    uint64_t            size;               /* header and records appended */
+    uint64_t            invalid;            /* bytes of dead records */
+    int                 state;
+} nst_disk_segment_t;
+
+/*
+ * The index of the log engine is the dict, an entry refers to its segment
+ * file and to the offset of its object in it. Segments are shared by all
+ * processes, appends reserve their range under the lock.
+ */
+typedef struct nst_disk_log {
+#if defined NUSTER_USE_PTHREAD || defined USE_PTHREAD_PSHARED
+    pthread_mutex_t     mutex;
+#else
+    unsigned int        waiters;
+#endif
+
+    int                 active;             /* segment appended to, or -1 */
+    uint64_t            compacted;          /* bytes reclaimed by compaction */
+
+    nst_disk_segment_t  segment[NST_DISK_LOG_SEGMENTS];
+} nst_disk_log_t;
+
+
+/*
+ * The snapshot is written by the master in steps, a bucket at a time, and
+ * is only renamed into place once the whole dict is walked.
+ */
+typedef struct nst_disk_index {
+    int                 fd;                 /* snapshot being written, or -1 */
+    uint64_t            idx;                /* next dict slot */
+    uint64_t            version;            /* dict->rehash.version of the walk */
+    uint64_t            count;
+    uint64_t            len;                /* records written */
+    uint64_t            start;              /* ms */
+    uint64_t            time;               /* ms, last snapshot written */
+    XXH64_state_t       check;
+
+    char               *buf;                /* records not written yet */
+    uint64_t            size;
+    uint64_t            data;
+
+    uint64_t            mtime;              /* loader, files older are indexed, s */
+} nst_disk_index_t;
 
 typedef struct nst_disk {
     nst_shmem_t        *shmem;
     hpx_ist_t           root;               /* disk root directory */
+    int                 engine;
     int                 loaded;
     int                 idx;
     DIR                *dir;
     nst_dirent_t       *de;
     char               *file;
+    nst_disk_log_t     *log;                /* log engine only */
+    nst_disk_index_t    index;              /* file engine only */
+    uint64_t            indexed;            /* objects loaded from the index */
+    uint64_t            load_start;         /* ms */
+    uint64_t            load_time;          /* ms, from start to loaded */
+    uint64_t            load_count;         /* objects loaded */
+    int                 load_idx;           /* next directory to load */
+    int                 load_dirs;          /* directories loaded */
+    int                 loaders;            /* loader threads */
+    nst_pcache_t       *pcache;             /* disk-direct, the worker's own */
+    int                 sync;               /* NST_DISK_SYNC_*, or seconds */
+    uint64_t            sync_time;          /* ms, last sync of the filesystem */
+    uint64_t            writes;             /* write syscalls of the objects */
+    uint64_t            written;            /* bytes written by them */
+    uint64_t           *commit_latency;     /* in global.nuster.stats */
 } nst_disk_t;
 
 
@@ -124,6 +335,12 @@ nst_disk_path_file_len(hpx_ist_t root) {
     return root.len + 47;
 }
 
+/* /log/00000000: 13 */
+static inline int
+nst_disk_path_segment_len(hpx_ist_t root) {
+    return root.len + 13;
+}
+
 static inline int
 nst_disk_file_remove(const char *file) {
     return remove(file);
@@ -131,7 +348,7 @@ nst_disk_file_remove(const char *file) {
 
 static inline int
 nst_disk_file_create(const char *pathname) {
-    return open(pathname, O_CREAT | O_WRONLY, 0600);
+    return open(pathname, O_CREAT | O_RDWR, 0600);
 }
 
 static inline int
@@ -309,6 +526,16 @@ nst_disk_meta_get_inactive(char *p) {
     return *(int32_t *)(p + NST_DISK_META_POS_INACTIVE);
 }
 
+static inline void
+nst_disk_meta_set_id(char *p, uint64_t v) {
+    *(uint64_t *)(p + NST_DISK_META_POS_ID) = v;
+}
+
+static inline uint64_t
+nst_disk_meta_get_id(char *p) {
+    return *(uint64_t *)(p + NST_DISK_META_POS_ID);
+}
+
 static inline int
 nst_disk_meta_check_expire(char *p) {
     uint64_t  expire = nst_disk_meta_get_expire(p);
@@ -404,24 +631,86 @@ nst_disk_pos_header(nst_disk_obj_t *obj) {
         + nst_disk_meta_get_last_modified_len(obj->meta);
 }
 
+/*
+ * the object end in its file, a segment is followed by the next record
+ */
+static inline uint64_t
+nst_disk_obj_end(nst_disk_obj_t *obj) {
+
+    if(obj->size) {
+        return obj->base + obj->size - NST_DISK_LOG_RECORD_SIZE;
+    }
+
+    return 0;
+}
+
+/*
+ * bytes of [offset, offset + len) read by the head of an object, whose first
+ * byte is at start, *buf is set to them
+ */
 static inline int
-nst_disk_write(nst_disk_obj_t *obj, char *buf, int len) {
-    ssize_t ret = pwrite(obj->fd, buf, len, obj->offset);
+nst_disk_head_read(hpx_buffer_t *head, uint64_t start, char **buf, int len, uint64_t offset) {
 
-    if(ret != len) {
-        return NST_ERR;
+    if(!head || offset < start || offset >= start + head->data) {
+        return 0;
     }
 
-    obj->offset += len;
+    *buf = head->area + (offset - start);
 
-    return NST_OK;
+    if(len > start + head->data - offset) {
+        len = start + head->data - offset;
+    }
+
+    return len;
 }
 
+int nst_disk_obj_flush(nst_disk_obj_t *obj);
+
+/*
+ * writes len bytes at the offset of obj, small writes following each other
+ * are only copied to the write buffer of obj until it is flushed
+ */
 static inline int
-nst_disk_write_meta(nst_disk_obj_t *obj) {
-    obj->offset = 0;
+nst_disk_write(nst_disk_obj_t *obj, char *buf, int len) {
+    ssize_t ret;
+
+    if(obj->wbuf) {
+
+        if(obj->wlen && (obj->wpos + obj->wlen != obj->offset
+                    || obj->wlen + len > NST_DISK_WBUF_SIZE)) {
+
+            if(nst_disk_obj_flush(obj) != NST_OK) {
+                return NST_ERR;
+            }
+        }
+
+        if(len < NST_DISK_WBUF_SIZE) {
+
+            if(!obj->wlen) {
+                obj->wpos = obj->offset;
+            }
+
+            memcpy(obj->wbuf + obj->wlen, buf, len);
+
+            obj->wlen   += len;
+            obj->offset += len;
+
+            return NST_OK;
+        }
+    }
+
+    ret = pwrite(obj->fd, buf, len, obj->offset);
+
+    obj->writes++;
+
+    if(ret != len) {
+        return NST_ERR;
+    }
+
+    obj->written += len;
+    obj->offset  += len;
 
-    return nst_disk_write(obj, obj->meta, NST_DISK_META_SIZE);
+    return NST_OK;
 }
 
 static inline int
@@ -473,6 +762,7 @@ nst_disk_write_last_modified(nst_disk_obj_t *obj, hpx_ist_t lm) {
     return nst_disk_write(obj, lm.ptr, lm.len);
 }
 
+int nst_disk_read_meta(nst_disk_obj_t *obj);
 int nst_disk_read_key(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key);
 int nst_disk_read_proxy(nst_disk_obj_t *obj, hpx_ist_t proxy);
 int nst_disk_read_rule(nst_disk_obj_t *obj, hpx_ist_t rule);
@@ -481,43 +771,89 @@ int nst_disk_read_path(nst_disk_obj_t *obj, hpx_ist_t path);
 int nst_disk_read_etag(nst_disk_obj_t *obj, hpx_ist_t etag);
 int nst_disk_read_last_modified(nst_disk_obj_t *obj, hpx_ist_t last_modified);
 
-int nst_disk_init(nst_disk_t *disk, hpx_ist_t root, nst_shmem_t *shmem, int clean_temp);
+int nst_disk_mkdir(char *path);
+int nst_disk_init(nst_disk_t *disk, hpx_ist_t root, nst_shmem_t *shmem, int clean_temp,
+        int engine);
+const char *nst_disk_engine(int engine);
 void nst_disk_load(nst_core_t *core);
 void nst_disk_cleanup(nst_core_t *core);
 int nst_disk_purge_by_key(nst_disk_obj_t *disk, nst_key_t *key, hpx_ist_t root);
-int nst_disk_purge_by_path(char *path);
-void nst_disk_update_expire(char *file, uint64_t expire);
+void nst_disk_update_expire(char *file, uint64_t base, uint64_t expire);
+void nst_disk_obj_sync(nst_disk_t *disk, int fd);
+void nst_disk_sync(nst_disk_t *disk);
+void nst_disk_obj_remove(nst_disk_t *disk, char *file, uint64_t base, uint64_t size);
+void nst_disk_obj_release(nst_disk_t *disk, char *file, uint64_t size);
+int nst_disk_obj_load(nst_core_t *core, nst_disk_obj_t *obj, char *data);
+void nst_disk_meta_init(char *p, uint64_t hash, uint64_t expire, uint64_t header_len,
+        uint64_t payload_len, uint64_t key_len, nst_http_txn_t *txn, nst_rule_prop_t *prop);
+
+int nst_disk_log_init(nst_disk_t *disk);
+void nst_disk_log_load(nst_core_t *core);
+void nst_disk_log_compact(nst_core_t *core);
+int nst_disk_log_append(nst_disk_t *disk, nst_disk_obj_t *obj);
+void nst_disk_log_remove(nst_disk_t *disk, char *file, uint64_t base, uint64_t size);
+void nst_disk_log_release(nst_disk_t *disk, char *file, uint64_t size);
+
+void nst_disk_index_save(nst_core_t *core);
+int nst_disk_index_load(nst_core_t *core);
+
+/*
+ * the file of an entry, a copy with the file engine, the segment's one with
+ * the log engine
+ */
+static inline char *
+nst_disk_file_dup(nst_disk_t *disk, char *file) {
+    char  *p;
+
+    if(disk->engine == NST_DISK_ENGINE_LOG) {
+        return file;
+    }
+
+    p = nst_shmem_alloc(disk->shmem, strlen(file) + 1);
+
+    if(p) {
+        memcpy(p, file, strlen(file) + 1);
+    }
+
+    return p;
+}
+
+static inline void
+nst_disk_file_free(nst_disk_t *disk, char *file) {
+
+    if(disk->engine == NST_DISK_ENGINE_FILE) {
+        nst_shmem_free(disk->shmem, file);
+    }
+}
 
 int nst_disk_obj_create(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key,
         nst_http_txn_t *txn, nst_rule_prop_t *prop);
 
-static inline int
-nst_disk_obj_append(nst_disk_t *disk, nst_disk_obj_t *obj, char *buf, int len) {
-
-    if(nst_disk_write(obj, buf, len) != NST_OK) {
-        if(obj->fd != -1) {
-            close(obj->fd);
-            obj->fd = -1;
-        }
+/*
+ * the write buffer of an object being written, and the counters of its
+ * writes, go back to the disk once it is finished or aborted
+ */
+static inline void
+nst_disk_obj_wbuf_free(nst_disk_t *disk, nst_disk_obj_t *obj) {
 
-        if(obj->file) {
-            remove(obj->file);
-            nst_shmem_free(disk->shmem, obj->file);
-            obj->file = NULL;
-        }
+    if(obj->writes) {
+        __sync_add_and_fetch(&disk->writes, obj->writes);
+        __sync_add_and_fetch(&disk->written, obj->written);
 
-        return NST_ERR;
+        obj->writes  = 0;
+        obj->written = 0;
     }
 
-    return NST_OK;
-}
+    free(obj->wbuf);
 
-int
-nst_disk_obj_finish(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key, nst_http_txn_t *txn,
-        uint64_t expire);
+    obj->wbuf = NULL;
+    obj->wlen = 0;
+}
 
 static inline void
 nst_disk_obj_abort(nst_disk_t *disk, nst_disk_obj_t *obj) {
+    nst_disk_obj_wbuf_free(disk, obj);
+
     if(obj->fd != -1) {
         close(obj->fd);
         obj->fd = -1;
@@ -530,11 +866,38 @@ nst_disk_obj_abort(nst_disk_t *disk, nst_disk_obj_t *obj) {
     }
 }
 
-int nst_disk_obj_valid(nst_disk_obj_t *disk, nst_key_t *key);
-int nst_disk_obj_exists(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key);
+static inline int
+nst_disk_obj_append(nst_disk_t *disk, nst_disk_obj_t *obj, char *buf, int len) {
+
+    if(nst_disk_write(obj, buf, len) != NST_OK) {
+        nst_disk_obj_abort(disk, obj);
+
+        return NST_ERR;
+    }
+
+    return NST_OK;
+}
 
-#ifdef USE_THREAD
-void *nst_disk_load_thread(void *core);
+int
+nst_disk_obj_finish(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key, nst_http_txn_t *txn,
+        uint64_t expire);
+
+static inline void
+nst_disk_obj_head_free(nst_disk_obj_t *obj) {
+
+    if(obj->head) {
+        free_trash_chunk(obj->head);
+        obj->head = NULL;
+    }
+}
+
+int nst_disk_applet_read(hpx_appctx_t *appctx, char **buf, int len, uint64_t offset);
+
+#if defined(USE_LINUX_SPLICE)
+int nst_disk_splice(int fd, struct pipe *pipe, uint64_t offset, uint64_t len);
 #endif
 
+int nst_disk_obj_valid(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key);
+int nst_disk_obj_exists(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key);
+
 #endif /* _NUSTER_DISK_H */
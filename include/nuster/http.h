@@ -22,10 +22,15 @@
 #ifndef _NUSTER_HTTP_H
 #define _NUSTER_HTTP_H
 
+#include <haproxy/htx-t.h>
+
 #include <nuster/common.h>
 #include <nuster/memory.h>
 
 
+/* DATA items from this size are sent alone in the response htx */
+#define NST_HTTP_ZEROCOPY_MIN_SIZE      4096
+
 enum {
     NST_HTTP_100 = 0,
     NST_HTTP_200,
@@ -75,6 +80,17 @@ int nst_http_parse_htx(hpx_stream_t *s, hpx_buffer_t *buf, nst_http_txn_t *txn);
 int nst_http_find_param(char *query_beg, char *query_end, char *name, char **val, int *val_len);
 int nst_http_memory_item_to_htx(nst_memory_item_t *item, hpx_htx_t *htx);
 
+/*
+ * the mux swaps the channel buffer with its output buffer instead of copying
+ * it when the htx holds a single DATA block, so large DATA items are sent
+ * alone to be copied only once from the memory zone
+ */
+static inline int
+nst_http_memory_item_alone(nst_memory_item_t *item) {
+    return (item->info >> 28) == HTX_BLK_DATA
+        && (item->info & 0xfffffff) >= NST_HTTP_ZEROCOPY_MIN_SIZE;
+}
+
 void nst_http_reply(hpx_stream_t *s, int idx);
 int nst_http_reply_100(hpx_stream_t *s);
 void nst_http_reply_304(hpx_stream_t *s, nst_http_txn_t *txn);
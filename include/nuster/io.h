@@ -0,0 +1,75 @@
+/*
+ * include/nuster/io.h
+ * This file defines everything related to nuster background disk passes.
+ *
+ * Copyright (C) Jiang Wenyuan, < koubunen AT gmail DOT com >
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef _NUSTER_IO_H
+#define _NUSTER_IO_H
+
+#include <pthread.h>
+
+#include <nuster/common.h>
+
+
+/* a run of the saver or the cleaner gives its thread back after this */
+#define NST_IO_SLICE_MS                 10
+
+enum {
+    NST_IO_JOB_SAVER            = 0,    /* nst_store_memory_sync_disk */
+    NST_IO_JOB_CLEANER,                 /* nst_disk_cleanup */
+    NST_IO_JOB_LOADER,                  /* nst_disk_load until loaded */
+    NST_IO_JOB_INDEX,                   /* nst_disk_index_save */
+    NST_IO_JOB_SYNC,                    /* nst_disk_sync */
+    NST_IO_JOBS,
+};
+
+typedef struct nst_io_job {
+    struct nst_io_job          *next;
+
+    nst_core_t                 *core;
+    int                         type;
+    int                         count;          /* passes of a run */
+    int                         queued;         /* from submit to the end of the run */
+} nst_io_job_t;
+
+/*
+ * The disk passes of a core are queued by the master's poll loop and run by
+ * a pool of threads, so that filesystem syscalls never delay the loop.
+ * A job is queued once at most, a pass thus never runs concurrently with
+ * itself. The pool only lives in the master and is started on first use,
+ * after the fork.
+ */
+typedef struct nst_io {
+    nst_io_job_t                job[NST_IO_JOBS];
+
+    nst_io_job_t               *head;
+    nst_io_job_t               *tail;
+
+    int                         threads;
+    int                         started;
+
+    pthread_mutex_t             mutex;
+    pthread_cond_t              cond;
+} nst_io_t;
+
+
+int nst_io_init(nst_io_t *io, nst_core_t *core, int threads);
+void nst_io_submit(nst_io_t *io, int type, int count);
+
+#endif /* _NUSTER_IO_H */
@@ -29,9 +29,16 @@
 
 #define NST_KEY_UUID_LEN        20
 
+/* keys up to this size are allocated from a pool, larger ones with malloc */
+#define NST_KEY_POOL_SIZE       256
+
+/* larger bodies are replaced by their length and SHA-1 in keys */
+#define NST_KEY_BODY_DIGEST_SIZE    1024
+
 enum {
     NST_KEY_MEMORY_CHECKED = 0x0001,
     NST_KEY_DISK_CHECKED   = 0x0002,
+    NST_KEY_UUID           = 0x0004,    /* uuid computed, see nst_key_uuid */
 };
 
 typedef struct nst_key {
@@ -65,16 +72,16 @@ nst_key_disk_set_checked(nst_key_t *key) {
 
 static inline void
 nst_key_reset_flag(nst_key_t *key) {
-    key->flags = 0;
+    key->flags &= NST_KEY_UUID;
 }
 
+/*
+ * the delimiters are written by nst_key_catist and nst_key_catdel, the chunk
+ * does not need zeroing
+ */
 static inline hpx_buffer_t *
 nst_key_init() {
-    hpx_buffer_t  *key = get_trash_chunk();
-
-    memset(key->area, 0, key->size);
-
-    return key;
+    return get_trash_chunk();
 }
 
 static inline int
@@ -98,7 +105,8 @@ nst_key_catist(hpx_buffer_t *key, hpx_ist_t v) {
     }
 
     memcpy(key->area + key->data, v.ptr, v.len);
-    key->data += v.len + 1;
+    key->data += v.len;
+    key->area[key->data++] = '\0';
 
     return NST_OK;
 }
@@ -110,7 +118,7 @@ nst_key_catdel(hpx_buffer_t *key) {
         return NST_ERR;
     }
 
-    key->data += 1;
+    key->area[key->data++] = '\0';
 
     return NST_OK;
 }
@@ -118,16 +126,19 @@ nst_key_catdel(hpx_buffer_t *key) {
 /*
  * It's the caller's reponsibility to allocate str and zero termination
  */
+unsigned char *nst_key_uuid(nst_key_t *key);
+
 static inline void
 nst_key_uuid_stringify(nst_key_t *key, char *str){
-    int  i;
+    unsigned char  *uuid = nst_key_uuid(key);
+    int             i;
 
     for(i = 0; i < NST_KEY_UUID_LEN; i++) {
-        sprintf((char*)&(str[i*2]), "%02x", key->uuid[i]);
+        sprintf((char*)&(str[i*2]), "%02x", uuid[i]);
     }
 }
 
-void nst_key_hash(nst_key_t *key);
+void nst_key_free(nst_key_t *key);
 
 void nst_key_debug(hpx_stream_t *s, nst_key_t *key);
 
@@ -39,9 +39,16 @@ enum {
     NST_MANAGER_REGEX_HOST,
 };
 
+/*
+ * latency histogram in us, four buckets per power of 2,
+ * see nst_stats_latency_idx
+ */
+#define NST_STATS_LATENCY_BUCKETS               96
+
 enum {
     NST_STATS_HEADER,
     NST_STATS_PAYLOAD,
+    NST_STATS_CHUNK,
     NST_STATS_PROXY,
     NST_STATS_DONE,
 };
@@ -54,6 +61,10 @@ typedef struct nst_stats {
         uint64_t                abort;
         uint64_t                bypass;
         uint64_t                bytes;
+        uint64_t                admitted;
+        uint64_t                rejected;
+        uint64_t                disk_latency[NST_STATS_LATENCY_BUCKETS];
+        uint64_t                disk_commit_latency[NST_STATS_LATENCY_BUCKETS];
     } cache;
 
     struct {
@@ -62,6 +73,8 @@ typedef struct nst_stats {
         uint64_t                post;
         uint64_t                delete;
         uint64_t                abort;
+        uint64_t                disk_latency[NST_STATS_LATENCY_BUCKETS];
+        uint64_t                disk_commit_latency[NST_STATS_LATENCY_BUCKETS];
     } nosql;
 
 #if defined NUSTER_USE_PTHREAD || defined USE_PTHREAD_PSHARED
@@ -80,7 +93,9 @@ void nst_manager_init();
 int nst_stats_init();
 int nst_stats_applet(hpx_stream_t *s, hpx_channel_t *req, hpx_proxy_t *px);
 void nst_stats_update_cache(int state, uint64_t bytes);
+void nst_stats_update_admission(int admitted);
 void nst_stats_update_nosql(hpx_http_meth_t meth);
+void nst_stats_update_latency(uint64_t *latency, uint64_t us);
 
 /* purger */
 void nst_purger_init();
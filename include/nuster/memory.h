@@ -28,6 +28,9 @@
 /*
  * A nst_memory_object contains a complete http response data
  * All nst_memory_object are stored in a circular singly linked list
+ * A packed object has all its items laid out in the single chunk obj->item
+ * An object being filled can be read by followers, items are linked once
+ * written and never change afterwards, done is set once the last is linked
  */
 typedef struct nst_memory_item {
     struct nst_memory_item      *next;
@@ -41,6 +44,9 @@ typedef struct nst_memory_object {
 
     int                          clients;
     int                          invalid;
+    int                          packed;
+    int                          done;          /* all the items are linked */
+    int                          waiting;       /* followers wait for more items */
 
     nst_memory_item_t           *item;
 } nst_memory_obj_t;
@@ -53,6 +59,9 @@ typedef struct nst_memory {
 
     uint64_t                     count;
     uint64_t                     invalid;
+    uint64_t                     evicted;
+
+    struct nst_dict             *dict;          /* evict from it when full, or NULL */
 
 #if defined NUSTER_USE_PTHREAD || defined USE_PTHREAD_PSHARED
     pthread_mutex_t              mutex;
@@ -71,16 +80,40 @@ nst_memory_incr_invalid(nst_memory_t *mem) {
     nst_shctx_unlock(mem);
 }
 
+void *nst_memory_alloc(nst_memory_t *mem, int size);
 
 static inline nst_memory_item_t *
 nst_memory_alloc_item(nst_memory_t *mem, uint32_t size) {
-    return nst_shmem_alloc(mem->shmem, sizeof(nst_memory_item_t) + size);
+    return nst_memory_alloc(mem, sizeof(nst_memory_item_t) + size);
 }
 
 nst_memory_obj_t *nst_memory_obj_create(nst_memory_t *mem);
+uint64_t nst_memory_obj_evict(nst_memory_t *mem, nst_memory_obj_t *obj);
 
 int nst_memory_obj_append(nst_memory_t *mem, nst_memory_obj_t *obj, nst_memory_item_t **tail,
-        const char *buf, uint32_t len, uint32_t info);
+        hpx_buffer_t *pack, const char *buf, uint32_t len, uint32_t info);
+int nst_memory_obj_pack(nst_memory_t *mem, nst_memory_obj_t *obj, hpx_buffer_t *pack);
+
+/*
+ * items of a small object are staged in pack, a process local buffer, and
+ * copied to a single chunk once the object is complete
+ */
+static inline void
+nst_memory_pack_init(hpx_buffer_t *pack, uint32_t size) {
+    pack->area = malloc(size);
+    pack->size = pack->area ? size : 0;
+    pack->data = 0;
+    pack->head = 0;
+}
+
+static inline void
+nst_memory_pack_free(hpx_buffer_t *pack) {
+    free(pack->area);
+
+    pack->area = NULL;
+    pack->size = 0;
+    pack->data = 0;
+}
 
 static inline int
 nst_memory_obj_finish(nst_memory_t *mem, nst_memory_obj_t *obj) {
@@ -112,6 +145,53 @@ nst_memory_obj_invalid(nst_memory_obj_t *obj) {
     return NST_ERR;
 }
 
+/*
+ * the item after item, or the first one if item is NULL, of an object which
+ * may still be filled
+ */
+static inline nst_memory_item_t *
+nst_memory_obj_next(nst_memory_obj_t *obj, nst_memory_item_t *item) {
+    return __atomic_load_n(item ? &item->next : &obj->item, __ATOMIC_ACQUIRE);
+}
+
+static inline int
+nst_memory_obj_done(nst_memory_obj_t *obj) {
+    return __atomic_load_n(&obj->done, __ATOMIC_ACQUIRE);
+}
+
+static inline void
+nst_memory_obj_set_done(nst_memory_obj_t *obj) {
+    __atomic_store_n(&obj->done, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * A follower at the end of the items sets waiting, then checks them again,
+ * the filler links an item, then checks waiting, so that at least one of
+ * them sees what the other did.
+ */
+static inline void
+nst_memory_obj_wait(nst_memory_obj_t *obj) {
+    obj->waiting = 1;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/*
+ * returns 1 if followers have to be woken for the items linked before
+ */
+static inline int
+nst_memory_obj_waited(nst_memory_obj_t *obj) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if(obj->waiting) {
+        obj->waiting = 0;
+
+        return 1;
+    }
+
+    return 0;
+}
+
 static inline void
 nst_memory_obj_attach(nst_memory_t *mem, nst_memory_obj_t *obj) {
     nst_shctx_lock(mem);
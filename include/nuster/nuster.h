@@ -33,6 +33,7 @@
 #include <nuster/http.h>
 #include <nuster/key.h>
 #include <nuster/store.h>
+#include <nuster/aio.h>
 #include <nuster/core.h>
 #include <nuster/cache.h>
 #include <nuster/nosql.h>
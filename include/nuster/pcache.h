@@ -0,0 +1,82 @@
+/*
+ * include/nuster/pcache.h
+ * This file defines everything related to the nuster disk page cache.
+ *
+ * Copyright (C) Jiang Wenyuan, < koubunen AT gmail DOT com >
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef _NUSTER_PCACHE_H
+#define _NUSTER_PCACHE_H
+
+#include <pthread.h>
+
+#include <nuster/common.h>
+
+
+/* blocks are aligned to this in memory and in files, as O_DIRECT requires */
+#define NST_PCACHE_BLOCK_SIZE           4096
+
+/* max number of blocks read by one miss */
+#define NST_PCACHE_READ_BLOCKS          16
+
+/* max number of passes of the hand a block survives */
+#define NST_PCACHE_REF_MAX              3
+
+typedef struct nst_pcache_block {
+    struct nst_pcache_block    *next;           /* hash chain */
+
+    uint64_t                    id;             /* object id, 0: free */
+    uint64_t                    offset;         /* offset in the file */
+    int                         len;            /* less than a block at the end of a file */
+    int                         ref;            /* decremented by the hand, evicted at 0 */
+
+    char                       *data;
+} nst_pcache_block_t;
+
+/*
+ * Blocks of the disk objects read by the hits of a worker when disk-direct is
+ * on, the files are then opened with O_DIRECT and do not fill the kernel page
+ * cache. A block is identified by the id of its object, which changes with
+ * every new version of it, and by its offset, so a block never goes stale.
+ * It lives in the worker's own memory, allocated once, and is shared by its
+ * threads.
+ *
+ * Blocks are evicted by a clock hand, a block starts with more passes the
+ * more its entry was accessed, and gains one with every hit.
+ */
+typedef struct nst_pcache {
+    pthread_mutex_t             mutex;
+
+    nst_pcache_block_t         *block;
+    nst_pcache_block_t        **table;
+    char                       *data;
+
+    uint64_t                    count;          /* number of blocks */
+    uint64_t                    mask;           /* of the table */
+    uint64_t                    hand;
+    uint64_t                    used;           /* blocks in use */
+
+    uint64_t                    hits;           /* blocks read from the cache */
+    uint64_t                    misses;         /* blocks read from the disk */
+} nst_pcache_t;
+
+
+nst_pcache_t *nst_pcache_create(uint64_t size);
+int nst_pcache_read(nst_pcache_t *pcache, int fd, uint64_t id, uint64_t hits, char *buf, int len,
+        uint64_t offset);
+
+#endif /* _NUSTER_PCACHE_H */
@@ -47,9 +47,10 @@ _nst_shctx_init(pthread_mutex_t *mutex) {
     return NST_OK;
 }
 
-#define nst_shctx_init(shctx)   _nst_shctx_init(&(shctx)->mutex)
-#define nst_shctx_lock(shctx)   pthread_mutex_lock(&(shctx)->mutex)
-#define nst_shctx_unlock(shctx) pthread_mutex_unlock(&(shctx)->mutex)
+#define nst_shctx_init(shctx)    _nst_shctx_init(&(shctx)->mutex)
+#define nst_shctx_lock(shctx)    pthread_mutex_lock(&(shctx)->mutex)
+#define nst_shctx_trylock(shctx) pthread_mutex_trylock(&(shctx)->mutex)
+#define nst_shctx_unlock(shctx)  pthread_mutex_unlock(&(shctx)->mutex)
 
 #else
 
@@ -178,6 +179,12 @@ _shctx_lock(unsigned int *waiters) {
 
 }
 
+/* returns 0 if locked */
+static inline int
+_shctx_trylock(unsigned int *waiters) {
+    return cmpxchg(waiters, 0, 1) != 0;
+}
+
 static inline void
 _shctx_unlock(unsigned int *waiters) {
 
@@ -194,9 +201,10 @@ _nst_shctx_init(unsigned int *waiters) {
 
     return NST_OK;
 }
-#define nst_shctx_init(shctx)   _nst_shctx_init(&(shctx)->waiters)
-#define nst_shctx_lock(shctx)   _shctx_lock(&(shctx)->waiters)
-#define nst_shctx_unlock(shctx) _shctx_unlock(&(shctx)->waiters)
+#define nst_shctx_init(shctx)    _nst_shctx_init(&(shctx)->waiters)
+#define nst_shctx_lock(shctx)    _shctx_lock(&(shctx)->waiters)
+#define nst_shctx_trylock(shctx) _shctx_trylock(&(shctx)->waiters)
+#define nst_shctx_unlock(shctx)  _shctx_unlock(&(shctx)->waiters)
 
 #endif
 
@@ -32,6 +32,44 @@
 #define NST_SHMEM_BLOCK_MAX_SIZE      1024 * 1024 * 2
 #define NST_SHMEM_BLOCK_MAX_SHIFT     21
 #define NST_SHMEM_INFO_BITMAP_BITS    32
+#define NST_SHMEM_CHUNK_CLASSES       (NST_SHMEM_BLOCK_MAX_SHIFT - NST_SHMEM_CHUNK_MIN_SHIFT + 1)
+
+/*
+ * chunk sizes: every power of two, plus three sizes in between so that there
+ * are four classes per power of two, e.g. 320 384 448 512, if the step is a
+ * multiple of 8 and a block holds more chunks than with the next power of two
+ */
+#define NST_SHMEM_CLASSES             (NST_SHMEM_CHUNK_CLASSES * 4)
+
+/*
+ * per-thread cache of free chunks: at most NST_SHMEM_CACHE_CHUNKS and
+ * NST_SHMEM_CACHE_BYTES per chunk class, for the first NST_SHMEM_CACHE_ZONES
+ * zones created, in the worker threads only
+ */
+#define NST_SHMEM_CACHE_ZONES         4
+#define NST_SHMEM_CACHE_CHUNKS        16
+#define NST_SHMEM_CACHE_BYTES         65536
+
+#define NST_SHMEM_HUGEPAGE_SIZE       (2 * 1024 * 1024)
+#define NST_SHMEM_NUMA_NODES          64
+
+/* flags of nst_shmem_create */
+enum {
+    NST_SHMEM_HUGEPAGE            = 0x01,     /* back the zone with huge pages */
+    NST_SHMEM_PREFAULT            = 0x02,     /* touch every page at creation */
+};
+
+/* numa policy, or a node to bind to */
+enum {
+    NST_SHMEM_NUMA_OFF            = -1,
+    NST_SHMEM_NUMA_INTERLEAVE     = -2,
+};
+
+enum {
+    NST_SHMEM_BACKING_NORMAL      = 0,        /* normal pages */
+    NST_SHMEM_BACKING_HUGETLB,                /* MAP_HUGETLB */
+    NST_SHMEM_BACKING_TRANSPARENT,            /* MADV_HUGEPAGE */
+};
 
 
 /* start                                 alignment                   stop
@@ -48,15 +86,31 @@
  * | bitmap: 32 | reserved: 16 | 5 | full: 1 | bitmap: 1 | inited: 1 | type: 8 |
  * bitmap: points to bitmap area, doesn't change once set
  * chunk size[n]: 1<<(NST_SHMEM_CHUNK_MIN_SHIFT + n)
+ *
+ * When there are more than NST_SHMEM_INFO_BITMAP_BITS chunks in a block,
+ * bitmap has one bit per chunk, summary one bit per full bitmap word and
+ * top one bit per full summary word, so a free chunk is found in three steps.
  */
 typedef struct nst_shmem_ctrl {
     uint64_t                     info;
     uint8_t                     *bitmap;
+    uint64_t                    *summary;     /* follows bitmap */
+    uint64_t                     top;
+    uint32_t                     count;       /* number of allocated chunks */
 
     struct nst_shmem_ctrl       *prev;
     struct nst_shmem_ctrl       *next;
 } nst_shmem_ctrl_t;
 
+typedef struct nst_shmem_cache {
+    int                          count;
+    void                        *chunk[NST_SHMEM_CACHE_CHUNKS];
+
+    /* not yet added to nst_shmem.stats */
+    uint64_t                     allocs;
+    uint64_t                     requested;
+} nst_shmem_cache_t;
+
 typedef struct nst_shmem {
     uint8_t                     *start;
     uint8_t                     *stop;
@@ -72,6 +126,10 @@ typedef struct nst_shmem {
     uint64_t                     size;
     uint64_t                     used;
 
+    int                          backing;
+    int                          numa;        /* numa policy applied */
+    int                          prefault;
+
     uint32_t                     block_size;  /* max shmem can be allocated */
     uint32_t                     chunk_size;  /* min shmem can be allocated */
     int                          chunk_shift;
@@ -79,9 +137,22 @@ typedef struct nst_shmem {
 
     int                          chunks;
     int                          blocks;
+    int                          zone;        /* index of per-thread caches, -1: none */
 
     nst_shmem_ctrl_t           **chunk;
     nst_shmem_ctrl_t            *block;
+
+    uint32_t                     class_size[NST_SHMEM_CLASSES];
+
+    /* chunk class of sizes in (2**(n-1), 2**n], by n - chunk_shift and quarter */
+    uint8_t                      class_of[NST_SHMEM_CHUNK_CLASSES][4];
+
+    /* cumulative, per chunk class */
+    struct {
+        uint64_t                 allocs;
+        uint64_t                 requested;   /* bytes asked for */
+    } stats[NST_SHMEM_CLASSES];
+
     nst_shmem_ctrl_t            *empty;
     nst_shmem_ctrl_t            *full;
 
@@ -134,9 +205,13 @@ _nst_shmem_block_clear_full(nst_shmem_ctrl_t *block) {
 }
 
 nst_shmem_t *
-nst_shmem_create(char *name, uint64_t size, uint32_t block_size, uint32_t chunk_size);
+nst_shmem_create(char *name, uint64_t size, uint32_t block_size, uint32_t chunk_size, int flags,
+        int numa);
 
+void *nst_shmem_alloc_blocks(nst_shmem_t *shmem, uint64_t size);
+void *nst_shmem_alloc_locked(nst_shmem_t *shmem, int size);
 void *nst_shmem_alloc(nst_shmem_t *shmem, int size);
+void nst_shmem_free_locked(nst_shmem_t *shmem, void *p);
 void nst_shmem_free(nst_shmem_t *shmem, void *p);
 
 #endif /* _NUSTER_SHMEM_H */
@@ -0,0 +1,62 @@
+/*
+ * include/nuster/sketch.h
+ * This file defines everything related to nuster sketch.
+ *
+ * Copyright (C) Jiang Wenyuan, < koubunen AT gmail DOT com >
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef _NUSTER_SKETCH_H
+#define _NUSTER_SKETCH_H
+
+#include <nuster/common.h>
+#include <nuster/shmem.h>
+
+
+#define NST_SKETCH_DEPTH                4
+
+/* max value of a counter */
+#define NST_SKETCH_COUNTER_MAX          15
+
+/* counters are halved every width * NST_SKETCH_SAMPLE_FACTOR additions */
+#define NST_SKETCH_SAMPLE_FACTOR        10
+
+/*
+ * A nst_sketch is a count-min sketch estimating how often a key was
+ * requested recently, used by the admission policy.
+ * Updates are not locked, a lost increment only makes the estimation a bit
+ * lower.
+ */
+typedef struct nst_sketch {
+    uint8_t                    *row[NST_SKETCH_DEPTH];
+    uint64_t                    width;          /* number of counters of a row, power of 2 */
+
+    uint64_t                    additions;
+    uint64_t                    sample;         /* age once additions reaches sample */
+
+#if defined NUSTER_USE_PTHREAD || defined USE_PTHREAD_PSHARED
+    pthread_mutex_t             mutex;
+#else
+    unsigned int                waiters;
+#endif
+} nst_sketch_t;
+
+
+int nst_sketch_init(nst_sketch_t *sketch, nst_shmem_t *shmem, uint64_t width);
+void nst_sketch_add(nst_sketch_t *sketch, uint64_t hash);
+int nst_sketch_estimate(nst_sketch_t *sketch, uint64_t hash);
+
+#endif /* _NUSTER_SKETCH_H */
@@ -27,6 +27,9 @@
 #include <nuster/disk.h>
 
 
+/* max entries pinned by one call of nst_store_memory_sync_disk */
+#define NST_STORE_SYNC_BATCH            64
+
 typedef struct nst_store {
     nst_memory_t                memory;
     nst_disk_t                  disk;
@@ -34,13 +37,14 @@ typedef struct nst_store {
 
 
 static inline int
-nst_store_init(nst_store_t *store, hpx_ist_t root, nst_shmem_t *shmem, int clean_temp) {
+nst_store_init(nst_store_t *store, hpx_ist_t root, nst_shmem_t *shmem, int clean_temp,
+        int engine) {
 
     if(nst_memory_init(&store->memory, shmem) != NST_OK) {
         return NST_ERR;
     }
 
-    if(nst_disk_init(&store->disk, root, shmem, clean_temp) != NST_OK) {
+    if(nst_disk_init(&store->disk, root, shmem, clean_temp, engine) != NST_OK) {
         return NST_ERR;
     }
 
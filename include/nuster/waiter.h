@@ -0,0 +1,74 @@
+/*
+ * include/nuster/waiter.h
+ * This file defines everything related to nuster waiters.
+ *
+ * Copyright (C) Jiang Wenyuan, < koubunen AT gmail DOT com >
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef _NUSTER_WAITER_H
+#define _NUSTER_WAITER_H
+
+#include <pthread.h>
+
+#include <haproxy/list-t.h>
+#include <haproxy/task-t.h>
+
+#include <nuster/common.h>
+
+
+#define NST_WAITER_BUCKETS              1024
+
+/* a parked stream, embedded in its ctx */
+typedef struct nst_waiter {
+    hpx_list_t                  list;           /* empty when not parked */
+    uint64_t                    hash;           /* of the key waited for */
+    struct task                *task;
+    int                         claim;          /* listed as the claim of hash */
+    int                         pass;           /* woken by a released claim */
+} nst_waiter_t;
+
+/*
+ * Streams parked until the entry of a key is done, then woken once.
+ * A waiter is found by the hash of its key only, a waiter of another key
+ * with the same hash is woken too and just checks its entry again.
+ * It lives in the worker's own memory, the waiters are its streams.
+ *
+ * Before the entry exists, the first stream which misses claims the hash and
+ * the identical streams park on the claim until the stream creates the entry
+ * or gives up.
+ */
+typedef struct nst_waiters {
+    pthread_mutex_t             mutex;
+
+    hpx_list_t                  bucket[NST_WAITER_BUCKETS];
+    hpx_list_t                  claim[NST_WAITER_BUCKETS];
+
+    uint64_t                    parked;         /* number of waits */
+    uint64_t                    woken;          /* number of waiters woken */
+} nst_waiters_t;
+
+
+void nst_waiter_init(nst_waiter_t *waiter, struct task *task);
+
+nst_waiters_t *nst_waiters_create();
+void nst_waiters_add(nst_waiters_t *waiters, nst_waiter_t *waiter, uint64_t hash);
+void nst_waiters_del(nst_waiters_t *waiters, nst_waiter_t *waiter);
+int nst_waiters_wake(nst_waiters_t *waiters, uint64_t hash);
+int nst_waiters_claim(nst_waiters_t *waiters, nst_waiter_t *waiter, uint64_t hash);
+void nst_waiters_release(nst_waiters_t *waiters, nst_waiter_t *waiter);
+
+#endif /* _NUSTER_WAITER_H */
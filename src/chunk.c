@@ -74,7 +74,7 @@ static int alloc_trash_buffers(int bufsize)
 	return trash.area && trash_buf1 && trash_buf2;
 }
 
-static int alloc_trash_buffers_per_thread()
+int alloc_trash_buffers_per_thread()
 {
 	return alloc_trash_buffers(global.tune.bufsize);
 }
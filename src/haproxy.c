@@ -191,11 +191,25 @@ struct global global = {
 			.data_size    = NST_DEFAULT_DATA_SIZE,
 			.dict_size    = NST_DEFAULT_DICT_SIZE,
 			.dict_cleaner = NST_DEFAULT_DICT_CLEANER,
+			.dict_locks   = NST_DEFAULT_DICT_LOCKS,
 			.data_cleaner = NST_DEFAULT_DATA_CLEANER,
 			.disk_cleaner = NST_DEFAULT_DISK_CLEANER,
 			.disk_loader  = NST_DEFAULT_DISK_LOADER,
 			.disk_saver   = NST_DEFAULT_DISK_SAVER,
 			.clean_temp   = NST_STATUS_OFF,
+			.disk_aio     = NST_AIO_ENGINE_NONE,
+			.io_threads   = NST_DEFAULT_IO_THREADS,
+			.disk_engine  = NST_DISK_ENGINE_FILE,
+			.disk_index   = 0,
+			.loader_threads = NST_DEFAULT_LOADER_THREADS,
+			.disk_direct  = 0,
+			.disk_sync    = 0,
+			.evict        = NST_STATUS_OFF,
+			.evict_high_water = NST_DEFAULT_EVICT_HIGH_WATER,
+			.hugepage     = NST_STATUS_OFF,
+			.prefault     = NST_STATUS_OFF,
+			.numa         = NST_SHMEM_NUMA_OFF,
+			.pack_size    = 0,
 			.root         = {
 				.ptr  = NULL,
 				.len  = 0,
@@ -206,11 +220,19 @@ struct global global = {
 			.data_size    = NST_DEFAULT_DATA_SIZE,
 			.dict_size    = NST_DEFAULT_DICT_SIZE,
 			.dict_cleaner = NST_DEFAULT_DICT_CLEANER,
+			.dict_locks   = NST_DEFAULT_DICT_LOCKS,
 			.data_cleaner = NST_DEFAULT_DATA_CLEANER,
 			.disk_cleaner = NST_DEFAULT_DISK_CLEANER,
 			.disk_loader  = NST_DEFAULT_DISK_LOADER,
 			.disk_saver   = NST_DEFAULT_DISK_SAVER,
 			.clean_temp   = NST_STATUS_OFF,
+			.disk_aio     = NST_AIO_ENGINE_NONE,
+			.io_threads   = NST_DEFAULT_IO_THREADS,
+			.disk_engine  = NST_DISK_ENGINE_FILE,
+			.disk_index   = 0,
+			.loader_threads = NST_DEFAULT_LOADER_THREADS,
+			.disk_direct  = 0,
+			.disk_sync    = 0,
 			.root         = {
 				.ptr  = NULL,
 				.len  = 0,
@@ -0,0 +1,532 @@
+/*
+ * nuster asynchronous disk read functions.
+ *
+ * Copyright (C) Jiang Wenyuan, < koubunen AT gmail DOT com >
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <pthread.h>
+
+#include <haproxy/global.h>
+#include <haproxy/errors.h>
+#include <haproxy/applet.h>
+#include <haproxy/fd.h>
+
+#include <nuster/nuster.h>
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define NST_AIO_USE_URING
+#endif
+
+static int         nst_aio_uring;               /* io_uring available and wanted */
+static int         nst_aio_pool;                /* thread pool wanted */
+static int         nst_aio_efd[MAX_THREADS];    /* eventfd of each thread */
+static nst_aio_t  *nst_aio_done[MAX_THREADS];   /* reads completed by the pool */
+
+static struct {
+    nst_aio_t                  *head;
+    nst_aio_t                  *tail;
+    int                         started;
+    pthread_mutex_t             mutex;
+    pthread_cond_t              cond;
+} nst_aio_queue = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond  = PTHREAD_COND_INITIALIZER,
+};
+
+#ifdef NST_AIO_USE_URING
+
+typedef struct nst_aio_uring {
+    int                         fd;
+    unsigned                    entries;
+    unsigned                    inflight;
+
+    unsigned                   *sq_tail;
+    unsigned                   *sq_mask;
+    unsigned                   *sq_array;
+    unsigned                   *cq_head;
+    unsigned                   *cq_tail;
+    unsigned                   *cq_mask;
+    struct io_uring_sqe        *sqes;
+    struct io_uring_cqe        *cqes;
+} nst_aio_uring_t;
+
+static THREAD_LOCAL nst_aio_uring_t  nst_aio_ring = { .fd = -1 };
+
+/*
+ * the rings are left mapped on failure, it only happens at startup
+ */
+static int
+_nst_aio_uring_init(nst_aio_uring_t *ring, unsigned entries, int efd) {
+    struct io_uring_params  p;
+    char                   *sq, *cq;
+    int                     fd;
+
+    memset(&p, 0, sizeof(p));
+
+    fd = syscall(__NR_io_uring_setup, entries, &p);
+
+    if(fd < 0) {
+        return NST_ERR;
+    }
+
+    sq = mmap(NULL, p.sq_off.array + p.sq_entries * sizeof(unsigned), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+
+    cq = mmap(NULL, p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+
+    ring->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if(sq == MAP_FAILED || cq == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        goto err;
+    }
+
+    if(efd >= 0 && syscall(__NR_io_uring_register, fd, IORING_REGISTER_EVENTFD, &efd, 1) < 0) {
+        goto err;
+    }
+
+    ring->fd       = fd;
+    ring->entries  = p.sq_entries;
+    ring->inflight = 0;
+    ring->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head  = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    return NST_OK;
+
+err:
+    close(fd);
+
+    return NST_ERR;
+}
+
+static int
+_nst_aio_uring_submit(nst_aio_uring_t *ring, nst_aio_t *aio) {
+    struct io_uring_sqe  *sqe;
+    unsigned              tail, idx;
+
+    if(ring->fd < 0 || ring->inflight >= ring->entries) {
+        return NST_ERR;
+    }
+
+    tail = *ring->sq_tail;
+    idx  = tail & *ring->sq_mask;
+    sqe  = &ring->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+
+    sqe->opcode    = IORING_OP_READV;
+    sqe->fd        = aio->fd;
+    sqe->off       = aio->offset;
+    sqe->addr      = (uintptr_t)&aio->iov;
+    sqe->len       = 1;
+    sqe->user_data = (uintptr_t)aio;
+
+    ring->sq_array[idx] = idx;
+
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    if(syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0) != 1) {
+        /* not consumed by the kernel */
+        __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+        return NST_ERR;
+    }
+
+    ring->inflight++;
+
+    return NST_OK;
+}
+
+#endif
+
+static void
+_nst_aio_complete(nst_aio_t *aio) {
+
+    nst_stats_update_latency(aio->latency, nst_time_now_us() - aio->start);
+
+    if(aio->state == NST_AIO_STATE_ORPHAN) {
+        free(aio);
+
+        return;
+    }
+
+    aio->state = NST_AIO_STATE_DONE;
+
+    appctx_wakeup(aio->appctx);
+}
+
+static void *
+_nst_aio_pool_thread(void *data) {
+    nst_aio_t  *aio;
+    uint64_t    one = 1;
+    int         ret, t;
+
+    while(1) {
+        pthread_mutex_lock(&nst_aio_queue.mutex);
+
+        while(!nst_aio_queue.head) {
+            pthread_cond_wait(&nst_aio_queue.cond, &nst_aio_queue.mutex);
+        }
+
+        aio = nst_aio_queue.head;
+
+        nst_aio_queue.head = aio->next;
+
+        if(!nst_aio_queue.head) {
+            nst_aio_queue.tail = NULL;
+        }
+
+        pthread_mutex_unlock(&nst_aio_queue.mutex);
+
+        ret      = pread(aio->fd, aio->buf, aio->iov.iov_len, aio->offset);
+        aio->ret = ret < 0 ? -1 : ret;
+
+        /* aio belongs to its thread once pushed */
+        t = aio->tid;
+
+        do {
+            aio->next = nst_aio_done[t];
+        } while(!__atomic_compare_exchange_n(&nst_aio_done[t], &aio->next, aio, 0,
+                    __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+        if(write(nst_aio_efd[t], &one, sizeof(one)) < 0) {
+            /* the counter is already non zero */
+        }
+    }
+
+    return NULL;
+}
+
+static void
+_nst_aio_pool_start() {
+    pthread_t  thread;
+    int        i;
+
+    pthread_mutex_lock(&nst_aio_queue.mutex);
+
+    if(!nst_aio_queue.started) {
+        nst_aio_queue.started = 1;
+
+        for(i = 0; i < NST_AIO_THREADS; i++) {
+
+            if(pthread_create(&thread, NULL, _nst_aio_pool_thread, NULL) == 0) {
+                pthread_detach(thread);
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&nst_aio_queue.mutex);
+}
+
+static int
+_nst_aio_submit(nst_aio_t *aio) {
+
+    if(aio->engine == NST_AIO_ENGINE_NONE || nst_aio_efd[tid] < 0) {
+        return NST_ERR;
+    }
+
+#ifdef NST_AIO_USE_URING
+    if(aio->engine == NST_AIO_ENGINE_URING && _nst_aio_uring_submit(&nst_aio_ring, aio) == NST_OK) {
+        return NST_OK;
+    }
+#endif
+
+    if(!nst_aio_queue.started) {
+        return NST_ERR;
+    }
+
+    aio->next = NULL;
+
+    pthread_mutex_lock(&nst_aio_queue.mutex);
+
+    if(nst_aio_queue.tail) {
+        nst_aio_queue.tail->next = aio;
+    } else {
+        nst_aio_queue.head = aio;
+    }
+
+    nst_aio_queue.tail = aio;
+
+    pthread_cond_signal(&nst_aio_queue.cond);
+    pthread_mutex_unlock(&nst_aio_queue.mutex);
+
+    return NST_OK;
+}
+
+/*
+ * wakes up the applets whose reads have completed, runs on their thread
+ */
+static void
+_nst_aio_fd_handler(int fd) {
+    nst_aio_t  *aio, *next;
+    uint64_t    n;
+
+    while(read(fd, &n, sizeof(n)) > 0) { }
+
+    fd_cant_recv(fd);
+
+#ifdef NST_AIO_USE_URING
+    if(nst_aio_ring.fd >= 0) {
+        nst_aio_uring_t      *ring = &nst_aio_ring;
+        struct io_uring_cqe  *cqe;
+        unsigned              head = *ring->cq_head;
+
+        while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            cqe      = &ring->cqes[head & *ring->cq_mask];
+            aio      = (nst_aio_t *)(uintptr_t)cqe->user_data;
+            aio->ret = cqe->res < 0 ? -1 : cqe->res;
+
+            head++;
+            ring->inflight--;
+
+            _nst_aio_complete(aio);
+        }
+
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+#endif
+
+    aio = __atomic_exchange_n(&nst_aio_done[tid], NULL, __ATOMIC_ACQUIRE);
+
+    while(aio) {
+        next = aio->next;
+
+        _nst_aio_complete(aio);
+
+        aio = next;
+    }
+}
+
+/*
+ * called once the configuration is parsed, before the workers are forked
+ */
+void
+nst_aio_init() {
+    int  engines[2] = { NST_AIO_ENGINE_NONE, NST_AIO_ENGINE_NONE };
+    int  i;
+
+    if(global.nuster.cache.status == NST_STATUS_ON) {
+        engines[0] = global.nuster.cache.disk_aio;
+    }
+
+    if(global.nuster.nosql.status == NST_STATUS_ON) {
+        engines[1] = global.nuster.nosql.disk_aio;
+    }
+
+    for(i = 0; i < 2; i++) {
+
+        if(engines[i] == NST_AIO_ENGINE_URING) {
+            nst_aio_uring = 1;
+        }
+
+        if(engines[i] == NST_AIO_ENGINE_THREADS) {
+            nst_aio_pool = 1;
+        }
+    }
+
+#ifdef NST_AIO_USE_URING
+    if(nst_aio_uring) {
+        nst_aio_uring_t  ring;
+
+        if(_nst_aio_uring_init(&ring, 1, -1) == NST_OK) {
+            close(ring.fd);
+        } else {
+            nst_aio_uring = 0;
+        }
+    }
+#else
+    nst_aio_uring = 0;
+#endif
+
+    if(!nst_aio_uring && (engines[0] == NST_AIO_ENGINE_URING
+                || engines[1] == NST_AIO_ENGINE_URING)) {
+
+        ha_warning("nuster disk-aio: io_uring unavailable, using %d threads.\n",
+                NST_AIO_THREADS);
+
+        nst_aio_pool = 1;
+    }
+}
+
+const char *
+nst_aio_engine(int engine) {
+
+    if(engine == NST_AIO_ENGINE_URING && nst_aio_uring) {
+        return "uring";
+    }
+
+    if(engine != NST_AIO_ENGINE_NONE) {
+        return "threads";
+    }
+
+    return "off";
+}
+
+nst_aio_t *
+nst_aio_new(hpx_appctx_t *appctx, int engine, uint64_t *latency) {
+    nst_aio_t  *aio = malloc(sizeof(*aio) + global.tune.bufsize);
+
+    if(aio) {
+        aio->next    = NULL;
+        aio->appctx  = appctx;
+        aio->tid     = tid;
+        aio->engine  = engine;
+        aio->state   = NST_AIO_STATE_IDLE;
+        aio->latency = latency;
+    }
+
+    return aio;
+}
+
+/*
+ * a pending read still writes to aio, which is then freed on completion
+ */
+void
+nst_aio_free(nst_aio_t *aio) {
+
+    if(!aio) {
+        return;
+    }
+
+    if(aio->state == NST_AIO_STATE_PENDING) {
+        aio->state = NST_AIO_STATE_ORPHAN;
+    } else {
+        free(aio);
+    }
+}
+
+/*
+ * Read len bytes at offset, *buf is set to the data read.
+ * Returns the number of bytes read, -1 on error, or NST_AIO_PENDING if the
+ * read is in progress, the applet is then woken up on completion and has to
+ * call again to get the result.
+ * Without aio, reads to the trash chunk synchronously.
+ */
+int
+nst_aio_read(nst_aio_t *aio, int fd, char **buf, int len, uint64_t offset) {
+    int  ret;
+
+    if(len > global.tune.bufsize) {
+        len = global.tune.bufsize;
+    }
+
+    if(!aio) {
+        *buf = get_trash_chunk()->area;
+
+        return pread(fd, *buf, len, offset);
+    }
+
+    *buf = aio->buf;
+
+    if(aio->state == NST_AIO_STATE_PENDING) {
+        return NST_AIO_PENDING;
+    }
+
+    if(aio->state == NST_AIO_STATE_DONE) {
+        aio->state = NST_AIO_STATE_IDLE;
+
+        return aio->ret;
+    }
+
+    aio->fd           = fd;
+    aio->offset       = offset;
+    aio->iov.iov_base = aio->buf;
+    aio->iov.iov_len  = len;
+    aio->start        = nst_time_now_us();
+    aio->state        = NST_AIO_STATE_PENDING;
+
+    if(_nst_aio_submit(aio) == NST_OK) {
+        return NST_AIO_PENDING;
+    }
+
+    aio->state = NST_AIO_STATE_IDLE;
+
+    ret = pread(fd, aio->buf, len, offset);
+
+    nst_stats_update_latency(aio->latency, nst_time_now_us() - aio->start);
+
+    return ret;
+}
+
+static int
+nst_aio_init_per_thread() {
+    int  efd;
+
+    nst_aio_efd[tid] = -1;
+
+    if(master || (!nst_aio_uring && !nst_aio_pool)) {
+        return 1;
+    }
+
+    efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if(efd < 0 || efd >= global.maxsock) {
+        ha_warning("nuster disk-aio: no eventfd for thread %u, reading synchronously.\n", tid);
+
+        if(efd >= 0) {
+            close(efd);
+        }
+
+        return 1;
+    }
+
+    nst_aio_efd[tid] = efd;
+
+    /* pollers skip the fds without owner */
+    fd_insert(efd, &nst_aio_efd[tid], _nst_aio_fd_handler, tid_bit);
+    fd_want_recv(efd);
+
+#ifdef NST_AIO_USE_URING
+    if(nst_aio_uring
+            && _nst_aio_uring_init(&nst_aio_ring, NST_AIO_URING_ENTRIES, efd) != NST_OK) {
+
+        ha_warning("nuster disk-aio: io_uring setup failed for thread %u, using threads.\n", tid);
+
+        nst_aio_ring.fd = -1;
+        nst_aio_pool    = 1;
+    }
+#endif
+
+    if(nst_aio_pool) {
+        _nst_aio_pool_start();
+    }
+
+    return 1;
+}
+
+static void
+nst_aio_deinit_per_thread() {
+
+#ifdef NST_AIO_USE_URING
+    if(nst_aio_ring.fd >= 0) {
+        close(nst_aio_ring.fd);
+
+        nst_aio_ring.fd = -1;
+    }
+#endif
+
+    if(nst_aio_efd[tid] >= 0) {
+        fd_delete(nst_aio_efd[tid]);
+
+        nst_aio_efd[tid] = -1;
+    }
+}
+
+REGISTER_PER_THREAD_INIT(nst_aio_init_per_thread);
+REGISTER_PER_THREAD_DEINIT(nst_aio_deinit_per_thread);
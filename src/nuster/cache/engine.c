@@ -11,9 +11,64 @@
  */
 
 #include <haproxy/stream_interface.h>
+#include <haproxy/filters.h>
+#include <haproxy/pipe.h>
+#include <haproxy/proxy.h>
 
 #include <nuster/nuster.h>
 
+/*
+ * An object still being filled is followed from the last item sent, sets item
+ * to the next one. Returns 1 if it was linked or the object is done, 0 to wait
+ * to be woken by the filler or by the recheck timer, or -1 if the filler
+ * aborted.
+ */
+static int
+_nst_cache_memory_follow(hpx_appctx_t *appctx, nst_memory_item_t **item) {
+    nst_memory_obj_t   *obj    = appctx->ctx.nuster.store.memory.obj;
+    nst_memory_item_t  *last   = appctx->ctx.nuster.store.memory.last;
+    nst_waiter_t       *waiter = &appctx->ctx.nuster.store.memory.waiter;
+    int                 parked = 0;
+
+    appctx->t->expire = TICK_ETERNITY;
+
+    while(1) {
+
+        if(nst_memory_obj_done(obj)) {
+            appctx->ctx.nuster.store.memory.follow = 0;
+
+            nst_waiters_del(nuster.cache->waiters, waiter);
+
+            *item = nst_memory_obj_next(obj, last);
+
+            return 1;
+        }
+
+        *item = nst_memory_obj_next(obj, last);
+
+        if(*item) {
+            return 1;
+        }
+
+        if(obj->invalid) {
+            return -1;
+        }
+
+        if(parked) {
+            /* checked again at the latest when the recheck expires */
+            appctx->t->expire = tick_add(now_ms, NST_CACHE_WAIT_RECHECK);
+
+            return 0;
+        }
+
+        /* parked before checking again, so that no item is missed */
+        nst_waiters_add(nuster.cache->waiters, waiter, waiter->hash);
+        nst_memory_obj_wait(obj);
+
+        parked = 1;
+    }
+}
+
 static void
 _nst_cache_memory_handler(hpx_appctx_t *appctx) {
     hpx_htx_t               *req_htx, *res_htx;
@@ -38,24 +93,67 @@ _nst_cache_memory_handler(hpx_appctx_t *appctx) {
     }
 
     if(res->flags & (CF_SHUTW|CF_SHUTR|CF_SHUTW_NOW)) {
-        appctx->ctx.nuster.store.memory.item = NULL;
+        appctx->ctx.nuster.store.memory.item   = NULL;
+        appctx->ctx.nuster.store.memory.follow = 0;
+    }
+
+    item = appctx->ctx.nuster.store.memory.item;
+
+next:
+    if(!item && appctx->ctx.nuster.store.memory.follow) {
+        int  ret = _nst_cache_memory_follow(appctx, &item);
+
+        /* the response is cut short, as if the server had aborted */
+        if(ret < 0) {
+            appctx->ctx.nuster.store.memory.follow = 0;
+
+            si_shutr(si);
+            res->flags |= CF_READ_NULL;
+
+            goto out;
+        }
+
+        if(ret == 0) {
+            goto out;
+        }
     }
 
-    if(appctx->ctx.nuster.store.memory.item) {
-        item = appctx->ctx.nuster.store.memory.item;
+    if(item) {
 
         while(item) {
 
+            /* headers are forwarded along with the first DATA block */
+            if(nst_http_memory_item_alone(item) && htx_get_tail_type(res_htx) == HTX_BLK_DATA) {
+                si_rx_room_blk(si);
+
+                goto out;
+            }
+
             if(nst_http_memory_item_to_htx(item, res_htx) != NST_OK) {
                 si_rx_room_blk(si);
 
                 goto out;
             }
 
-            item = item->next;
+            appctx->ctx.nuster.store.memory.last = item;
+
+            if(nst_http_memory_item_alone(item)) {
+                item = nst_memory_obj_next(appctx->ctx.nuster.store.memory.obj, item);
+
+                si_rx_room_blk(si);
+
+                goto out;
+            }
+
+            item = nst_memory_obj_next(appctx->ctx.nuster.store.memory.obj, item);
 
         }
 
+        /* not woken by the stream once all is sent, so wait for more now */
+        if(appctx->ctx.nuster.store.memory.follow) {
+            goto next;
+        }
+
     } else {
 
         if(!htx_add_endof(res_htx, HTX_BLK_EOM)) {
@@ -88,6 +186,85 @@ out:
     htx_to_buf(res_htx, &res->buf);
 }
 
+#if defined(USE_LINUX_SPLICE)
+/*
+ * Moves the payload from the disk file to the response pipe, which the client
+ * side then splices to its socket, so that it never reaches user space.
+ * Only for raw connections whose mux can splice, with splice-response on and
+ * no response data filter but the cache one, for responses with a
+ * content-length, and once the header has left the buffer, as the pipe is sent
+ * first.
+ * Returns the bytes spliced, 0 to use the buffer or -1 to wait for the
+ * channel to be empty.
+ */
+static int
+_nst_cache_disk_splice(hpx_appctx_t *appctx, hpx_channel_t *res, hpx_htx_t *res_htx) {
+    hpx_stream_interface_t  *si = appctx->owner;
+    hpx_stream_t            *s  = si_strm(si);
+    struct conn_stream      *cs = objt_cs(s->si[0].end);
+    struct filter           *filter;
+    int                      ret;
+
+    if(appctx->ctx.nuster.store.disk.splice < 0) {
+        return 0;
+    }
+
+    /*
+     * the aio engine is for disks whose reads must not block the thread, and
+     * disk-direct keeps the pages out of the kernel's cache
+     */
+    if(appctx->ctx.nuster.store.disk.aio || appctx->ctx.nuster.store.disk.pcache
+            || !(global.tune.options & GTUNE_USE_SPLICE)
+            || !((s->be->options2 | strm_fe(s)->options2) & (PR_O2_SPLIC_RTR|PR_O2_SPLIC_AUT))
+            || !cs || !cs->conn->xprt || !cs->conn->xprt->snd_pipe
+            || !cs->conn->mux || !cs->conn->mux->snd_pipe) {
+
+        appctx->ctx.nuster.store.disk.splice = -1;
+
+        return 0;
+    }
+
+    if(appctx->ctx.nuster.store.disk.payload_len < MIN_SPLICE_FORWARD) {
+        return 0;
+    }
+
+    if(res->pipe || !htx_is_empty(res_htx)) {
+        return -1;
+    }
+
+    /* all the response filters are known once the header is forwarded */
+    list_for_each_entry(filter, &strm_flt(s)->filters, list) {
+
+        if(IS_RSP_DATA_FILTER(filter) && FLT_ID(filter) != nst_cache_flt_id) {
+            appctx->ctx.nuster.store.disk.splice = -1;
+
+            return 0;
+        }
+    }
+
+    if(pipes_used >= global.maxpipes || !(res->pipe = get_pipe())) {
+        return 0;
+    }
+
+    ret = nst_disk_splice(appctx->ctx.nuster.store.disk.fd, res->pipe,
+            appctx->ctx.nuster.store.disk.offset, appctx->ctx.nuster.store.disk.payload_len);
+
+    if(ret <= 0) {
+        put_pipe(res->pipe);
+        res->pipe = NULL;
+
+        appctx->ctx.nuster.store.disk.splice = -1;
+
+        return 0;
+    }
+
+    res->flags |= CF_READ_PARTIAL;
+    res->total += ret;
+
+    return ret;
+}
+#endif
+
 /*
  * The cache disk applet acts like the backend to send cached http data
  */
@@ -96,18 +273,21 @@ _nst_cache_disk_handler(hpx_appctx_t *appctx) {
     hpx_stream_interface_t  *si  = appctx->owner;
     hpx_channel_t           *req = si_oc(si);
     hpx_channel_t           *res = si_ic(si);
-    hpx_buffer_t            *buf;
     hpx_htx_t               *req_htx, *res_htx;
     hpx_htx_blk_type_t       type;
     hpx_htx_blk_t           *blk;
+    hpx_buffer_t            *head;
     char                    *p, *ptr;
-    uint64_t                 offset, payload_len;
+    uint64_t                 offset, payload_len, start, end;
     uint32_t                 blksz, sz, info;
     int                      total, ret, max, fd, header_len;
 
     header_len  = appctx->ctx.nuster.store.disk.header_len;
     payload_len = appctx->ctx.nuster.store.disk.payload_len;
     offset      = appctx->ctx.nuster.store.disk.offset;
+    start       = appctx->ctx.nuster.store.disk.start;
+    end         = appctx->ctx.nuster.store.disk.end;
+    head        = appctx->ctx.nuster.store.disk.head;
     fd          = appctx->ctx.nuster.store.disk.fd;
     res_htx     = htxbuf(&res->buf);
     total       = res_htx->data;
@@ -130,10 +310,15 @@ _nst_cache_disk_handler(hpx_appctx_t *appctx) {
 
     switch(appctx->st1) {
         case NST_DISK_APPLET_HEADER:
-            buf = get_trash_chunk();
-            p   = buf->area;
+            ret = nst_disk_head_read(head, start, &p, header_len, offset);
+
+            if(ret != header_len) {
+                ret = nst_disk_applet_read(appctx, &p, header_len, offset);
+            }
 
-            ret = pread(fd, p, header_len, offset);
+            if(ret == NST_AIO_PENDING) {
+                goto out;
+            }
 
             if(ret != header_len) {
                 appctx->st1 = NST_DISK_APPLET_ERROR;
@@ -162,6 +347,18 @@ _nst_cache_disk_handler(hpx_appctx_t *appctx) {
                 p  += sz;
 
                 header_len -= 4 + sz;
+
+                /*
+                 * the h1 mux chunks a response without content-length itself,
+                 * spliced data would not be framed
+                 */
+                if(type == HTX_BLK_RES_SL) {
+                    hpx_htx_sl_t  *sl = (hpx_htx_sl_t *)ptr;
+
+                    if(!(sl->flags & HTX_SL_F_CLEN) || (sl->flags & HTX_SL_F_CHNK)) {
+                        appctx->ctx.nuster.store.disk.splice = -1;
+                    }
+                }
             }
 
             appctx->st1 = NST_DISK_APPLET_PAYLOAD;
@@ -171,8 +368,6 @@ _nst_cache_disk_handler(hpx_appctx_t *appctx) {
 
             /* fall through */
         case NST_DISK_APPLET_PAYLOAD:
-            buf = get_trash_chunk();
-            p   = buf->area;
             max = htx_get_max_blksz(res_htx, channel_htx_recv_max(res, res_htx));
 
             if(max <= 0) {
@@ -183,10 +378,47 @@ _nst_cache_disk_handler(hpx_appctx_t *appctx) {
                 appctx->st1 = NST_DISK_APPLET_EOP;
             } else {
 
-                if(max < payload_len) {
-                    ret = pread(fd, p, max, offset);
-                } else {
-                    ret = pread(fd, p, payload_len, offset);
+                if(max > payload_len) {
+                    max = payload_len;
+                }
+
+                ret = nst_disk_head_read(head, start, &p, max, offset);
+
+#if defined(USE_LINUX_SPLICE)
+                if(!ret) {
+                    ret = _nst_cache_disk_splice(appctx, res, res_htx);
+
+                    if(ret < 0) {
+                        si_rx_room_blk(si);
+
+                        goto out;
+                    }
+
+                    if(ret > 0) {
+                        appctx->ctx.nuster.store.disk.payload_len -= ret;
+
+                        offset += ret;
+                        appctx->ctx.nuster.store.disk.offset = offset;
+
+                        if(appctx->ctx.nuster.store.disk.payload_len) {
+                            si_rx_room_blk(si);
+
+                            goto out;
+                        }
+
+                        appctx->st1 = NST_DISK_APPLET_EOP;
+
+                        goto eop;
+                    }
+                }
+#endif
+
+                if(!ret) {
+                    ret = nst_disk_applet_read(appctx, &p, max, offset);
+                }
+
+                if(ret == NST_AIO_PENDING) {
+                    goto out;
                 }
 
                 if(ret <= 0) {
@@ -228,11 +460,30 @@ _nst_cache_disk_handler(hpx_appctx_t *appctx) {
 
             /* fall through */
         case NST_DISK_APPLET_EOP:
-            buf = get_trash_chunk();
-            p   = buf->area;
+eop:
             max = htx_get_max_blksz(res_htx, channel_htx_recv_max(res, res_htx));
 
-            ret = pread(fd, p, max, offset);
+            /* stop at the object end, a segment goes on with the next record */
+            if(end && offset >= end) {
+                ret = 0;
+            } else if(max <= 0) {
+                goto out;
+            } else {
+
+                if(end && max > end - offset) {
+                    max = end - offset;
+                }
+
+                ret = nst_disk_head_read(head, start, &p, max, offset);
+
+                if(ret != max) {
+                    ret = nst_disk_applet_read(appctx, &p, max, offset);
+                }
+            }
+
+            if(ret == NST_AIO_PENDING) {
+                goto out;
+            }
 
             if(ret < 0) {
                 appctx->st1 = NST_DISK_APPLET_ERROR;
@@ -334,28 +585,35 @@ nst_cache_handler(hpx_appctx_t *appctx) {
     }
 }
 
+static void
+nst_cache_release_handler(hpx_appctx_t *appctx) {
+
+    if(appctx->st0 != NST_CTX_STATE_HIT_MEMORY) {
+        nst_aio_free(appctx->ctx.nuster.store.disk.aio);
+        free_trash_chunk(appctx->ctx.nuster.store.disk.head);
+    } else if(appctx->ctx.nuster.store.memory.waiter.task) {
+        nst_waiters_del(nuster.cache->waiters, &appctx->ctx.nuster.store.memory.waiter);
+    }
+}
+
 void
 nst_cache_housekeeping() {
     nst_dict_t   *dict  = &nuster.cache->dict;
     nst_store_t  *store = &nuster.cache->store;
+    nst_shmem_t  *shmem = global.nuster.cache.shmem;
     uint64_t      start;
 
-#ifndef USE_THREAD
-    uint64_t      begin = nst_time_now_ms();
-#endif
-
     if(global.nuster.cache.status == NST_STATUS_ON && master == 1) {
         int  dict_cleaner = global.nuster.cache.dict_cleaner;
+        int  dict_rehash  = NST_DICT_REHASH_STEPS;
         int  data_cleaner = global.nuster.cache.data_cleaner;
         int  disk_cleaner = global.nuster.cache.disk_cleaner;
         int  disk_saver   = global.nuster.cache.disk_saver;
+        int  disk_index   = global.nuster.cache.disk_engine == NST_DISK_ENGINE_FILE
+                            ? global.nuster.cache.disk_index : 0;
         int  ms           = 10;
         int  ratio        = 1;
 
-#ifndef USE_THREAD
-        int  disk_loader  = global.nuster.cache.disk_loader;
-#endif
-
         start = nst_time_now_ms();
 
         while(dict_cleaner--) {
@@ -368,6 +626,32 @@ nst_cache_housekeeping() {
 
         start = nst_time_now_ms();
 
+        while(dict_rehash--) {
+            nst_dict_rehash(dict);
+
+            if(nst_time_now_ms() - start >= ms) {
+                break;
+            }
+        }
+
+        start = nst_time_now_ms();
+
+        /* evict cold data above the high water mark */
+        while(store->memory.dict
+                && shmem->used * 100 >= shmem->size * global.nuster.cache.evict_high_water) {
+
+            /* all the candidates are in use or recently accessed */
+            if(nst_dict_evict(dict, shmem->block_size) == 0) {
+                break;
+            }
+
+            if(nst_time_now_ms() - start >= ms) {
+                break;
+            }
+        }
+
+        start = nst_time_now_ms();
+
         if(data_cleaner > store->memory.count) {
             data_cleaner = store->memory.count;
         }
@@ -391,38 +675,59 @@ nst_cache_housekeeping() {
             }
         }
 
-        start = nst_time_now_ms();
-        ms    = 10;
+        /* the disk passes run on the io threads */
+        if(nuster.cache->root.len) {
 
-        while(store->disk.loaded && disk_saver--) {
-            nst_store_memory_sync_disk(nuster.cache);
+            if(store->disk.loaded) {
+                nst_io_submit(&nuster.cache->io, NST_IO_JOB_SAVER, disk_saver);
+                nst_io_submit(&nuster.cache->io, NST_IO_JOB_CLEANER, disk_cleaner);
 
-            if(nst_time_now_ms() - start >= ms) {
-                break;
-            }
-        }
+                if(disk_index && (store->disk.index.fd != -1
+                            || nst_time_now_ms() - store->disk.index.time >= disk_index * 1000ULL)) {
 
-        start = nst_time_now_ms();
+                    nst_io_submit(&nuster.cache->io, NST_IO_JOB_INDEX, 0);
+                }
 
-        while(store->disk.loaded && disk_cleaner--) {
-            nst_disk_cleanup(nuster.cache);
+                if(store->disk.sync > 0
+                        && nst_time_now_ms() - store->disk.sync_time >= store->disk.sync * 1000ULL) {
 
-            if(nst_time_now_ms() - start >= ms) {
-                break;
+                    nst_io_submit(&nuster.cache->io, NST_IO_JOB_SYNC, 0);
+                }
+            } else {
+                nst_io_submit(&nuster.cache->io, NST_IO_JOB_LOADER, 0);
             }
         }
 
-#ifndef USE_THREAD
-        while(!store->disk.loaded && disk_loader--) {
-            nst_disk_load(nuster.cache);
+    }
+}
 
-            if(nst_time_now_ms() - begin >= 500) {
-                break;
+/*
+ * the admission sketch is only needed if a rule has admission on
+ */
+static int
+_nst_cache_admission_on() {
+    hpx_proxy_t  *p = proxies_list;
+    nst_rule_t   *rule;
+
+    while(p) {
+
+        if(p->nuster.mode == NST_MODE_CACHE) {
+            rule = nuster.proxy[p->uuid]->rule;
+
+            while(rule) {
+
+                if(rule->prop.admission == NST_STATUS_ON) {
+                    return 1;
+                }
+
+                rule = rule->next;
             }
         }
-#endif
 
+        p = p->next;
     }
+
+    return 0;
 }
 
 void
@@ -430,29 +735,62 @@ nst_cache_init() {
     hpx_ist_t     root;
     nst_shmem_t  *shmem;
     uint64_t      dict_size, data_size, size;
-    int           clean_temp;
-
-#ifdef USE_THREAD
-    pthread_t     tid;
-#endif
+    int           clean_temp, dict_locks, admission;
+    int           flags = 0;
 
     root       = global.nuster.cache.root;
     dict_size  = global.nuster.cache.dict_size;
     data_size  = global.nuster.cache.data_size;
     size       = dict_size + data_size;
     clean_temp = global.nuster.cache.clean_temp;
+    dict_locks = global.nuster.cache.dict_locks;
 
-    nuster.applet.cache.fct = nst_cache_handler;
+    nuster.applet.cache.fct     = nst_cache_handler;
+    nuster.applet.cache.release = nst_cache_release_handler;
 
     if(global.nuster.cache.status == NST_STATUS_ON) {
+        admission = _nst_cache_admission_on();
+
+        /*
+         * a row of the sketch has a counter per bucket of the initial dict
+         * table, the rows are added to the zone on top of data-size and dict-size
+         */
+        if(admission) {
+            size += NST_SKETCH_DEPTH * (dict_size / sizeof(nst_dict_entry_t *));
+        }
 
-        shmem = nst_shmem_create("cache.shm", size, global.tune.bufsize, NST_DEFAULT_CHUNK_SIZE);
+        if(global.nuster.cache.hugepage == NST_STATUS_ON) {
+            flags |= NST_SHMEM_HUGEPAGE;
+        }
+
+        if(global.nuster.cache.prefault == NST_STATUS_ON) {
+            flags |= NST_SHMEM_PREFAULT;
+        }
+
+        shmem = nst_shmem_create("cache.shm", size, global.tune.bufsize, NST_DEFAULT_CHUNK_SIZE,
+                flags, global.nuster.cache.numa);
 
         if(!shmem) {
             ha_alert("Failed to create nuster cache memory zone.\n");
             exit(1);
         }
 
+        if(flags & NST_SHMEM_HUGEPAGE && shmem->backing == NST_SHMEM_BACKING_NORMAL) {
+            ha_warning("nuster cache memory zone: huge pages unavailable, using normal pages.\n");
+        }
+
+        if(shmem->numa != global.nuster.cache.numa) {
+            ha_warning("nuster cache memory zone: failed to apply the numa policy.\n");
+        }
+
+        /* a packed object is a single chunk */
+        if(global.nuster.cache.pack_size > shmem->block_size) {
+            ha_warning("nuster cache pack-size: reduced to the block size %u.\n",
+                    shmem->block_size);
+
+            global.nuster.cache.pack_size = shmem->block_size;
+        }
+
         global.nuster.cache.shmem = shmem;
 
         if(nst_shctx_init(shmem) != NST_OK) {
@@ -472,21 +810,83 @@ nst_cache_init() {
         nuster.cache->shmem = shmem;
         nuster.cache->root  = root;
 
-        if(nst_store_init(&nuster.cache->store, root, shmem, clean_temp) != NST_OK) {
+        if(nst_store_init(&nuster.cache->store, root, shmem, clean_temp,
+                    global.nuster.cache.disk_engine) != NST_OK) {
             ha_alert("Failed to init nuster cache store.\n");
             exit(1);
         }
 
-        if(nst_dict_init(&nuster.cache->dict, &nuster.cache->store, shmem, dict_size) != NST_OK) {
+        nuster.cache->store.disk.loaders = global.nuster.cache.loader_threads;
+        nuster.cache->store.disk.sync    = global.nuster.cache.disk_sync;
+
+        nuster.cache->store.disk.commit_latency = global.nuster.stats->cache.disk_commit_latency;
+
+        if(global.nuster.cache.disk_direct && root.len) {
+            nuster.cache->store.disk.pcache = nst_pcache_create(global.nuster.cache.disk_direct);
+
+            if(!nuster.cache->store.disk.pcache) {
+                ha_alert("Failed to init nuster cache disk-direct page cache.\n");
+                exit(1);
+            }
+        }
+
+        nuster.cache->waiters = nst_waiters_create();
+
+        if(!nuster.cache->waiters) {
+            ha_alert("Failed to init nuster cache waiters.\n");
+            exit(1);
+        }
+
+        if(nst_dict_init(&nuster.cache->dict, &nuster.cache->store, shmem, dict_size,
+                    dict_locks) != NST_OK) {
             ha_alert("Failed to init nuster cache dict.\n");
             exit(1);
         }
 
-#ifdef USE_THREAD
-        pthread_create(&tid, NULL, nst_disk_load_thread, nuster.cache);
-#endif
+        if(global.nuster.cache.evict == NST_STATUS_ON) {
+            nuster.cache->store.memory.dict = &nuster.cache->dict;
+        }
 
+        if(admission && nst_sketch_init(&nuster.cache->sketch, shmem,
+                    nuster.cache->dict.table[0].size) != NST_OK) {
+
+            ha_alert("Failed to init nuster cache sketch.\n");
+            exit(1);
+        }
+
+        if(nst_io_init(&nuster.cache->io, nuster.cache, global.nuster.cache.io_threads) != NST_OK) {
+            ha_alert("Failed to init nuster cache io.\n");
+            exit(1);
+        }
+
+    }
+}
+
+/*
+ * TinyLFU admission: once the memory is above the high water mark, a new
+ * entry is admitted only if it is requested more often than the entry which
+ * would be evicted for it.
+ */
+static int
+_nst_cache_admit(nst_ctx_t *ctx) {
+    nst_shmem_t  *shmem = nuster.cache->shmem;
+    uint64_t      hash;
+    int           admitted = 1;
+
+    if(ctx->rule->prop.admission != NST_STATUS_ON) {
+        return admitted;
     }
+
+    if(shmem->used * 100 >= shmem->size * global.nuster.cache.evict_high_water
+            && nst_dict_victim(&nuster.cache->dict, &hash) == NST_OK) {
+
+        admitted = nst_sketch_estimate(&nuster.cache->sketch, ctx->key->hash)
+            > nst_sketch_estimate(&nuster.cache->sketch, hash);
+    }
+
+    nst_stats_update_admission(admitted);
+
+    return admitted;
 }
 
 void
@@ -506,8 +906,12 @@ nst_cache_create(hpx_http_msg_t *msg, nst_ctx_t *ctx) {
     disk = &nuster.cache->store.disk;
     htx  = htxbuf(&msg->chn->buf);
 
+    if(ctx->state == NST_CTX_STATE_CREATE && !_nst_cache_admit(ctx)) {
+        ctx->state = NST_CTX_STATE_BYPASS;
+    }
+
     if(ctx->state == NST_CTX_STATE_CREATE) {
-        nst_shctx_lock(dict);
+        nst_dict_lock(dict, ctx->key->hash);
 
         entry = nst_dict_get(dict, ctx->key);
 
@@ -526,7 +930,7 @@ nst_cache_create(hpx_http_msg_t *msg, nst_ctx_t *ctx) {
             }
         }
 
-        nst_shctx_unlock(dict);
+        nst_dict_unlock(dict, ctx->key->hash);
     }
 
     /* init store data */
@@ -535,6 +939,10 @@ nst_cache_create(hpx_http_msg_t *msg, nst_ctx_t *ctx) {
 
         if(nst_store_memory_on(ctx->rule->prop.store)) {
             ctx->store.memory.obj = nst_memory_obj_create(mem);
+
+            if(ctx->store.memory.obj && global.nuster.cache.pack_size) {
+                nst_memory_pack_init(&ctx->store.memory.pack, global.nuster.cache.pack_size);
+            }
         }
 
         if(nst_store_disk_on(ctx->rule->prop.store)) {
@@ -563,10 +971,11 @@ nst_cache_create(hpx_http_msg_t *msg, nst_ctx_t *ctx) {
             if(nst_store_memory_on(ctx->rule->prop.store) && ctx->store.memory.obj) {
                 nst_memory_obj_t    *obj  = ctx->store.memory.obj;
                 nst_memory_item_t  **item = &ctx->store.memory.item;
+                hpx_buffer_t        *pack = &ctx->store.memory.pack;
                 char                *ptr  = htx_get_blk_ptr(htx, blk);
                 int                  ret;
 
-                ret = nst_memory_obj_append(mem, obj, item, ptr, sz, blk->info);
+                ret = nst_memory_obj_append(mem, obj, item, pack, ptr, sz, blk->info);
 
                 if(ret == NST_ERR) {
                     ctx->store.memory.obj = NULL;
@@ -584,10 +993,55 @@ nst_cache_create(hpx_http_msg_t *msg, nst_ctx_t *ctx) {
         }
     }
 
+    /* identical requests which would wait follow the object instead */
+    if(ctx->state == NST_CTX_STATE_CREATE && ctx->store.memory.obj && ctx->rule->prop.wait >= 0) {
+        nst_memory_obj_t  *obj = ctx->store.memory.obj;
+
+        /* the filler holds it while it is published */
+        nst_memory_obj_attach(mem, obj);
+
+        nst_dict_lock(dict, ctx->key->hash);
+
+        ctx->entry->store.memory.fill     = obj;
+        ctx->entry->store.memory.fill_pid = pid;
+
+        nst_dict_unlock(dict, ctx->key->hash);
+
+        ctx->store.memory.fill = obj;
+    }
+
 err:
     return;
 }
 
+/*
+ * Stops publishing the object being filled, followers go on with it.
+ */
+static void
+_nst_cache_unfill(nst_ctx_t *ctx) {
+    nst_dict_t        *dict = &nuster.cache->dict;
+    nst_memory_obj_t  *obj  = ctx->store.memory.fill;
+
+    if(!obj) {
+        return;
+    }
+
+    nst_dict_lock(dict, ctx->key->hash);
+
+    ctx->entry->store.memory.fill = NULL;
+
+    /* followers waiting for an item which will never come */
+    if(obj->invalid && nst_memory_obj_waited(obj)) {
+        nst_waiters_wake(nuster.cache->waiters, ctx->key->hash);
+    }
+
+    nst_dict_unlock(dict, ctx->key->hash);
+
+    nst_memory_obj_detach(&nuster.cache->store.memory, obj);
+
+    ctx->store.memory.fill = NULL;
+}
+
 /*
  * Add partial http data to nst_memory_object
  */
@@ -633,12 +1087,15 @@ nst_cache_append(hpx_http_msg_t *msg, nst_ctx_t *ctx, unsigned int offset, unsig
             if(nst_store_memory_on(ctx->rule->prop.store) && ctx->store.memory.obj) {
                 nst_memory_obj_t    *obj  = ctx->store.memory.obj;
                 nst_memory_item_t  **item = &ctx->store.memory.item;
+                hpx_buffer_t        *pack = &ctx->store.memory.pack;
                 int                  ret;
 
-                ret = nst_memory_obj_append(mem, obj, item, data.ptr, data.len, info);
+                ret = nst_memory_obj_append(mem, obj, item, pack, data.ptr, data.len, info);
 
                 if(ret == NST_ERR) {
                     ctx->store.memory.obj = NULL;
+
+                    _nst_cache_unfill(ctx);
                 }
             }
 
@@ -656,13 +1113,16 @@ nst_cache_append(hpx_http_msg_t *msg, nst_ctx_t *ctx, unsigned int offset, unsig
             if(nst_store_memory_on(ctx->rule->prop.store) && ctx->store.memory.obj) {
                 nst_memory_obj_t    *obj  = ctx->store.memory.obj;
                 nst_memory_item_t  **item = &ctx->store.memory.item;
+                hpx_buffer_t        *pack = &ctx->store.memory.pack;
                 char                *ptr  = htx_get_blk_ptr(htx, blk);
                 int                  ret;
 
-                ret = nst_memory_obj_append(mem, obj, item, ptr, sz, blk->info);
+                ret = nst_memory_obj_append(mem, obj, item, pack, ptr, sz, blk->info);
 
                 if(ret == NST_ERR) {
                     ctx->store.memory.obj = NULL;
+
+                    _nst_cache_unfill(ctx);
                 }
             }
 
@@ -683,18 +1143,41 @@ nst_cache_append(hpx_http_msg_t *msg, nst_ctx_t *ctx, unsigned int offset, unsig
 
     }
 
+    if(ctx->store.memory.fill && nst_memory_obj_waited(ctx->store.memory.fill)) {
+        nst_waiters_wake(nuster.cache->waiters, ctx->key->hash);
+    }
+
     return forward;
 }
 
+/*
+ * Wakes the requests waiting for the entry being filled by ctx, under the
+ * dict lock they were parked with, so that none is parked after the entry is
+ * done and never woken.
+ */
+static void
+_nst_cache_wake(nst_ctx_t *ctx) {
+    nst_dict_t  *dict = &nuster.cache->dict;
+
+    nst_dict_lock(dict, ctx->key->hash);
+
+    nst_waiters_wake(nuster.cache->waiters, ctx->key->hash);
+
+    nst_dict_unlock(dict, ctx->key->hash);
+}
+
 /*
  * cache done
  */
 int
 nst_cache_finish(nst_ctx_t *ctx) {
     nst_dict_t        *dict  = &nuster.cache->dict;
+    nst_memory_t      *mem   = &nuster.cache->store.memory;
     nst_disk_t        *disk  = &nuster.cache->store.disk;
     nst_dict_entry_t  *entry = ctx->entry;
 
+    _nst_cache_unfill(ctx);
+
     ctx->state = NST_CTX_STATE_DONE;
 
     entry->ctime = nst_time_now_ms();
@@ -709,7 +1192,16 @@ nst_cache_finish(nst_ctx_t *ctx) {
     entry->payload_len = ctx->txn.res.payload_len;
 
     if(nst_store_memory_on(ctx->rule->prop.store) && ctx->store.memory.obj) {
-        nst_shctx_lock(dict);
+
+        if(nst_memory_obj_pack(mem, ctx->store.memory.obj, &ctx->store.memory.pack) != NST_OK) {
+            ctx->store.memory.obj = NULL;
+        } else {
+            nst_memory_obj_set_done(ctx->store.memory.obj);
+        }
+    }
+
+    if(nst_store_memory_on(ctx->rule->prop.store) && ctx->store.memory.obj) {
+        nst_dict_lock(dict, entry->key.hash);
 
         if(entry && entry->state != NST_DICT_ENTRY_STATE_INVALID && entry->store.memory.obj) {
             entry->store.memory.obj->invalid = 1;
@@ -720,24 +1212,33 @@ nst_cache_finish(nst_ctx_t *ctx) {
         entry->state = NST_DICT_ENTRY_STATE_VALID;
         entry->store.memory.obj = ctx->store.memory.obj;
 
-        nst_shctx_unlock(dict);
+        nst_dict_unlock(dict, entry->key.hash);
     }
 
     if(nst_store_disk_on(ctx->rule->prop.store) && ctx->store.disk.obj.file) {
         nst_disk_obj_t  *obj  = &ctx->store.disk.obj;
 
         if(nst_disk_obj_finish(disk, obj, ctx->key, &ctx->txn, entry->expire) == NST_OK) {
+            nst_dict_lock(dict, entry->key.hash);
+
             entry->state = NST_DICT_ENTRY_STATE_VALID;
-            entry->store.disk.file = ctx->store.disk.obj.file;
+
+            nst_dict_entry_set_disk(dict, entry, obj);
+
+            nst_dict_unlock(dict, entry->key.hash);
         }
     }
 
     if(entry->state != NST_DICT_ENTRY_STATE_VALID) {
         entry->state = NST_DICT_ENTRY_STATE_INVALID;
 
+        _nst_cache_wake(ctx);
+
         return NST_ERR;
     }
 
+    _nst_cache_wake(ctx);
+
     return NST_OK;
 }
 
@@ -760,7 +1261,11 @@ nst_cache_exists(nst_ctx_t *ctx) {
     if(!nst_key_memory_checked(ctx->key)) {
         nst_key_memory_set_checked(ctx->key);
 
-        nst_shctx_lock(dict);
+        if(ctx->rule->prop.admission == NST_STATUS_ON) {
+            nst_sketch_add(&nuster.cache->sketch, ctx->key->hash);
+        }
+
+        nst_dict_lock(dict, ctx->key->hash);
 
         entry = nst_dict_get(dict, ctx->key);
 
@@ -774,10 +1279,17 @@ nst_cache_exists(nst_ctx_t *ctx) {
                     ret = NST_CTX_STATE_HIT_MEMORY;
 
                     ctx->store.memory.obj = entry->store.memory.obj;
+
+                    /* attach while locked, or it could be evicted */
+                    nst_memory_obj_attach(&nuster.cache->store.memory, ctx->store.memory.obj);
                 } else if(entry->store.disk.file) {
                     ret = NST_CTX_STATE_HIT_DISK;
 
                     ctx->store.disk.obj.file = entry->store.disk.file;
+                    ctx->store.disk.obj.base = entry->store.disk.base;
+                    ctx->store.disk.obj.size = entry->store.disk.size;
+                    ctx->store.disk.obj.id   = entry->store.disk.id;
+                    ctx->store.disk.obj.hits = nst_dict_entry_hits(entry);
                 }
 
                 ctx->txn.res.header_len    = entry->header_len;
@@ -790,9 +1302,30 @@ nst_cache_exists(nst_ctx_t *ctx) {
             }
 
             if(entry->state == NST_DICT_ENTRY_STATE_INIT) {
+                nst_memory_obj_t  *fill = entry->store.memory.fill;
+
                 ret = NST_CTX_STATE_WAIT;
 
                 ctx->prop = &entry->prop;
+
+                /* the filler only wakes the followers of its own process */
+                if(ctx->prop->wait >= 0 && fill && !fill->invalid
+                        && entry->store.memory.fill_pid == pid) {
+
+                    /* follow the object as it is filled, see _nst_cache_memory_follow */
+                    ret = NST_CTX_STATE_HIT_MEMORY;
+
+                    ctx->store.memory.obj    = fill;
+                    ctx->store.memory.follow = 1;
+
+                    nst_memory_obj_attach(&nuster.cache->store.memory, fill);
+
+                    ctx->txn.res.etag          = entry->etag;
+                    ctx->txn.res.last_modified = entry->last_modified;
+                } else if(ctx->prop->wait >= 0) {
+                    /* parked under the dict lock, the entry cannot be done meanwhile */
+                    nst_waiters_add(nuster.cache->waiters, &ctx->waiter, ctx->key->hash);
+                }
             }
 
             if(entry->state == NST_DICT_ENTRY_STATE_REFRESH) {
@@ -805,7 +1338,7 @@ nst_cache_exists(nst_ctx_t *ctx) {
 
         }
 
-        nst_shctx_unlock(dict);
+        nst_dict_unlock(dict, ctx->key->hash);
     }
 
     if(ret == NST_CTX_STATE_INIT) {
@@ -830,7 +1363,7 @@ nst_cache_exists(nst_ctx_t *ctx) {
 
             if(ctx->store.disk.obj.file) {
 
-                if(nst_disk_obj_valid(&ctx->store.disk.obj, ctx->key) != NST_OK) {
+                if(nst_disk_obj_valid(&nuster.cache->store.disk, &ctx->store.disk.obj, ctx->key) != NST_OK) {
 
                     ret = NST_CTX_STATE_INIT;
 
@@ -920,6 +1453,8 @@ void
 nst_cache_abort(nst_ctx_t *ctx) {
     nst_dict_entry_t   *entry = ctx->entry;
 
+    _nst_cache_unfill(ctx);
+
     if(entry->state == NST_DICT_ENTRY_STATE_INIT || entry->state == NST_DICT_ENTRY_STATE_UPDATE) {
 
         if(ctx->store.memory.obj) {
@@ -938,6 +1473,8 @@ nst_cache_abort(nst_ctx_t *ctx) {
     if(entry->state == NST_DICT_ENTRY_STATE_UPDATE) {
         entry->state = NST_DICT_ENTRY_STATE_STALE;
     }
+
+    _nst_cache_wake(ctx);
 }
 
 /*
@@ -951,7 +1488,7 @@ nst_cache_delete(nst_key_t *key) {
     nst_dict_entry_t  *entry = NULL;
     int                ret   = 1;
 
-    nst_shctx_lock(dict);
+    nst_dict_lock(dict, key->hash);
 
     entry = nst_dict_get(dict, key);
 
@@ -972,8 +1509,10 @@ nst_cache_delete(nst_key_t *key) {
             }
 
             if(entry->store.disk.file) {
-                nst_disk_file_remove(entry->store.disk.file);
-                nst_shmem_free(nuster.cache->shmem, entry->store.disk.file);
+                nst_disk_obj_remove(&nuster.cache->store.disk, entry->store.disk.file,
+                        entry->store.disk.base, entry->store.disk.size);
+
+                nst_disk_file_free(&nuster.cache->store.disk, entry->store.disk.file);
                 entry->store.disk.file = NULL;
             }
 
@@ -984,9 +1523,11 @@ nst_cache_delete(nst_key_t *key) {
         ret = 0;
     }
 
-    nst_shctx_unlock(dict);
+    nst_dict_unlock(dict, key->hash);
 
-    if(!nuster.cache->store.disk.loaded && global.nuster.cache.root.len){
+    /* the log engine has no other index than the dict */
+    if(!nuster.cache->store.disk.loaded && global.nuster.cache.root.len
+            && nuster.cache->store.disk.engine == NST_DISK_ENGINE_FILE) {
         nst_disk_obj_t  disk;
         hpx_buffer_t    *buf = get_trash_chunk();
 
@@ -1023,16 +1564,44 @@ nst_cache_hit(hpx_stream_t *s, hpx_stream_interface_t *si, hpx_channel_t *req, h
         appctx->st0 = ctx->state;
 
         if(ctx->state == NST_CTX_STATE_HIT_MEMORY) {
-            nst_memory_obj_attach(&nuster.cache->store.memory, ctx->store.memory.obj);
             appctx->ctx.nuster.store.memory.obj  = ctx->store.memory.obj;
             appctx->ctx.nuster.store.memory.item = ctx->store.memory.obj->item;
+
+            if(ctx->store.memory.follow) {
+                appctx->ctx.nuster.store.memory.item   = NULL;
+                appctx->ctx.nuster.store.memory.follow = 1;
+
+                nst_waiter_init(&appctx->ctx.nuster.store.memory.waiter, appctx->t);
+
+                appctx->ctx.nuster.store.memory.waiter.hash = ctx->key->hash;
+            }
         } else {
             char  *meta = ctx->store.disk.obj.meta;
 
             appctx->ctx.nuster.store.disk.fd          = ctx->store.disk.obj.fd;
-            appctx->ctx.nuster.store.disk.offset      = nst_disk_pos_header(&ctx->store.disk.obj);
+            appctx->ctx.nuster.store.disk.offset      = ctx->store.disk.obj.base
+                + nst_disk_pos_header(&ctx->store.disk.obj);
             appctx->ctx.nuster.store.disk.header_len  = nst_disk_meta_get_header_len(meta);
             appctx->ctx.nuster.store.disk.payload_len = nst_disk_meta_get_payload_len(meta);
+            appctx->ctx.nuster.store.disk.start       = ctx->store.disk.obj.base
+                + NST_DISK_META_SIZE;
+            appctx->ctx.nuster.store.disk.end         = ctx->store.disk.obj.end;
+
+            /* the applet owns the head from now on */
+            appctx->ctx.nuster.store.disk.head        = ctx->store.disk.obj.head;
+            ctx->store.disk.obj.head                  = NULL;
+
+            appctx->ctx.nuster.store.disk.pcache      = ctx->store.disk.obj.pcache;
+            appctx->ctx.nuster.store.disk.id          = ctx->store.disk.obj.id;
+            appctx->ctx.nuster.store.disk.hits        = ctx->store.disk.obj.hits;
+
+            /* the page cache reads are served from memory mostly */
+            if(global.nuster.cache.disk_aio != NST_AIO_ENGINE_NONE
+                    && !appctx->ctx.nuster.store.disk.pcache) {
+
+                appctx->ctx.nuster.store.disk.aio = nst_aio_new(appctx,
+                        global.nuster.cache.disk_aio, global.nuster.stats->cache.disk_latency);
+            }
         }
 
         appctx->st1 = NST_DISK_APPLET_HEADER;
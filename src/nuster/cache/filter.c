@@ -83,6 +83,8 @@ _nst_cache_filter_attach(hpx_stream_t *s, hpx_filter_t *filter) {
             return 0;
         }
 
+        nst_waiter_init(&ctx->waiter, s->task);
+
         filter->ctx = ctx;
     }
 
@@ -109,14 +111,19 @@ _nst_cache_filter_detach(hpx_stream_t *s, hpx_filter_t *filter) {
             nst_cache_abort(ctx);
         }
 
+        nst_waiters_release(nuster.cache->waiters, &ctx->waiter);
+        nst_waiters_del(nuster.cache->waiters, &ctx->waiter);
+
         for(i = 0; i < ctx->key_cnt; i++) {
             ctx->key = &ctx->keys[i];
 
-            if(ctx->key->data) {
-                free(ctx->key->data);
-            }
+            nst_key_free(ctx->key);
         }
 
+        nst_memory_pack_free(&ctx->store.memory.pack);
+
+        nst_disk_obj_head_free(&ctx->store.disk.obj);
+
         free_trash_chunk(ctx->buf);
 
         free(ctx);
@@ -184,8 +191,6 @@ _nst_cache_filter_http_headers(hpx_stream_t *s, hpx_filter_t *filter, hpx_http_m
 
                         return 1;
                     }
-
-                    nst_key_hash(ctx->key);
                 }
 
                 nst_key_debug(s, ctx->key);
@@ -232,6 +237,18 @@ _nst_cache_filter_http_headers(hpx_stream_t *s, hpx_filter_t *filter, hpx_http_m
                     nst_debug_end("PASS");
                     ctx->state = NST_CTX_STATE_PASS;
 
+                    /* identical requests wait for this one to create the entry */
+                    if(ctx->rule->prop.wait >= 0 && !ctx->waiter.pass
+                            && nst_waiters_claim(nuster.cache->waiters, &ctx->waiter,
+                                ctx->key->hash) != NST_OK) {
+
+                        nst_key_reset_flag(ctx->key);
+                        nst_debug(s, "[cache] WAIT claimed");
+
+                        ctx->state = NST_CTX_STATE_WAIT;
+                        ctx->prop  = &ctx->rule->prop;
+                    }
+
                     break;
                 }
 
@@ -255,13 +272,26 @@ _nst_cache_filter_http_headers(hpx_stream_t *s, hpx_filter_t *filter, hpx_http_m
             int  t = nst_time_now_ms() - ctx->ctime;
 
             if(ctx->prop->wait == 0 || (ctx->prop->wait > 0 && t < ctx->prop->wait * 1000)) {
-                usleep(1000);
+                int  ms = NST_CACHE_WAIT_RECHECK;
+
+                if(ctx->prop->wait > 0 && ctx->prop->wait * 1000 - t < ms) {
+                    ms = ctx->prop->wait * 1000 - t;
+                }
+
+                /*
+                 * parked by nst_cache_exists or on the claim of the key, woken
+                 * once the entry is done or the claim released,
+                 * or at the latest when the wait or the recheck expires
+                 */
                 ctx->state = NST_CTX_STATE_INIT;
 
-                task_wakeup(s->task, TASK_WOKEN_MSG);
+                req->flags      &= ~CF_ANA_TIMEOUT;
+                req->analyse_exp = tick_add(now_ms, ms);
 
                 return 0;
             }
+
+            nst_waiters_del(nuster.cache->waiters, &ctx->waiter);
         }
 
     } else {
@@ -319,6 +349,8 @@ _nst_cache_filter_http_headers(hpx_stream_t *s, hpx_filter_t *filter, hpx_http_m
             if(!valid) {
                 nst_debug_end("FAIL");
 
+                nst_waiters_release(nuster.cache->waiters, &ctx->waiter);
+
                 return 1;
             }
 
@@ -339,6 +371,8 @@ _nst_cache_filter_http_headers(hpx_stream_t *s, hpx_filter_t *filter, hpx_http_m
 
                     ctx->state = NST_CTX_STATE_BYPASS;
 
+                    nst_waiters_release(nuster.cache->waiters, &ctx->waiter);
+
                     return 1;
                 }
             } else {
@@ -358,6 +392,9 @@ _nst_cache_filter_http_headers(hpx_stream_t *s, hpx_filter_t *filter, hpx_http_m
             }
 
             nst_cache_create(msg, ctx);
+
+            /* the waiters of the claim find the entry, or go to the backend */
+            nst_waiters_release(nuster.cache->waiters, &ctx->waiter);
         }
 
     }
@@ -12,45 +12,136 @@
 
 #include <nuster/nuster.h>
 
+static int
+_nst_dict_table_init(nst_dict_t *dict, nst_dict_table_t *table, uint64_t segs) {
+    uint64_t  block_size = dict->shmem->block_size;
+    uint64_t  i;
+
+    for(i = 0; i < segs; i++) {
+        table->seg[i] = nst_shmem_alloc(dict->shmem, block_size);
+
+        if(!table->seg[i]) {
+
+            while(i--) {
+                nst_shmem_free(dict->shmem, table->seg[i]);
+            }
+
+            return NST_ERR;
+        }
+
+        memset(table->seg[i], 0, block_size);
+    }
+
+    table->size = segs << dict->seg_shift;
+
+    return NST_OK;
+}
+
+static void
+_nst_dict_table_free(nst_dict_t *dict, nst_dict_table_t *table) {
+    uint64_t  i;
+
+    for(i = 0; i < table->size >> dict->seg_shift; i++) {
+        nst_shmem_free(dict->shmem, table->seg[i]);
+    }
+
+    table->size = 0;
+}
+
+static void
+_nst_dict_lock_all(nst_dict_t *dict) {
+    uint64_t  i;
+
+    for(i = 0; i < dict->locks; i++) {
+        nst_shctx_lock(&dict->lock[i]);
+    }
+}
+
+static void
+_nst_dict_unlock_all(nst_dict_t *dict) {
+    uint64_t  i;
+
+    for(i = 0; i < dict->locks; i++) {
+        nst_shctx_unlock(&dict->lock[i]);
+    }
+}
+
 int
-nst_dict_init(nst_dict_t *dict, nst_store_t *store, nst_shmem_t *shmem, uint64_t dict_size) {
+nst_dict_init(nst_dict_t *dict, nst_store_t *store, nst_shmem_t *shmem, uint64_t dict_size,
+        int locks) {
 
-    int  block_size = shmem->block_size;
-    int  entry_size = sizeof(nst_dict_entry_t *);
-    int  size       = (block_size + dict_size - 1) / block_size * block_size;
-    int  i;
+    uint64_t  block_size = shmem->block_size;
+    uint64_t  entry_size = sizeof(nst_dict_entry_t *);
+    uint64_t  i;
 
     dict->shmem = shmem;
-    dict->size  = size / entry_size;
     dict->used  = 0;
-    dict->entry = nst_shmem_alloc(shmem, block_size);
     dict->store = store;
 
-    if(!dict->entry) {
-        return NST_ERR;
-    }
+    for(dict->seg_shift = 0; entry_size << dict->seg_shift < block_size; dict->seg_shift++) { }
+
+    /*
+     * a table cannot have more segments than the blocks of shmem, the
+     * segment directories of both tables are allocated once here, each one
+     * spans consecutive blocks
+     */
+    dict->segs = shmem->blocks;
 
-    for(i = 1; i < size / block_size; i++) {
+    for(i = 0; i < 2; i++) {
+        dict->table[i].size = 0;
+        dict->table[i].seg  = nst_shmem_alloc_blocks(shmem,
+                dict->segs * sizeof(nst_dict_entry_t **));
 
-        if(!nst_shmem_alloc(shmem, block_size)) {
+        if(!dict->table[i].seg) {
             return NST_ERR;
         }
     }
 
-    for(i = 0; i < dict->size; i++) {
-        dict->entry[i] = NULL;
+    if(_nst_dict_table_init(dict, &dict->table[0],
+                (dict_size + block_size - 1) / block_size) != NST_OK) {
+
+        return NST_ERR;
+    }
+
+    /*
+     * locks must be a power of 2 which divides the number of buckets of a
+     * segment, and the stripes must fit in one block
+     */
+    dict->locks = 1;
+
+    while(dict->locks * 2 <= locks
+            && dict->locks * 2 <= 1ULL << dict->seg_shift
+            && dict->locks * 2 * sizeof(nst_dict_lock_t) <= block_size) {
+
+        dict->locks *= 2;
     }
 
-    return nst_shctx_init(dict);
+    dict->lock = nst_shmem_alloc(shmem, dict->locks * sizeof(nst_dict_lock_t));
+
+    if(!dict->lock) {
+        return NST_ERR;
+    }
+
+    for(i = 0; i < dict->locks; i++) {
+
+        if(nst_shctx_init(&dict->lock[i]) != NST_OK) {
+            return NST_ERR;
+        }
+    }
+
+    return nst_shctx_init(&dict->evict);
 }
 
 /*
  * Check entry validity, free the entry if its invalid,
+ * only the stripe of dict->cleanup_idx is locked, entries pinned by the disk
+ * saver are left to a later pass
  */
 void
 nst_dict_cleanup(nst_dict_t *dict) {
     nst_dict_entry_t  *entry;
     nst_dict_entry_t  *prev;
+    nst_dict_entry_t **bucket;
     uint64_t           start;
 
     if(!dict->used) {
@@ -59,14 +150,15 @@ nst_dict_cleanup(nst_dict_t *dict) {
 
     start = nst_time_now_ms();
 
-    nst_shctx_lock(dict);
+    nst_dict_lock(dict, dict->cleanup_idx);
 
-    entry = dict->entry[dict->cleanup_idx];
+    bucket = nst_dict_slot(dict, dict->cleanup_idx);
+    entry  = *bucket;
     prev  = entry;
 
     while(entry) {
 
-        if(nst_dict_entry_invalid(entry)) {
+        if(nst_dict_entry_invalid(entry) && !entry->pinned) {
             nst_dict_entry_t  *tmp = entry;
 
             if(entry->store.memory.obj) {
@@ -77,12 +169,15 @@ nst_dict_cleanup(nst_dict_t *dict) {
             }
 
             if(entry->store.disk.file) {
-                nst_shmem_free(dict->shmem, entry->store.disk.file);
+                nst_disk_obj_release(&dict->store->disk, entry->store.disk.file,
+                        entry->store.disk.size);
+
+                nst_disk_file_free(&dict->store->disk, entry->store.disk.file);
                 entry->store.disk.file = NULL;
             }
 
             if(prev == entry) {
-                dict->entry[dict->cleanup_idx] = entry->next;
+                *bucket = entry->next;
                 prev = entry->next;
             } else {
                 prev->next = entry->next;
@@ -94,7 +189,7 @@ nst_dict_cleanup(nst_dict_t *dict) {
             nst_shmem_free(dict->shmem, tmp->key.data);
             nst_shmem_free(dict->shmem, tmp);
 
-            dict->used--;
+            __sync_sub_and_fetch(&dict->used, 1);
         } else {
             prev  = entry;
             entry = entry->next;
@@ -105,24 +200,280 @@ nst_dict_cleanup(nst_dict_t *dict) {
         }
     }
 
+    nst_dict_unlock(dict, dict->cleanup_idx);
+
     if(entry == NULL) {
         dict->cleanup_idx++;
     }
 
     /* if we have checked the whole dict */
-    if(dict->cleanup_idx == dict->size) {
+    if(dict->cleanup_idx >= nst_dict_slots(dict)) {
         dict->cleanup_idx = 0;
     }
+}
+
+/*
+ * Grow the dict once overloaded, a table twice as big is allocated then the
+ * buckets of table[0] are moved to it, one bucket per call.
+ */
+void
+nst_dict_rehash(nst_dict_t *dict) {
+    nst_dict_entry_t  *entry, *next, **bucket, **tail;
+    nst_dict_table_t   table;
+    uint64_t           idx, segs;
+
+    if(!dict->table[1].size) {
+        segs = dict->table[0].size >> dict->seg_shift;
+
+        if(dict->used <= dict->table[0].size * NST_DICT_LOAD_FACTOR || segs * 2 > dict->segs) {
+            return;
+        }
+
+        if(nst_time_now_ms() < dict->rehash.retry) {
+            return;
+        }
+
+        table.seg = dict->table[1].seg;
+
+        if(_nst_dict_table_init(dict, &table, segs * 2) != NST_OK) {
+            dict->rehash.retry = nst_time_now_ms() + 1000;
+
+            return;
+        }
+
+        _nst_dict_lock_all(dict);
+
+        dict->table[1]   = table;
+        dict->rehash.idx = 0;
+
+        _nst_dict_unlock_all(dict);
+
+        return;
+    }
+
+    idx = dict->rehash.idx;
 
-    nst_shctx_unlock(dict);
+    if(idx < dict->table[0].size) {
+        nst_dict_lock(dict, idx);
+
+        bucket  = nst_dict_bucket(dict, &dict->table[0], idx);
+        entry   = *bucket;
+        *bucket = NULL;
+
+        while(entry) {
+            next = entry->next;
+            tail = nst_dict_bucket(dict, &dict->table[1], entry->key.hash % dict->table[1].size);
+
+            /* append, entries added to table[1] meanwhile are newer */
+            while(*tail) {
+                tail = &(*tail)->next;
+            }
+
+            entry->next = NULL;
+            *tail       = entry;
+            entry       = next;
+        }
+
+        nst_dict_unlock(dict, idx);
+
+        dict->rehash.idx++;
+
+        return;
+    }
+
+    /* all buckets are moved, switch tables */
+    _nst_dict_lock_all(dict);
+
+    table               = dict->table[0];
+    dict->table[0]      = dict->table[1];
+    dict->table[1].seg  = table.seg;
+    dict->table[1].size = 0;
+    dict->cleanup_idx   = 0;
+    dict->rehash.idx    = 0;
+    dict->rehash.version++;
+
+    _nst_dict_unlock_all(dict);
+
+    _nst_dict_table_free(dict, &table);
+}
+
+/*
+ * CLOCK eviction of memory objects: the hand walks the slots and evicts the
+ * objects of entries not accessed since the hand last passed. Entries also
+ * stored on disk only lose the memory object.
+ * Locks are only tried, the caller may hold other nuster locks.
+ * Returns the number of bytes freed.
+ */
+uint64_t
+nst_dict_evict(nst_dict_t *dict, uint64_t size) {
+    nst_memory_t      *mem   = &dict->store->memory;
+    nst_dict_entry_t  *entry;
+    nst_memory_obj_t  *obj;
+    uint64_t           freed = 0;
+    uint64_t           idx, now;
+    int                scan  = NST_DICT_EVICT_SCAN;
+
+    if(nst_shctx_trylock(&dict->evict)) {
+        return 0;
+    }
+
+    now = nst_time_now_ms();
+
+    while(freed < size && scan--) {
+
+        if(dict->evict.idx >= nst_dict_slots(dict)) {
+            dict->evict.idx = 0;
+        }
+
+        idx = dict->evict.idx++;
+
+        if(nst_shctx_trylock(nst_dict_stripe(dict, idx))) {
+            continue;
+        }
+
+        /* tables may have been switched meanwhile */
+        if(idx >= nst_dict_slots(dict)) {
+            nst_dict_unlock(dict, idx);
+
+            continue;
+        }
+
+        entry = *nst_dict_slot(dict, idx);
+
+        while(entry) {
+
+            if(entry->store.memory.obj
+                    && (entry->state == NST_DICT_ENTRY_STATE_VALID
+                        || entry->state == NST_DICT_ENTRY_STATE_STALE)) {
+
+                if(entry->atime < entry->htime) {
+                    obj = entry->store.memory.obj;
+
+                    entry->store.memory.obj = NULL;
+
+                    if(!entry->store.disk.file) {
+                        entry->state  = NST_DICT_ENTRY_STATE_INVALID;
+                        entry->expire = 0;
+                    }
+
+                    freed += nst_memory_obj_evict(mem, obj);
+                } else {
+                    entry->htime = now;
+                }
+            }
+
+            entry = entry->next;
+        }
+
+        nst_dict_unlock(dict, idx);
+    }
+
+    nst_shctx_unlock(&dict->evict);
+
+    return freed;
+}
+
+/*
+ * find the entry the eviction hand would evict next, without moving the hand
+ * return NST_OK and set hash if found, otherwise NST_ERR
+ */
+int
+nst_dict_victim(nst_dict_t *dict, uint64_t *hash) {
+    nst_dict_entry_t  *entry;
+    uint64_t           idx   = dict->evict.idx;
+    int                scan  = NST_DICT_VICTIM_SCAN;
+    int                ret   = NST_ERR;
+
+    while(ret != NST_OK && scan--) {
+
+        if(idx >= nst_dict_slots(dict)) {
+            idx = 0;
+        }
+
+        if(nst_shctx_trylock(nst_dict_stripe(dict, idx))) {
+            idx++;
+
+            continue;
+        }
+
+        if(idx < nst_dict_slots(dict)) {
+            entry = *nst_dict_slot(dict, idx);
+
+            while(entry) {
+
+                if(entry->store.memory.obj
+                        && (entry->state == NST_DICT_ENTRY_STATE_VALID
+                            || entry->state == NST_DICT_ENTRY_STATE_STALE)) {
+
+                    *hash = entry->key.hash;
+                    ret   = NST_OK;
+
+                    if(entry->atime < entry->htime) {
+                        break;
+                    }
+                }
+
+                entry = entry->next;
+            }
+        }
+
+        nst_dict_unlock(dict, idx);
+
+        idx++;
+    }
+
+    return ret;
+}
+
+/*
+ * new entries go to table[1] while rehashing
+ */
+static nst_dict_entry_t **
+_nst_dict_insert_bucket(nst_dict_t *dict, nst_key_t *key) {
+    nst_dict_table_t  *table = &dict->table[dict->table[1].size ? 1 : 0];
+
+    return nst_dict_bucket(dict, table, key->hash % table->size);
+}
+
+/*
+ * table[1] holds the newer entries
+ */
+static nst_dict_entry_t *
+_nst_dict_lookup(nst_dict_t *dict, nst_key_t *key) {
+    nst_dict_table_t  *table;
+    nst_dict_entry_t  *entry;
+    int                i;
+
+    for(i = 1; i >= 0; i--) {
+        table = &dict->table[i];
+
+        if(!table->size) {
+            continue;
+        }
+
+        entry = *nst_dict_bucket(dict, table, key->hash % table->size);
+
+        while(entry) {
+
+            if(entry->key.hash == key->hash && entry->key.size == key->size
+                    && !memcmp(entry->key.data, key->data, key->size)) {
+
+                return entry;
+            }
+
+            entry = entry->next;
+        }
+    }
+
+    return NULL;
 }
 
 nst_dict_entry_t *
 nst_dict_set(nst_dict_t *dict, nst_key_t *key, nst_http_txn_t *txn, nst_rule_prop_t *prop) {
     nst_dict_entry_t  *entry = NULL;
-    int                idx;
+    nst_dict_entry_t **bucket;
 
-    entry = nst_shmem_alloc(dict->shmem, sizeof(*entry));
+    entry = nst_memory_alloc(&dict->store->memory, sizeof(*entry));
 
     if(!entry) {
         goto err;
@@ -130,34 +481,43 @@ nst_dict_set(nst_dict_t *dict, nst_key_t *key, nst_http_txn_t *txn, nst_rule_pro
 
     memset(entry, 0, sizeof(*entry));
 
-    idx = key->hash % dict->size;
+    /* set key before linking, lookups and the rehash rely on it */
+    entry->key.data = nst_memory_alloc(&dict->store->memory, key->size);
 
-    /* prepend entry to dict->entry[idx] */
-    entry->next      = dict->entry[idx];
-    dict->entry[idx] = entry;
-    dict->used++;
+    if(!entry->key.data) {
+        nst_shmem_free(dict->shmem, entry);
 
-    /* init entry */
-    entry->state = NST_DICT_ENTRY_STATE_INIT;
+        return NULL;
+    }
+
+    memcpy(entry->key.data, key->data, key->size);
 
-    /* set key */
     entry->key.size = key->size;
     entry->key.hash = key->hash;
-    entry->key.data = nst_shmem_alloc(dict->shmem, key->size);
 
-    if(!entry->key.data) {
-        goto err;
+    /* the uuid, if already computed, spares the saver computing it again */
+    if(key->flags & NST_KEY_UUID) {
+        memcpy(entry->key.uuid, key->uuid, NST_KEY_UUID_LEN);
+
+        entry->key.flags = NST_KEY_UUID;
     }
 
-    memcpy(entry->key.data, key->data, key->size);
-    memcpy(entry->key.uuid, key->uuid, 20);
+    bucket = _nst_dict_insert_bucket(dict, key);
+
+    /* prepend entry to bucket */
+    entry->next = *bucket;
+    *bucket     = entry;
+    __sync_add_and_fetch(&dict->used, 1);
+
+    /* init entry */
+    entry->state = NST_DICT_ENTRY_STATE_INIT;
 
     /* set buf */
     entry->buf.size = txn->req.host.len + txn->req.path.len + txn->res.etag.len
         + txn->res.last_modified.len + prop->pid.len + prop->rid.len;
 
     entry->buf.data = 0;
-    entry->buf.area = nst_shmem_alloc(dict->shmem, entry->buf.size);
+    entry->buf.area = nst_memory_alloc(&dict->store->memory, entry->buf.size);
 
     if(!entry->buf.area) {
         goto err;
@@ -192,6 +552,7 @@ nst_dict_set(nst_dict_t *dict, nst_key_t *key, nst_http_txn_t *txn, nst_rule_pro
     entry->prop.wait          = prop->wait;
     entry->prop.stale         = prop->stale;
     entry->prop.inactive      = prop->inactive;
+    entry->prop.store         = prop->store;
     entry->expire             = 0;
     entry->atime              = nst_time_now_ms();
 
@@ -214,132 +575,110 @@ nst_dict_entry_t *
 nst_dict_get(nst_dict_t *dict, nst_key_t *key) {
     nst_dict_entry_t  *entry = NULL;
     uint64_t           max;
-    int                idx, expired;
+    int                expired;
 
     if(dict->used == 0) {
         return NULL;
     }
 
-    idx   = key->hash % dict->size;
-    entry = dict->entry[idx];
-
-    while(entry) {
+    entry = _nst_dict_lookup(dict, key);
 
-        if(entry->key.hash == key->hash && entry->key.size == key->size
-                && !memcmp(entry->key.uuid, key->uuid, NST_KEY_UUID_LEN)
-                && !memcmp(entry->key.data, key->data, key->size)) {
-
-            if(entry->state == NST_DICT_ENTRY_STATE_INVALID) {
-                return NULL;
-            }
-
-            if(entry->state == NST_DICT_ENTRY_STATE_INIT
-                    || entry->state == NST_DICT_ENTRY_STATE_UPDATE) {
+    if(entry == NULL) {
+        return NULL;
+    }
 
-                return entry;
-            }
+    if(entry->state == NST_DICT_ENTRY_STATE_INVALID) {
+        return NULL;
+    }
 
-            if(entry->state == NST_DICT_ENTRY_STATE_STALE) {
+    if(entry->state == NST_DICT_ENTRY_STATE_INIT
+            || entry->state == NST_DICT_ENTRY_STATE_UPDATE) {
 
-                if(nst_dict_entry_stale_valid(entry)) {
-                    return entry;
-                } else {
-                    return NULL;
-                }
-            }
+        return entry;
+    }
 
-            /*
-             * check extend
-             */
-            expired = nst_dict_entry_expired(entry);
+    if(entry->state == NST_DICT_ENTRY_STATE_STALE) {
 
-            max = 1000 * entry->expire + 1000 * entry->prop.ttl * entry->prop.extend[3] / 100;
+        if(nst_dict_entry_stale_valid(entry)) {
+            return entry;
+        } else {
+            return NULL;
+        }
+    }
 
-            entry->atime = nst_time_now_ms();
+    /*
+     * check extend
+     */
+    expired = nst_dict_entry_expired(entry);
 
-            if(expired && entry->prop.extend[0] != 0xFF && entry->atime <= max
-                    && entry->access[3] > entry->access[2]
-                    && entry->access[2] > entry->access[1]) {
+    max = 1000 * entry->expire + 1000 * entry->prop.ttl * entry->prop.extend[3] / 100;
 
-                entry->expire    += entry->prop.ttl;
+    entry->atime = nst_time_now_ms();
 
-                entry->access[0] += entry->access[1];
-                entry->access[0] += entry->access[2];
-                entry->access[0] += entry->access[3];
-                entry->access[1]  = 0;
-                entry->access[2]  = 0;
-                entry->access[3]  = 0;
-                entry->extended  += 1;
+    if(expired && entry->prop.extend[0] != 0xFF && entry->atime <= max
+            && entry->access[3] > entry->access[2]
+            && entry->access[2] > entry->access[1]) {
 
-                if(entry->store.disk.file) {
-                    nst_disk_update_expire(entry->store.disk.file, entry->expire);
-                }
+        entry->expire    += entry->prop.ttl;
 
-                expired = 0;
-            }
+        entry->access[0] += entry->access[1];
+        entry->access[0] += entry->access[2];
+        entry->access[0] += entry->access[3];
+        entry->access[1]  = 0;
+        entry->access[2]  = 0;
+        entry->access[3]  = 0;
+        entry->extended  += 1;
 
-            /*
-             * check stale
-             */
-            if(expired && entry->prop.stale >= 0) {
-                entry->state = NST_DICT_ENTRY_STATE_REFRESH;
+        if(entry->store.disk.file) {
+            nst_disk_update_expire(entry->store.disk.file, entry->store.disk.base, entry->expire);
+        }
 
-                expired = 0;
-            }
+        expired = 0;
+    }
 
-            /* check expire
-             * change state only, leave the free stuff to cleanup
-             * */
-            if(expired) {
-                entry->state     = NST_DICT_ENTRY_STATE_INVALID;
-                entry->expire    = 0;
-                entry->access[0] = 0;
-                entry->access[1] = 0;
-                entry->access[2] = 0;
-                entry->access[3] = 0;
-                entry->extended  = 0;
-
-                if(entry->store.memory.obj) {
-                    entry->store.memory.obj->invalid = 1;
-                    entry->store.memory.obj          = NULL;
-
-                    nst_memory_incr_invalid(&dict->store->memory);
-                }
+    /*
+     * check stale
+     */
+    if(expired && entry->prop.stale >= 0) {
+        entry->state = NST_DICT_ENTRY_STATE_REFRESH;
 
-                return NULL;
-            }
+        expired = 0;
+    }
 
-            return entry;
+    /* check expire
+     * change state only, leave the free stuff to cleanup
+     * */
+    if(expired) {
+        entry->state     = NST_DICT_ENTRY_STATE_INVALID;
+        entry->expire    = 0;
+        entry->access[0] = 0;
+        entry->access[1] = 0;
+        entry->access[2] = 0;
+        entry->access[3] = 0;
+        entry->extended  = 0;
+
+        if(entry->store.memory.obj) {
+            entry->store.memory.obj->invalid = 1;
+            entry->store.memory.obj          = NULL;
+
+            nst_memory_incr_invalid(&dict->store->memory);
         }
 
-        entry = entry->next;
+        return NULL;
     }
 
-    return NULL;
+    return entry;
 }
 
 int
 nst_dict_set_from_disk(nst_dict_t *dict, hpx_buffer_t *buf, nst_key_t *key, nst_http_txn_t *txn,
-        nst_rule_prop_t *prop, char *file, uint64_t expire) {
+        nst_rule_prop_t *prop, char *file, uint64_t base, uint64_t size, uint64_t id,
+        uint64_t expire) {
 
     nst_dict_entry_t  *entry = NULL;
-    int                idx;
-
-    idx = key->hash % dict->size;
-
-    entry = dict->entry[idx];
-
-    while(entry) {
+    nst_dict_entry_t **bucket;
 
-        if(entry->key.hash == key->hash && entry->key.size == key->size
-                && !memcmp(entry->key.uuid, key->uuid, NST_KEY_UUID_LEN)
-                && !memcmp(entry->key.data, key->data, key->size)) {
-
-            break;
-        }
-
-        entry = entry->next;
-    }
+    entry = _nst_dict_lookup(dict, key);
 
     if(entry) {
         nst_shmem_free(dict->shmem, key->data);
@@ -356,10 +695,20 @@ nst_dict_set_from_disk(nst_dict_t *dict, hpx_buffer_t *buf, nst_key_t *key, nst_
 
     memset(entry, 0, sizeof(*entry));
 
-    /* prepend entry to dict->entry[idx] */
-    entry->next      = dict->entry[idx];
-    dict->entry[idx] = entry;
-    dict->used++;
+    entry->store.disk.file = nst_disk_file_dup(&dict->store->disk, file);
+
+    if(!entry->store.disk.file) {
+        nst_shmem_free(dict->shmem, entry);
+
+        return NST_ERR;
+    }
+
+    bucket = _nst_dict_insert_bucket(dict, key);
+
+    /* prepend entry to bucket */
+    entry->next = *bucket;
+    *bucket     = entry;
+    __sync_add_and_fetch(&dict->used, 1);
 
     /* init entry */
     if(expire == 0 || expire * 1000 > nst_time_now_ms()) {
@@ -372,15 +721,9 @@ nst_dict_set_from_disk(nst_dict_t *dict, hpx_buffer_t *buf, nst_key_t *key, nst_
     entry->expire = expire;
     entry->atime  = nst_time_now_ms();
 
-    entry->store.disk.file = nst_shmem_alloc(dict->shmem, strlen(file));
-
-    if(!entry->store.disk.file) {
-        nst_shmem_free(dict->shmem, entry);
-
-        return NST_ERR;
-    }
-
-    memcpy(entry->store.disk.file, file, strlen(file));
+    entry->store.disk.base = base;
+    entry->store.disk.size = size;
+    entry->store.disk.id   = id;
 
     entry->header_len         = txn->res.header_len;
     entry->payload_len        = txn->res.payload_len;
@@ -404,6 +747,60 @@ nst_dict_set_from_disk(nst_dict_t *dict, hpx_buffer_t *buf, nst_key_t *key, nst_
     return NST_OK;
 }
 
+/*
+ * publishes the disk object of a locked entry, the one it replaces is removed
+ * unless it is the same file
+ */
+void
+nst_dict_entry_set_disk(nst_dict_t *dict, nst_dict_entry_t *entry, nst_disk_obj_t *obj) {
+    nst_disk_t  *disk = &dict->store->disk;
+
+    if(entry->store.disk.file && disk->engine == NST_DISK_ENGINE_LOG) {
+        nst_disk_obj_remove(disk, entry->store.disk.file, entry->store.disk.base,
+                entry->store.disk.size);
+    }
+
+    entry->store.disk.file = obj->file;
+    entry->store.disk.base = obj->base;
+    entry->store.disk.size = obj->size;
+    entry->store.disk.id   = nst_disk_meta_get_id(obj->meta);
+}
+
+/*
+ * the entry whose disk object is at file:base, if any
+ */
+nst_dict_entry_t *
+nst_dict_get_disk(nst_dict_t *dict, nst_key_t *key, char *file, uint64_t base) {
+    nst_dict_table_t  *table;
+    nst_dict_entry_t  *entry;
+    int                i;
+
+    for(i = 1; i >= 0; i--) {
+        table = &dict->table[i];
+
+        if(!table->size) {
+            continue;
+        }
+
+        entry = *nst_dict_bucket(dict, table, key->hash % table->size);
+
+        while(entry) {
+
+            if(entry->store.disk.file == file && entry->store.disk.base == base
+                    && entry->state != NST_DICT_ENTRY_STATE_INVALID
+                    && entry->key.hash == key->hash && entry->key.size == key->size
+                    && !memcmp(entry->key.data, key->data, key->size)) {
+
+                return entry;
+            }
+
+            entry = entry->next;
+        }
+    }
+
+    return NULL;
+}
+
 void
 nst_dict_record_access(nst_dict_entry_t *entry) {
 
@@ -12,10 +12,12 @@
 
 #include <inttypes.h>
 
+#define XXH_STATIC_LINKING_ONLY
 #include <import/xxhash.h>
 #include <import/sha1.h>
 
 #include <haproxy/global.h>
+#include <haproxy/pool.h>
 #include <haproxy/htx.h>
 #include <haproxy/stream.h>
 #include <haproxy/http_htx.h>
@@ -23,6 +25,64 @@
 
 #include <nuster/nuster.h>
 
+DECLARE_STATIC_POOL(pool_head_nst_key, "nst_key", NST_KEY_POOL_SIZE);
+
+/*
+ * A body larger than NST_KEY_BODY_DIGEST_SIZE is not copied to the key, its
+ * length and its XXH3 128 bits digest are, hashed block by block as they are
+ * in the HTX.
+ */
+static int
+_nst_key_cat_body(hpx_buffer_t *key, hpx_htx_t *htx) {
+    XXH3_state_t        state;
+    XXH128_canonical_t  digest;
+    uint64_t            len = 0;
+    int                 idx;
+
+    for(idx = htx_get_first(htx); idx != -1; idx = htx_get_next(htx, idx)) {
+        hpx_htx_blk_t  *blk = htx_get_blk(htx, idx);
+
+        if(htx_get_blk_type(blk) == HTX_BLK_DATA) {
+            len += htx_get_blksz(blk);
+        }
+    }
+
+    if(len <= NST_KEY_BODY_DIGEST_SIZE) {
+
+        for(idx = htx_get_first(htx); idx != -1; idx = htx_get_next(htx, idx)) {
+            hpx_htx_blk_t  *blk = htx_get_blk(htx, idx);
+
+            if(htx_get_blk_type(blk) != HTX_BLK_DATA) {
+                continue;
+            }
+
+            if(nst_key_cat(key, htx_get_blk_ptr(htx, blk), htx_get_blksz(blk)) != NST_OK) {
+                return NST_ERR;
+            }
+        }
+
+        return NST_OK;
+    }
+
+    XXH3_128bits_reset(&state);
+
+    for(idx = htx_get_first(htx); idx != -1; idx = htx_get_next(htx, idx)) {
+        hpx_htx_blk_t  *blk = htx_get_blk(htx, idx);
+
+        if(htx_get_blk_type(blk) == HTX_BLK_DATA) {
+            XXH3_128bits_update(&state, htx_get_blk_ptr(htx, blk), htx_get_blksz(blk));
+        }
+    }
+
+    XXH128_canonicalFromHash(&digest, XXH3_128bits_digest(&state));
+
+    if(nst_key_cat(key, (char *)&len, sizeof(len)) != NST_OK) {
+        return NST_ERR;
+    }
+
+    return nst_key_cat(key, (char *)digest.digest, sizeof(digest.digest));
+}
+
 int
 nst_key_build(hpx_stream_t *s, hpx_http_msg_t *msg, nst_rule_t *rule, nst_http_txn_t *txn,
         nst_key_t *key, hpx_http_meth_t method) {
@@ -30,11 +90,15 @@ nst_key_build(hpx_stream_t *s, hpx_http_msg_t *msg, nst_rule_t *rule, nst_http_t
     nst_key_element_t  **pck = rule->key->data;
     nst_key_element_t   *ck  = NULL;
     hpx_buffer_t        *buf = nst_key_init();
+    XXH64_state_t        state;
 
     nst_debug_beg(s, "[rule ] key:  ");
 
+    XXH64_reset(&state, 0);
+
     while((ck = *pck++)) {
-        int  ret = NST_ERR;
+        int     ret   = NST_ERR;
+        size_t  start = buf->data;
 
         switch(ck->type) {
             case NST_KEY_ELEMENT_METHOD:
@@ -166,23 +230,8 @@ nst_key_build(hpx_stream_t *s, hpx_http_msg_t *msg, nst_rule_t *rule, nst_http_t
 
                 if(s->txn->meth == HTTP_METH_POST || s->txn->meth == HTTP_METH_PUT) {
 
-                    int         idx;
-                    hpx_htx_t  *htx = htxbuf(&msg->chn->buf);
-
-                    for(idx = htx_get_first(htx); idx != -1; idx = htx_get_next(htx, idx)) {
-                        hpx_htx_blk_t      *blk  = htx_get_blk(htx, idx);
-                        hpx_htx_blk_type_t  type = htx_get_blk_type(blk);
-                        uint32_t            sz   = htx_get_blksz(blk);
-
-                        if(type != HTX_BLK_DATA) {
-                            continue;
-                        }
-
-                        ret = nst_key_cat(buf, htx_get_blk_ptr(htx, blk), sz);
-
-                        if(ret != NST_OK) {
-                            break;
-                        }
+                    if(_nst_key_cat_body(buf, htxbuf(&msg->chn->buf)) != NST_OK) {
+                        break;
                     }
                 }
 
@@ -196,12 +245,22 @@ nst_key_build(hpx_stream_t *s, hpx_http_msg_t *msg, nst_rule_t *rule, nst_http_t
         if(ret != NST_OK) {
             return NST_ERR;
         }
+
+        /* the key is hashed as it is built, element by element */
+        XXH64_update(&state, buf->area + start, buf->data - start);
     }
 
     nst_debug_end("");
 
-    key->size = buf->data;
-    key->data = malloc(key->size);
+    key->hash   = XXH64_digest(&state);
+    key->flags &= ~NST_KEY_UUID;
+    key->size   = buf->data;
+
+    if(key->size <= NST_KEY_POOL_SIZE) {
+        key->data = pool_alloc(pool_head_nst_key);
+    } else {
+        key->data = malloc(key->size);
+    }
 
     if(!key->data) {
         return NST_ERR;
@@ -212,15 +271,42 @@ nst_key_build(hpx_stream_t *s, hpx_http_msg_t *msg, nst_rule_t *rule, nst_http_t
     return NST_OK;
 }
 
+/*
+ * frees the data of a key built by nst_key_build
+ */
 void
-nst_key_hash(nst_key_t *key) {
+nst_key_free(nst_key_t *key) {
+
+    if(!key->data) {
+        return;
+    }
+
+    if(key->size <= NST_KEY_POOL_SIZE) {
+        pool_free(pool_head_nst_key, key->data);
+    } else {
+        free(key->data);
+    }
+
+    key->data = NULL;
+}
+
+/*
+ * Only the hash is needed to find a key in the dict, where the whole key is
+ * compared anyway, the uuid is computed once a disk file name needs it.
+ */
+unsigned char *
+nst_key_uuid(nst_key_t *key) {
     blk_SHA_CTX ctx;
 
-    key->hash = XXH64(key->data, key->size, 0);
+    if(!(key->flags & NST_KEY_UUID)) {
+        blk_SHA1_Init(&ctx);
+        blk_SHA1_Update(&ctx, key->data, key->size);
+        blk_SHA1_Final(key->uuid, &ctx);
+
+        key->flags |= NST_KEY_UUID;
+    }
 
-    blk_SHA1_Init(&ctx);
-    blk_SHA1_Update(&ctx, key->data, key->size);
-    blk_SHA1_Final(key->uuid, &ctx);
+    return key->uuid;
 }
 
 void
@@ -46,16 +46,12 @@ nst_purger_basic(hpx_stream_t *s, hpx_channel_t *req, hpx_proxy_t *px) {
             while(rule) {
                 nst_debug(s, "[rule ] ----- %s", rule->prop.rid.ptr);
 
-                if(key.data) {
-                    free(key.data);
-                }
+                nst_key_free(&key);
 
                 if(nst_key_build(s, msg, rule, &txn, &key, HTTP_METH_GET) != NST_OK) {
                     goto err;
                 }
 
-                nst_key_hash(&key);
-
                 nst_key_debug(s, &key);
 
                 if(global.nuster.cache.status == NST_STATUS_ON
@@ -93,9 +89,7 @@ err:
 end:
     free_trash_chunk(buf);
 
-    if(key.data) {
-        free(key.data);
-    }
+    nst_key_free(&key);
 
     return 1;
 }
@@ -235,6 +229,8 @@ purge:
             appctx->ctx.nuster.manager.dict = &nuster.nosql->dict;
         }
 
+        appctx->ctx.nuster.manager.version = appctx->ctx.nuster.manager.dict->rehash.version;
+
         switch(method) {
             case NST_MANAGER_PROXY:
             case NST_MANAGER_RULE:
@@ -376,10 +372,22 @@ nst_purger_handler(hpx_appctx_t *appctx) {
 
     while(1) {
 
-        while(appctx->ctx.nuster.manager.idx < dict->size && max--) {
-            nst_shctx_lock(dict);
+        while(appctx->ctx.nuster.manager.idx < nst_dict_slots(dict) && max--) {
+            uint64_t  idx = appctx->ctx.nuster.manager.idx;
+
+            nst_dict_lock(dict, idx);
+
+            /* slots changed as the dict was resized, start over */
+            if(appctx->ctx.nuster.manager.version != dict->rehash.version) {
+                appctx->ctx.nuster.manager.version = dict->rehash.version;
+                appctx->ctx.nuster.manager.idx     = 0;
 
-            entry = dict->entry[appctx->ctx.nuster.manager.idx];
+                nst_dict_unlock(dict, idx);
+
+                continue;
+            }
+
+            entry = *nst_dict_slot(dict, idx);
 
             while(entry) {
 
@@ -398,7 +406,11 @@ nst_purger_handler(hpx_appctx_t *appctx) {
                         }
 
                         if(entry->store.disk.file) {
-                            nst_disk_purge_by_path(entry->store.disk.file);
+                            nst_disk_obj_remove(&dict->store->disk, entry->store.disk.file,
+                                    entry->store.disk.base, entry->store.disk.size);
+
+                            nst_disk_file_free(&dict->store->disk, entry->store.disk.file);
+                            entry->store.disk.file = NULL;
                         }
                     }
                 }
@@ -410,11 +422,11 @@ nst_purger_handler(hpx_appctx_t *appctx) {
                 }
             }
 
+            nst_dict_unlock(dict, idx);
+
             if(entry == NULL) {
                 appctx->ctx.nuster.manager.idx++;
             }
-
-            nst_shctx_unlock(dict);
         }
 
         if(nst_time_now_ms() - start > 20) {
@@ -426,7 +438,7 @@ nst_purger_handler(hpx_appctx_t *appctx) {
 
     task_wakeup(s->task, TASK_WOKEN_OTHER);
 
-    if(appctx->ctx.nuster.manager.idx == dict->size) {
+    if(appctx->ctx.nuster.manager.idx == nst_dict_slots(dict)) {
         nst_http_reply(s, NST_HTTP_200);
     }
 }
@@ -15,6 +15,12 @@
 
 #include <nuster/nuster.h>
 
+static const char *_nst_stats_backing[] = {
+    [NST_SHMEM_BACKING_NORMAL]      = "normal",
+    [NST_SHMEM_BACKING_HUGETLB]     = "hugetlb",
+    [NST_SHMEM_BACKING_TRANSPARENT] = "transparent",
+};
+
 void
 nst_stats_update_cache(int state, uint64_t bytes) {
     nst_shctx_lock(global.nuster.stats);
@@ -43,6 +49,19 @@ nst_stats_update_cache(int state, uint64_t bytes) {
     nst_shctx_unlock(global.nuster.stats);
 }
 
+void
+nst_stats_update_admission(int admitted) {
+    nst_shctx_lock(global.nuster.stats);
+
+    if(admitted) {
+        global.nuster.stats->cache.admitted++;
+    } else {
+        global.nuster.stats->cache.rejected++;
+    }
+
+    nst_shctx_unlock(global.nuster.stats);
+}
+
 void
 nst_stats_update_nosql(hpx_http_meth_t meth) {
     nst_shctx_lock(global.nuster.stats);
@@ -66,6 +85,195 @@ nst_stats_update_nosql(hpx_http_meth_t meth) {
     nst_shctx_unlock(global.nuster.stats);
 }
 
+/*
+ * four buckets per power of 2: below 4us they are exact, then for us in
+ * [2^n, 2^(n+1)), bucket 4 * (n - 1) + i holds [(4 + i) << (n - 2), (5 + i) << (n - 2))
+ */
+static inline int
+_nst_stats_latency_idx(uint64_t us) {
+    int  n, idx;
+
+    if(us < 4) {
+        return us;
+    }
+
+    n   = 63 - __builtin_clzll(us);
+    idx = 4 * (n - 1) + ((us >> (n - 2)) & 3);
+
+    return idx < NST_STATS_LATENCY_BUCKETS ? idx : NST_STATS_LATENCY_BUCKETS - 1;
+}
+
+/* the highest latency of a bucket */
+static inline uint64_t
+_nst_stats_latency_max(int idx) {
+    int  n = idx / 4 + 1;
+
+    if(idx < 4) {
+        return idx;
+    }
+
+    return ((5ULL + idx % 4) << (n - 2)) - 1;
+}
+
+void
+nst_stats_update_latency(uint64_t *latency, uint64_t us) {
+    nst_shctx_lock(global.nuster.stats);
+
+    latency[_nst_stats_latency_idx(us)]++;
+
+    nst_shctx_unlock(global.nuster.stats);
+}
+
+/*
+ * append the number of reads and the p50 and p99 latencies in us
+ */
+static void
+_nst_stats_latency(hpx_buffer_t *buf, int len, const char *name, uint64_t *latency) {
+    uint64_t  total = 0, sum = 0, p50 = 0, p99 = 0;
+    char      key[64];
+    int       i;
+
+    for(i = 0; i < NST_STATS_LATENCY_BUCKETS; i++) {
+        total += latency[i];
+    }
+
+    for(i = 0; i < NST_STATS_LATENCY_BUCKETS && total; i++) {
+        sum += latency[i];
+
+        if(!p50 && sum * 100 >= total * 50) {
+            p50 = _nst_stats_latency_max(i);
+        }
+
+        if(sum * 100 >= total * 99) {
+            p99 = _nst_stats_latency_max(i);
+
+            break;
+        }
+    }
+
+    snprintf(key, sizeof(key), "%s.count:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, total);
+
+    snprintf(key, sizeof(key), "%s.p50_us:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, p50);
+
+    snprintf(key, sizeof(key), "%s.p99_us:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, p99);
+}
+
+/*
+ * append the segments in use, their size, dead bytes and the bytes reclaimed
+ */
+static void
+_nst_stats_disk_log(hpx_buffer_t *buf, int len, const char *name, nst_disk_t *disk) {
+    nst_disk_segment_t  *seg;
+    uint64_t             segments = 0, size = 0, invalid = 0;
+    char                 key[64];
+    int                  i;
+
+    if(!disk->log) {
+        return;
+    }
+
+    for(i = 0; i < NST_DISK_LOG_SEGMENTS; i++) {
+        seg = &disk->log->segment[i];
+
+        if(seg->state != NST_DISK_SEGMENT_FREE) {
+            segments++;
+            size    += seg->size;
+            invalid += seg->invalid;
+        }
+    }
+
+    snprintf(key, sizeof(key), "%s.segments:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, segments);
+
+    snprintf(key, sizeof(key), "%s.size:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, size);
+
+    snprintf(key, sizeof(key), "%s.invalid:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, invalid);
+
+    snprintf(key, sizeof(key), "%s.compacted:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, disk->log->compacted);
+}
+
+/*
+ * progress of the disk loading, the time and the rate are the current ones
+ * until it is loaded
+ */
+static void
+_nst_stats_disk_load(hpx_buffer_t *buf, int len, const char *name, nst_disk_t *disk) {
+    uint64_t  count = __atomic_load_n(&disk->load_count, __ATOMIC_RELAXED);
+    uint64_t  ms    = 0;
+    char      key[64];
+
+    if(disk->loaded) {
+        ms = disk->load_time;
+    } else if(disk->load_start) {
+        ms = nst_time_now_ms() - disk->load_start;
+    }
+
+    snprintf(key, sizeof(key), "%s.load_time:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, ms);
+
+    if(disk->engine == NST_DISK_ENGINE_FILE) {
+        snprintf(key, sizeof(key), "%s.load_dirs:", name);
+        chunk_appendf(buf, "%-*s%d/%d\n", len, key,
+                __atomic_load_n(&disk->load_dirs, __ATOMIC_RELAXED), 16 * 16);
+    }
+
+    snprintf(key, sizeof(key), "%s.load_objects:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, count);
+
+    snprintf(key, sizeof(key), "%s.load_rate:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, ms ? count * 1000 / ms : 0);
+}
+
+/*
+ * the durability of the writes and their number
+ */
+static void
+_nst_stats_disk_write(hpx_buffer_t *buf, int len, const char *name, nst_disk_t *disk) {
+    char  key[64];
+
+    snprintf(key, sizeof(key), "%s.sync:", name);
+
+    if(disk->sync == NST_DISK_SYNC_NONE) {
+        chunk_appendf(buf, "%-*s%s\n", len, key, "none");
+    } else if(disk->sync == NST_DISK_SYNC_ALWAYS) {
+        chunk_appendf(buf, "%-*s%s\n", len, key, "always");
+    } else {
+        chunk_appendf(buf, "%-*s%ds\n", len, key, disk->sync);
+    }
+
+    snprintf(key, sizeof(key), "%s.writes:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, disk->writes);
+
+    snprintf(key, sizeof(key), "%s.written:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, disk->written);
+}
+
+/*
+ * the disk-direct page cache of this worker
+ */
+static void
+_nst_stats_disk_direct(hpx_buffer_t *buf, int len, const char *name, nst_pcache_t *pcache) {
+    char  key[64];
+
+    snprintf(key, sizeof(key), "%s.direct_size:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, pcache->count * NST_PCACHE_BLOCK_SIZE);
+
+    snprintf(key, sizeof(key), "%s.direct_used:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, pcache->used * NST_PCACHE_BLOCK_SIZE);
+
+    snprintf(key, sizeof(key), "%s.direct_hits:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, pcache->hits);
+
+    snprintf(key, sizeof(key), "%s.direct_misses:", name);
+    chunk_appendf(buf, "%-*s%"PRIu64"\n", len, key, pcache->misses);
+}
+
 /*
  * return 1 if the req is done, otherwise 0
  */
@@ -218,16 +426,31 @@ _nst_stats_payload(hpx_appctx_t *appctx, hpx_stream_interface_t *si, hpx_htx_t *
                     global.nuster.cache.dict_size);
 
             chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.cache.length:",
-                    nuster.cache->dict.size);
+                    nuster.cache->dict.table[0].size);
 
             chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.cache.used:",
                     nuster.cache->dict.used);
 
+            chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.cache.locks:",
+                    nuster.cache->dict.locks);
+
             chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.cache.cleanup_idx:",
                     nuster.cache->dict.cleanup_idx);
 
             chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.cache.sync_idx:",
                     nuster.cache->dict.sync_idx);
+
+            chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.cache.sync_saved:",
+                    nuster.cache->dict.sync_saved);
+
+            chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.cache.sync_lock_us:",
+                    nuster.cache->dict.sync_lock_us);
+
+            chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.cache.rehash_length:",
+                    nuster.cache->dict.table[1].size);
+
+            chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.cache.rehash_idx:",
+                    nuster.cache->dict.rehash.idx);
         }
 
         if(global.nuster.nosql.status == NST_STATUS_ON) {
@@ -235,16 +458,31 @@ _nst_stats_payload(hpx_appctx_t *appctx, hpx_stream_interface_t *si, hpx_htx_t *
                     global.nuster.nosql.dict_size);
 
             chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.nosql.length:",
-                    nuster.nosql->dict.size);
+                    nuster.nosql->dict.table[0].size);
 
             chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.nosql.used:",
                     nuster.nosql->dict.used);
 
+            chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.nosql.locks:",
+                    nuster.nosql->dict.locks);
+
             chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.nosql.cleanup_idx:",
                     nuster.nosql->dict.cleanup_idx);
 
             chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.nosql.sync_idx:",
                     nuster.nosql->dict.sync_idx);
+
+            chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.nosql.sync_saved:",
+                    nuster.nosql->dict.sync_saved);
+
+            chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.nosql.sync_lock_us:",
+                    nuster.nosql->dict.sync_lock_us);
+
+            chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.nosql.rehash_length:",
+                    nuster.nosql->dict.table[1].size);
+
+            chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "dict.nosql.rehash_idx:",
+                    nuster.nosql->dict.rehash.idx);
         }
     }
 
@@ -265,8 +503,26 @@ _nst_stats_payload(hpx_appctx_t *appctx, hpx_stream_interface_t *si, hpx_htx_t *
         chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "store.memory.cache.used:",
                 global.nuster.cache.shmem->used);
 
+        chunk_appendf(&trash, "%-*s%s\n", len, "store.memory.cache.backing:",
+                _nst_stats_backing[global.nuster.cache.shmem->backing]);
+
+        chunk_appendf(&trash, "%-*s%s\n", len, "store.memory.cache.prefault:",
+                global.nuster.cache.shmem->prefault ? "yes" : "no");
+
+        if(global.nuster.cache.shmem->numa == NST_SHMEM_NUMA_OFF) {
+            chunk_appendf(&trash, "%-*s%s\n", len, "store.memory.cache.numa:", "off");
+        } else if(global.nuster.cache.shmem->numa == NST_SHMEM_NUMA_INTERLEAVE) {
+            chunk_appendf(&trash, "%-*s%s\n", len, "store.memory.cache.numa:", "interleave");
+        } else {
+            chunk_appendf(&trash, "%-*snode %d\n", len, "store.memory.cache.numa:",
+                    global.nuster.cache.shmem->numa);
+        }
+
         chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "store.memory.cache.count:",
                 nuster.cache->store.memory.count);
+
+        chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "store.memory.cache.evicted:",
+                nuster.cache->store.memory.evicted);
     }
 
     if(global.nuster.nosql.status == NST_STATUS_ON) {
@@ -293,6 +549,29 @@ _nst_stats_payload(hpx_appctx_t *appctx, hpx_stream_interface_t *si, hpx_htx_t *
 
         chunk_appendf(&trash, "%-*s%s\n", len, "store.disk.cache.loaded:",
                 nuster.cache->store.disk.loaded ? "yes" : "no");
+
+        _nst_stats_disk_load(&trash, len, "store.disk.cache", &nuster.cache->store.disk);
+
+        if(global.nuster.cache.disk_index) {
+            chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "store.disk.cache.indexed:",
+                    nuster.cache->store.disk.indexed);
+        }
+
+        chunk_appendf(&trash, "%-*s%s\n", len, "store.disk.cache.aio:",
+                nst_aio_engine(global.nuster.cache.disk_aio));
+
+        chunk_appendf(&trash, "%-*s%s\n", len, "store.disk.cache.engine:",
+                nst_disk_engine(global.nuster.cache.disk_engine));
+
+        _nst_stats_disk_write(&trash, len, "store.disk.cache", &nuster.cache->store.disk);
+
+        if(global.nuster.cache.disk_engine == NST_DISK_ENGINE_LOG) {
+            _nst_stats_disk_log(&trash, len, "store.disk.cache", &nuster.cache->store.disk);
+        }
+
+        if(nuster.cache->store.disk.pcache) {
+            _nst_stats_disk_direct(&trash, len, "store.disk.cache", nuster.cache->store.disk.pcache);
+        }
     }
 
     if(global.nuster.nosql.status == NST_STATUS_ON && global.nuster.nosql.root.len) {
@@ -301,6 +580,29 @@ _nst_stats_payload(hpx_appctx_t *appctx, hpx_stream_interface_t *si, hpx_htx_t *
 
         chunk_appendf(&trash, "%-*s%s\n", len, "store.disk.nosql.loaded:",
                 nuster.nosql->store.disk.loaded ? "yes" : "no");
+
+        _nst_stats_disk_load(&trash, len, "store.disk.nosql", &nuster.nosql->store.disk);
+
+        if(global.nuster.nosql.disk_index) {
+            chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "store.disk.nosql.indexed:",
+                    nuster.nosql->store.disk.indexed);
+        }
+
+        chunk_appendf(&trash, "%-*s%s\n", len, "store.disk.nosql.aio:",
+                nst_aio_engine(global.nuster.nosql.disk_aio));
+
+        chunk_appendf(&trash, "%-*s%s\n", len, "store.disk.nosql.engine:",
+                nst_disk_engine(global.nuster.nosql.disk_engine));
+
+        _nst_stats_disk_write(&trash, len, "store.disk.nosql", &nuster.nosql->store.disk);
+
+        if(global.nuster.nosql.disk_engine == NST_DISK_ENGINE_LOG) {
+            _nst_stats_disk_log(&trash, len, "store.disk.nosql", &nuster.nosql->store.disk);
+        }
+
+        if(nuster.nosql->store.disk.pcache) {
+            _nst_stats_disk_direct(&trash, len, "store.disk.nosql", nuster.nosql->store.disk.pcache);
+        }
     }
 
     if(global.nuster.cache.status == NST_STATUS_ON || global.nuster.nosql.status == NST_STATUS_ON) {
@@ -325,6 +627,24 @@ _nst_stats_payload(hpx_appctx_t *appctx, hpx_stream_interface_t *si, hpx_htx_t *
 
         chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "stats.cache.bytes:",
                 global.nuster.stats->cache.bytes);
+
+        chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "stats.cache.admitted:",
+                global.nuster.stats->cache.admitted);
+
+        chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "stats.cache.rejected:",
+                global.nuster.stats->cache.rejected);
+
+        chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "stats.cache.waited:",
+                nuster.cache->waiters->parked);
+
+        chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "stats.cache.woken:",
+                nuster.cache->waiters->woken);
+
+        _nst_stats_latency(&trash, len, "stats.cache.disk_read",
+                global.nuster.stats->cache.disk_latency);
+
+        _nst_stats_latency(&trash, len, "stats.cache.disk_commit",
+                global.nuster.stats->cache.disk_commit_latency);
     }
 
     if(global.nuster.nosql.status == NST_STATUS_ON) {
@@ -339,6 +659,12 @@ _nst_stats_payload(hpx_appctx_t *appctx, hpx_stream_interface_t *si, hpx_htx_t *
 
         chunk_appendf(&trash, "%-*s%"PRIu64"\n", len, "stats.nosql.delete:",
                 global.nuster.stats->nosql.delete);
+
+        _nst_stats_latency(&trash, len, "stats.nosql.disk_read",
+                global.nuster.stats->nosql.disk_latency);
+
+        _nst_stats_latency(&trash, len, "stats.nosql.disk_commit",
+                global.nuster.stats->nosql.disk_commit_latency);
     }
 
     if(!_nst_stats_putdata(res, htx, &trash)) {
@@ -353,6 +679,67 @@ full:
     return 0;
 }
 
+/*
+ * internal fragmentation per chunk class, one line per class as there can be
+ * many of them, appctx->st2 is the class of cache then nosql
+ */
+static int
+_nst_stats_chunk(hpx_appctx_t *appctx, hpx_stream_interface_t *si, hpx_htx_t *htx) {
+    hpx_channel_t  *res = si_ic(si);
+    nst_shmem_t    *shmem;
+    const char     *name;
+    char            key[64];
+    uint64_t        allocated, requested;
+    int             len = _getMaxPaddingLen();
+    int             idx;
+
+    if(global.nuster.cache.status != NST_STATUS_ON
+            && global.nuster.nosql.status != NST_STATUS_ON) {
+
+        return 1;
+    }
+
+    for(; appctx->st2 < 2 * NST_SHMEM_CLASSES; appctx->st2++) {
+        chunk_reset(&trash);
+
+        if(appctx->st2 == 0) {
+            chunk_appendf(&trash, "\n**STORE MEMORY CHUNK**\n");
+        }
+
+        if(appctx->st2 < NST_SHMEM_CLASSES) {
+            shmem = global.nuster.cache.status == NST_STATUS_ON ? global.nuster.cache.shmem : NULL;
+            name  = "cache";
+        } else {
+            shmem = global.nuster.nosql.status == NST_STATUS_ON ? global.nuster.nosql.shmem : NULL;
+            name  = "nosql";
+        }
+
+        idx = appctx->st2 % NST_SHMEM_CLASSES;
+
+        if(shmem && idx < shmem->chunks && shmem->stats[idx].allocs) {
+            allocated = shmem->stats[idx].allocs * shmem->class_size[idx];
+            requested = shmem->stats[idx].requested;
+
+            snprintf(key, sizeof(key), "store.memory.%s.chunk.%u:", name,
+                    shmem->class_size[idx]);
+
+            chunk_appendf(&trash, "%-*sallocs=%"PRIu64" requested=%"PRIu64" allocated=%"PRIu64
+                    " waste=%"PRIu64"%%\n", len, key, shmem->stats[idx].allocs, requested,
+                    allocated, (allocated - requested) * 100 / allocated);
+        }
+
+        if(trash.data && !_nst_stats_putdata(res, htx, &trash)) {
+            si_rx_room_blk(si);
+
+            return 0;
+        }
+    }
+
+    appctx->st2 = 0;
+
+    return 1;
+}
+
 static int
 _nst_stats_proxy(hpx_appctx_t *appctx, hpx_stream_interface_t *si, hpx_htx_t *htx) {
     hpx_channel_t  *res = si_ic(si);
@@ -459,6 +846,13 @@ nst_stats_handler(hpx_appctx_t *appctx) {
     if(appctx->st0 == NST_STATS_PAYLOAD) {
 
         if(_nst_stats_payload(appctx, si, res_htx)) {
+            appctx->st0 = NST_STATS_CHUNK;
+        }
+    }
+
+    if(appctx->st0 == NST_STATS_CHUNK) {
+
+        if(_nst_stats_chunk(appctx, si, res_htx)) {
             appctx->st0 = NST_STATS_PROXY;
         }
     }
@@ -21,12 +21,12 @@ nst_nosql_handler(hpx_appctx_t *appctx) {
     hpx_channel_t           *req  = si_oc(si);
     hpx_channel_t           *res  = si_ic(si);
     nst_memory_item_t       *item = NULL;
-    hpx_buffer_t            *buf;
     hpx_htx_t               *req_htx, *res_htx;
     hpx_htx_blk_type_t       type;
     hpx_htx_blk_t           *blk;
+    hpx_buffer_t            *head;
     char                    *p, *ptr;
-    uint64_t                 offset, payload_len;
+    uint64_t                 offset, payload_len, start;
     uint32_t                 blksz, sz, info;
     int                      ret, max, fd, header_len, total;
 
@@ -113,14 +113,21 @@ out:
                 header_len  = appctx->ctx.nuster.store.disk.header_len;
                 payload_len = appctx->ctx.nuster.store.disk.payload_len;
                 offset      = appctx->ctx.nuster.store.disk.offset;
+                start       = appctx->ctx.nuster.store.disk.start;
+                head        = appctx->ctx.nuster.store.disk.head;
                 fd          = appctx->ctx.nuster.store.disk.fd;
 
                 switch(appctx->st1) {
                     case NST_DISK_APPLET_HEADER:
-                        buf = get_trash_chunk();
-                        p   = buf->area;
+                        ret = nst_disk_head_read(head, start, &p, header_len, offset);
 
-                        ret = pread(fd, p, header_len, offset);
+                        if(ret != header_len) {
+                            ret = nst_disk_applet_read(appctx, &p, header_len, offset);
+                        }
+
+                        if(ret == NST_AIO_PENDING) {
+                            goto end;
+                        }
 
                         if(ret != header_len) {
                             appctx->st1 = NST_DISK_APPLET_ERROR;
@@ -162,18 +169,24 @@ out:
 
                         break;
                     case NST_DISK_APPLET_PAYLOAD:
-                        buf = get_trash_chunk();
-                        p   = buf->area;
                         max = htx_get_max_blksz(res_htx, channel_htx_recv_max(res, res_htx));
 
                         if(max <= 0) {
                             goto end;
                         }
 
-                        if(max < payload_len) {
-                            ret = pread(fd, p, max, offset);
-                        } else {
-                            ret = pread(fd, p, payload_len, offset);
+                        if(max > payload_len) {
+                            max = payload_len;
+                        }
+
+                        ret = nst_disk_head_read(head, start, &p, max, offset);
+
+                        if(!ret) {
+                            ret = nst_disk_applet_read(appctx, &p, max, offset);
+                        }
+
+                        if(ret == NST_AIO_PENDING) {
+                            goto end;
                         }
 
                         if(ret <= 0) {
@@ -294,28 +307,29 @@ end:
     return;
 }
 
+static void
+nst_nosql_release_handler(hpx_appctx_t *appctx) {
+    nst_aio_free(appctx->ctx.nuster.store.disk.aio);
+    free_trash_chunk(appctx->ctx.nuster.store.disk.head);
+}
+
 void
 nst_nosql_housekeeping() {
     nst_dict_t   *dict  = &nuster.nosql->dict;
     nst_store_t  *store = &nuster.nosql->store;
     uint64_t      start;
 
-#ifndef USE_THREAD
-    uint64_t      begin = nst_time_now_ms();
-#endif
-
     if(global.nuster.nosql.status == NST_STATUS_ON && master == 1) {
         int  dict_cleaner = global.nuster.nosql.dict_cleaner;
+        int  dict_rehash  = NST_DICT_REHASH_STEPS;
         int  data_cleaner = global.nuster.nosql.data_cleaner;
         int  disk_cleaner = global.nuster.nosql.disk_cleaner;
         int  disk_saver   = global.nuster.nosql.disk_saver;
+        int  disk_index   = global.nuster.nosql.disk_engine == NST_DISK_ENGINE_FILE
+                            ? global.nuster.nosql.disk_index : 0;
         int  ms           = 10;
         int  ratio        = 1;
 
-#ifndef USE_THREAD
-        int  disk_loader  = global.nuster.nosql.disk_loader;
-#endif
-
         start = nst_time_now_ms();
 
         while(dict_cleaner--) {
@@ -328,6 +342,16 @@ nst_nosql_housekeeping() {
 
         start = nst_time_now_ms();
 
+        while(dict_rehash--) {
+            nst_dict_rehash(dict);
+
+            if(nst_time_now_ms() - start >= ms) {
+                break;
+            }
+        }
+
+        start = nst_time_now_ms();
+
         if(data_cleaner > store->memory.count) {
             data_cleaner = store->memory.count;
         }
@@ -351,36 +375,28 @@ nst_nosql_housekeeping() {
             }
         }
 
-        start = nst_time_now_ms();
-        ms    = 10;
-
-        while(store->disk.loaded && disk_saver--) {
-            nst_store_memory_sync_disk(nuster.nosql);
+        /* the disk passes run on the io threads */
+        if(nuster.nosql->root.len) {
 
-            if(nst_time_now_ms() - start >= ms) {
-                break;
-            }
-        }
+            if(store->disk.loaded) {
+                nst_io_submit(&nuster.nosql->io, NST_IO_JOB_SAVER, disk_saver);
+                nst_io_submit(&nuster.nosql->io, NST_IO_JOB_CLEANER, disk_cleaner);
 
-        start = nst_time_now_ms();
-
-        while(store->disk.loaded && disk_cleaner--) {
-            nst_disk_cleanup(nuster.nosql);
+                if(disk_index && (store->disk.index.fd != -1
+                            || nst_time_now_ms() - store->disk.index.time >= disk_index * 1000ULL)) {
 
-            if(nst_time_now_ms() - start >= ms) {
-                break;
-            }
-        }
+                    nst_io_submit(&nuster.nosql->io, NST_IO_JOB_INDEX, 0);
+                }
 
-#ifndef USE_THREAD
-        while(!store->disk.loaded && disk_loader--) {
-            nst_disk_load(nuster.nosql);
+                if(store->disk.sync > 0
+                        && nst_time_now_ms() - store->disk.sync_time >= store->disk.sync * 1000ULL) {
 
-            if(nst_time_now_ms() - begin >= 500) {
-                break;
+                    nst_io_submit(&nuster.nosql->io, NST_IO_JOB_SYNC, 0);
+                }
+            } else {
+                nst_io_submit(&nuster.nosql->io, NST_IO_JOB_LOADER, 0);
             }
         }
-#endif
 
     }
 }
@@ -390,23 +406,22 @@ nst_nosql_init() {
     hpx_ist_t     root;
     nst_shmem_t  *shmem;
     uint64_t      dict_size, data_size, size;
-    int           clean_temp;
-
-#ifdef USE_THREAD
-    pthread_t     tid;
-#endif
+    int           clean_temp, dict_locks;
 
     root       = global.nuster.nosql.root;
     dict_size  = global.nuster.nosql.dict_size;
     data_size  = global.nuster.nosql.data_size;
     size       = dict_size + data_size;
     clean_temp = global.nuster.nosql.clean_temp;
+    dict_locks = global.nuster.nosql.dict_locks;
 
-    nuster.applet.nosql.fct = nst_nosql_handler;
+    nuster.applet.nosql.fct     = nst_nosql_handler;
+    nuster.applet.nosql.release = nst_nosql_release_handler;
 
     if(global.nuster.nosql.status == NST_STATUS_ON) {
 
-        shmem = nst_shmem_create("nosql.shm", size, global.tune.bufsize, NST_DEFAULT_CHUNK_SIZE);
+        shmem = nst_shmem_create("nosql.shm", size, global.tune.bufsize, NST_DEFAULT_CHUNK_SIZE,
+                0, NST_SHMEM_NUMA_OFF);
 
         if(!shmem) {
             ha_alert("Failed to create nuster nosql memory zone.\n");
@@ -432,19 +447,36 @@ nst_nosql_init() {
         nuster.nosql->shmem = shmem;
         nuster.nosql->root  = root;
 
-        if(nst_store_init(&nuster.nosql->store, root, shmem, clean_temp) != NST_OK) {
+        if(nst_store_init(&nuster.nosql->store, root, shmem, clean_temp,
+                    global.nuster.nosql.disk_engine) != NST_OK) {
             ha_alert("Failed to init nuster nosql store.\n");
             exit(1);
         }
 
-        if(nst_dict_init(&nuster.nosql->dict, &nuster.nosql->store, shmem, dict_size) != NST_OK) {
+        nuster.nosql->store.disk.loaders = global.nuster.nosql.loader_threads;
+        nuster.nosql->store.disk.sync    = global.nuster.nosql.disk_sync;
+
+        nuster.nosql->store.disk.commit_latency = global.nuster.stats->nosql.disk_commit_latency;
+
+        if(global.nuster.nosql.disk_direct && root.len) {
+            nuster.nosql->store.disk.pcache = nst_pcache_create(global.nuster.nosql.disk_direct);
+
+            if(!nuster.nosql->store.disk.pcache) {
+                ha_alert("Failed to init nuster nosql disk-direct page cache.\n");
+                exit(1);
+            }
+        }
+
+        if(nst_dict_init(&nuster.nosql->dict, &nuster.nosql->store, shmem, dict_size,
+                    dict_locks) != NST_OK) {
             ha_alert("Failed to init nuster nosql dict.\n");
             exit(1);
         }
 
-#ifdef USE_THREAD
-        pthread_create(&tid, NULL, nst_disk_load_thread, nuster.nosql);
-#endif
+        if(nst_io_init(&nuster.nosql->io, nuster.nosql, global.nuster.nosql.io_threads) != NST_OK) {
+            ha_alert("Failed to init nuster nosql io.\n");
+            exit(1);
+        }
 
     }
 }
@@ -482,6 +514,10 @@ nst_nosql_check_applet(hpx_stream_t *s, hpx_channel_t *req, hpx_proxy_t *px) {
             appctx->st1 = 0;
             appctx->st2 = 0;
 
+            appctx->ctx.nuster.store.disk.aio = NULL;
+            appctx->ctx.nuster.store.disk.head = NULL;
+            appctx->ctx.nuster.store.disk.pcache = NULL;
+
             req->analysers &= (AN_REQ_HTTP_BODY | AN_REQ_FLT_HTTP_HDRS | AN_REQ_FLT_END);
             req->analysers &= ~AN_REQ_FLT_XFER_DATA;
             req->analysers |= AN_REQ_HTTP_XFER_BODY;
@@ -695,7 +731,7 @@ nst_nosql_create(hpx_stream_t *s, hpx_http_msg_t *msg, nst_ctx_t *ctx) {
 
     ctx->state = NST_CTX_STATE_CREATE;
 
-    nst_shctx_lock(dict);
+    nst_dict_lock(dict, ctx->key->hash);
 
     entry = nst_dict_get(dict, ctx->key);
 
@@ -723,7 +759,7 @@ nst_nosql_create(hpx_stream_t *s, hpx_http_msg_t *msg, nst_ctx_t *ctx) {
         }
     }
 
-    nst_shctx_unlock(dict);
+    nst_dict_unlock(dict, ctx->key->hash);
 
     /* init store data */
 
@@ -826,7 +862,7 @@ nst_nosql_append(hpx_http_msg_t *msg, nst_ctx_t *ctx, unsigned int offset, unsig
                 int  ret;
 
                 ret = nst_memory_obj_append(mem, ctx->store.memory.obj,
-                        &ctx->store.memory.item, data.ptr, data.len, info);
+                        &ctx->store.memory.item, NULL, data.ptr, data.len, info);
 
                 if(ret == NST_ERR) {
                     ctx->store.memory.obj = NULL;
@@ -850,7 +886,7 @@ nst_nosql_append(hpx_http_msg_t *msg, nst_ctx_t *ctx, unsigned int offset, unsig
                 char                *ptr  = htx_get_blk_ptr(htx, blk);
                 int  ret;
 
-                ret = nst_memory_obj_append(mem, obj, item, ptr, sz, blk->info);
+                ret = nst_memory_obj_append(mem, obj, item, NULL, ptr, sz, blk->info);
 
                 if(ret == NST_ERR) {
                     ctx->store.memory.obj = NULL;
@@ -911,7 +947,7 @@ nst_nosql_finish(hpx_stream_t *s, hpx_http_msg_t *msg, nst_ctx_t *ctx) {
             nst_memory_item_t  **item = &ctx->store.memory.item;
             int                  ret;
 
-            ret = nst_memory_obj_append(mem, obj, item, "", size, info);
+            ret = nst_memory_obj_append(mem, obj, item, NULL, "", size, info);
 
             if(ret == NST_ERR) {
                 ctx->store.memory.obj = NULL;
@@ -921,7 +957,7 @@ nst_nosql_finish(hpx_stream_t *s, hpx_http_msg_t *msg, nst_ctx_t *ctx) {
 
     if(nst_store_memory_on(ctx->rule->prop.store) && ctx->store.memory.obj) {
 
-        nst_shctx_lock(dict);
+        nst_dict_lock(dict, entry->key.hash);
 
         if(entry && entry->state != NST_DICT_ENTRY_STATE_INVALID && entry->store.memory.obj) {
             entry->store.memory.obj->invalid = 1;
@@ -932,7 +968,7 @@ nst_nosql_finish(hpx_stream_t *s, hpx_http_msg_t *msg, nst_ctx_t *ctx) {
         entry->state = NST_DICT_ENTRY_STATE_VALID;
         entry->store.memory.obj = ctx->store.memory.obj;
 
-        nst_shctx_unlock(dict);
+        nst_dict_unlock(dict, entry->key.hash);
     }
 
     if(nst_store_disk_on(ctx->rule->prop.store) && ctx->store.disk.obj.file) {
@@ -947,9 +983,13 @@ nst_nosql_finish(hpx_stream_t *s, hpx_http_msg_t *msg, nst_ctx_t *ctx) {
         nst_disk_obj_t  *obj = &ctx->store.disk.obj;
 
         if(nst_disk_obj_finish(disk, obj, ctx->key, &ctx->txn, entry->expire) == NST_OK) {
+            nst_dict_lock(dict, entry->key.hash);
+
             entry->state = NST_DICT_ENTRY_STATE_VALID;
 
-            entry->store.disk.file = ctx->store.disk.obj.file;
+            nst_dict_entry_set_disk(dict, entry, obj);
+
+            nst_dict_unlock(dict, entry->key.hash);
         }
     }
 
@@ -978,7 +1018,7 @@ nst_nosql_exists(nst_ctx_t *ctx) {
     if(!nst_key_memory_checked(ctx->key)) {
         nst_key_memory_set_checked(ctx->key);
 
-        nst_shctx_lock(dict);
+        nst_dict_lock(dict, ctx->key->hash);
 
         entry = nst_dict_get(dict, ctx->key);
 
@@ -993,6 +1033,10 @@ nst_nosql_exists(nst_ctx_t *ctx) {
                     ret = NST_CTX_STATE_HIT_MEMORY;
                 } else if(entry->store.disk.file) {
                     ctx->store.disk.obj.file = entry->store.disk.file;
+                    ctx->store.disk.obj.base = entry->store.disk.base;
+                    ctx->store.disk.obj.size = entry->store.disk.size;
+                    ctx->store.disk.obj.id   = entry->store.disk.id;
+                    ctx->store.disk.obj.hits = nst_dict_entry_hits(entry);
                     ret = NST_CTX_STATE_HIT_DISK;
                 }
 
@@ -1010,7 +1054,7 @@ nst_nosql_exists(nst_ctx_t *ctx) {
             }
         }
 
-        nst_shctx_unlock(dict);
+        nst_dict_unlock(dict, ctx->key->hash);
     }
 
     if(ret == NST_CTX_STATE_INIT) {
@@ -1033,7 +1077,7 @@ nst_nosql_exists(nst_ctx_t *ctx) {
             nst_key_disk_set_checked(ctx->key);
 
             if(ctx->store.disk.obj.file) {
-                int  valid  = nst_disk_obj_valid(&ctx->store.disk.obj, ctx->key);
+                int  valid  = nst_disk_obj_valid(disk, &ctx->store.disk.obj, ctx->key);
                 int  expire = nst_disk_meta_check_expire(ctx->store.disk.obj.meta);
 
                 if(valid != NST_OK && expire != NST_OK) {
@@ -1125,7 +1169,7 @@ nst_nosql_delete(nst_key_t *key) {
     nst_dict_entry_t  *entry = NULL;
     int                ret   = 0;
 
-    nst_shctx_lock(dict);
+    nst_dict_lock(dict, key->hash);
 
     entry = nst_dict_get(dict, key);
 
@@ -1145,8 +1189,10 @@ nst_nosql_delete(nst_key_t *key) {
             }
 
             if(entry->store.disk.file) {
-                nst_disk_file_remove(entry->store.disk.file);
-                nst_shmem_free(nuster.nosql->shmem, entry->store.disk.file);
+                nst_disk_obj_remove(&nuster.nosql->store.disk, entry->store.disk.file,
+                        entry->store.disk.base, entry->store.disk.size);
+
+                nst_disk_file_free(&nuster.nosql->store.disk, entry->store.disk.file);
                 entry->store.disk.file = NULL;
             }
 
@@ -1157,9 +1203,11 @@ nst_nosql_delete(nst_key_t *key) {
         ret = 0;
     }
 
-    nst_shctx_unlock(dict);
+    nst_dict_unlock(dict, key->hash);
 
-    if(!nuster.nosql->store.disk.loaded && global.nuster.nosql.root.len){
+    /* the log engine has no other index than the dict */
+    if(!nuster.nosql->store.disk.loaded && global.nuster.nosql.root.len
+            && nuster.nosql->store.disk.engine == NST_DISK_ENGINE_FILE) {
         nst_disk_obj_t  disk;
         hpx_buffer_t    *buf = get_trash_chunk();
 
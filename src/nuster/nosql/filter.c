@@ -104,11 +104,11 @@ _nst_nosql_filter_detach(hpx_stream_t *s, hpx_filter_t *filter) {
         for(i = 0; i < ctx->key_cnt; i++) {
             ctx->key = &ctx->keys[i];
 
-            if(ctx->key->data) {
-                free(ctx->key->data);
-            }
+            nst_key_free(ctx->key);
         }
 
+        nst_disk_obj_head_free(&ctx->store.disk.obj);
+
         free_trash_chunk(ctx->buf);
 
         free(ctx);
@@ -175,8 +175,6 @@ _nst_nosql_filter_http_headers(hpx_stream_t *s, hpx_filter_t *filter, hpx_http_m
 
                     break;
                 }
-
-                nst_key_hash(ctx->key);
             }
 
             nst_key_debug(s, ctx->key);
@@ -273,9 +271,29 @@ _nst_nosql_filter_http_headers(hpx_stream_t *s, hpx_filter_t *filter, hpx_http_m
         appctx->st1 = NST_DISK_APPLET_HEADER;
 
         appctx->ctx.nuster.store.disk.fd          = ctx->store.disk.obj.fd;
-        appctx->ctx.nuster.store.disk.offset      = nst_disk_pos_header(&ctx->store.disk.obj);
+        appctx->ctx.nuster.store.disk.offset      = ctx->store.disk.obj.base
+            + nst_disk_pos_header(&ctx->store.disk.obj);
         appctx->ctx.nuster.store.disk.header_len  = nst_disk_meta_get_header_len(meta);
         appctx->ctx.nuster.store.disk.payload_len = nst_disk_meta_get_payload_len(meta);
+        appctx->ctx.nuster.store.disk.start       = ctx->store.disk.obj.base
+            + NST_DISK_META_SIZE;
+        appctx->ctx.nuster.store.disk.end         = ctx->store.disk.obj.end;
+
+        /* the applet owns the head from now on */
+        appctx->ctx.nuster.store.disk.head        = ctx->store.disk.obj.head;
+        ctx->store.disk.obj.head                  = NULL;
+
+        appctx->ctx.nuster.store.disk.pcache      = ctx->store.disk.obj.pcache;
+        appctx->ctx.nuster.store.disk.id          = ctx->store.disk.obj.id;
+        appctx->ctx.nuster.store.disk.hits        = ctx->store.disk.obj.hits;
+
+        /* the page cache reads are served from memory mostly */
+        if(global.nuster.nosql.disk_aio != NST_AIO_ENGINE_NONE
+                && !appctx->ctx.nuster.store.disk.pcache) {
+
+            appctx->ctx.nuster.store.disk.aio = nst_aio_new(appctx,
+                    global.nuster.nosql.disk_aio, global.nuster.stats->nosql.disk_latency);
+        }
 
         req->analysers &= ~AN_REQ_FLT_HTTP_HDRS;
         req->analysers &= ~AN_REQ_FLT_XFER_DATA;
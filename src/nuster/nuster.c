@@ -48,7 +48,7 @@ _nst_proxy_init() {
 
     /* new rule init */
     global.nuster.shmem = nst_shmem_create("nuster.shm", NST_DEFAULT_SIZE,
-            global.tune.bufsize, NST_DEFAULT_CHUNK_SIZE);
+            global.tune.bufsize, NST_DEFAULT_CHUNK_SIZE, 0, NST_SHMEM_NUMA_OFF);
 
     if(!global.nuster.shmem) {
         goto err;
@@ -188,6 +188,7 @@ _nst_proxy_init() {
                 rule->prop.wait          = rc->wait;
                 rule->prop.stale         = rc->stale;
                 rule->prop.inactive      = rc->inactive;
+                rule->prop.admission     = rc->admission;
 
                 rule->cond = rc->cond;
 
@@ -228,5 +229,7 @@ nuster_init() {
 
     nst_cache_init();
     nst_nosql_init();
+
+    nst_aio_init();
 }
 
@@ -504,6 +504,29 @@ nuster_parse_global_cache(const char *file, int line, char **args) {
             continue;
         }
 
+        if(!strcmp(args[cur_arg], "dict-locks")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] dict-locks expects a number.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            global.nuster.cache.dict_locks = atoi(args[cur_arg]);
+
+            if(global.nuster.cache.dict_locks <= 0) {
+                global.nuster.cache.dict_locks = NST_DEFAULT_DICT_LOCKS;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
         if(!strcmp(args[cur_arg], "dir")) {
             cur_arg++;
 
@@ -574,7 +597,377 @@ nuster_parse_global_cache(const char *file, int line, char **args) {
             cur_arg++;
 
             if(*args[cur_arg] == 0) {
-                ha_alert("parsing [%s:%d]: [%s] disk-cleaner expects a number.\n",
+                ha_alert("parsing [%s:%d]: [%s] disk-cleaner expects a number.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            global.nuster.cache.disk_cleaner = atoi(args[cur_arg]);
+
+            if(global.nuster.cache.disk_cleaner <= 0) {
+                global.nuster.cache.disk_cleaner = NST_DEFAULT_DISK_CLEANER;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "disk-loader")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] disk-loader expects a number.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            global.nuster.cache.disk_loader = atoi(args[cur_arg]);
+
+            if(global.nuster.cache.disk_loader <= 0) {
+                global.nuster.cache.disk_loader = NST_DEFAULT_DISK_LOADER;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "disk-saver")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] disk-saver expects a number.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            global.nuster.cache.disk_saver = atoi(args[cur_arg]);
+
+            if(global.nuster.cache.disk_saver <= 0) {
+                global.nuster.cache.disk_saver = NST_DEFAULT_DISK_SAVER;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "clean-temp")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] expects 'on' or 'off' as argument.\n", file, line,
+                        args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            if(!strcmp(args[cur_arg], "off")) {
+                global.nuster.cache.clean_temp = NST_STATUS_OFF;
+            } else if(!strcmp(args[cur_arg], "on")) {
+                global.nuster.cache.clean_temp = NST_STATUS_ON;
+            } else {
+                ha_alert("parsing [%s:%d]: [%s] only supports 'on' and 'off'.\n", file, line,
+                        args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "disk-aio")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] disk-aio expects 'on', 'off' or 'threads'.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            if(!strcmp(args[cur_arg], "off")) {
+                global.nuster.cache.disk_aio = NST_AIO_ENGINE_NONE;
+            } else if(!strcmp(args[cur_arg], "on")) {
+                global.nuster.cache.disk_aio = NST_AIO_ENGINE_URING;
+            } else if(!strcmp(args[cur_arg], "threads")) {
+                global.nuster.cache.disk_aio = NST_AIO_ENGINE_THREADS;
+            } else {
+                ha_alert("parsing [%s:%d]: [%s] disk-aio only supports 'on', 'off' and 'threads'.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "io-threads")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] io-threads expects a number.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            global.nuster.cache.io_threads = atoi(args[cur_arg]);
+
+            if(global.nuster.cache.io_threads <= 0) {
+                global.nuster.cache.io_threads = NST_DEFAULT_IO_THREADS;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "disk-engine")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] disk-engine expects 'file' or 'log'.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            if(!strcmp(args[cur_arg], "file")) {
+                global.nuster.cache.disk_engine = NST_DISK_ENGINE_FILE;
+            } else if(!strcmp(args[cur_arg], "log")) {
+                global.nuster.cache.disk_engine = NST_DISK_ENGINE_LOG;
+            } else {
+                ha_alert("parsing [%s:%d]: [%s] disk-engine only supports 'file' and 'log'.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "disk-index")) {
+            uint32_t  interval;
+            int       ret;
+
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] disk-index expects a time.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            ret = nst_parse_time(args[cur_arg], strlen(args[cur_arg]), &interval);
+
+            if(ret == NST_TIME_ERR) {
+                ha_alert("parsing [%s:%d]: [%s] invalid disk-index.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            } else if(ret == NST_TIME_OVER) {
+                interval = INT_MAX;
+            }
+
+            global.nuster.cache.disk_index = interval;
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "loader-threads")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] loader-threads expects a number.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            global.nuster.cache.loader_threads = atoi(args[cur_arg]);
+
+            if(global.nuster.cache.loader_threads <= 0) {
+                global.nuster.cache.loader_threads = NST_DEFAULT_LOADER_THREADS;
+            }
+
+            if(global.nuster.cache.loader_threads > NST_DISK_LOADERS_MAX) {
+                global.nuster.cache.loader_threads = NST_DISK_LOADERS_MAX;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "disk-direct")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] disk-direct expects a size.\n", file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            if(nst_parse_size(args[cur_arg], &global.nuster.cache.disk_direct)) {
+
+                ha_alert("parsing [%s:%d]: [%s] invalid disk-direct, expects [m|M|g|G].\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "disk-sync")) {
+            uint32_t  interval;
+            int       ret;
+
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] disk-sync expects none, always or a time.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            if(!strcmp(args[cur_arg], "none")) {
+                global.nuster.cache.disk_sync = NST_DISK_SYNC_NONE;
+            } else if(!strcmp(args[cur_arg], "always")) {
+                global.nuster.cache.disk_sync = NST_DISK_SYNC_ALWAYS;
+            } else {
+                ret = nst_parse_time(args[cur_arg], strlen(args[cur_arg]), &interval);
+
+                if(ret == NST_TIME_ERR) {
+                    ha_alert("parsing [%s:%d]: [%s] invalid disk-sync.\n",
+                            file, line, args[0]);
+
+                    err_code |= ERR_ALERT | ERR_FATAL;
+
+                    goto out;
+                } else if(ret == NST_TIME_OVER) {
+                    interval = INT_MAX;
+                }
+
+                global.nuster.cache.disk_sync = interval;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "evict")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] evict expects 'on' or 'off' as argument.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            if(!strcmp(args[cur_arg], "off")) {
+                global.nuster.cache.evict = NST_STATUS_OFF;
+            } else if(!strcmp(args[cur_arg], "on")) {
+                global.nuster.cache.evict = NST_STATUS_ON;
+            } else {
+                ha_alert("parsing [%s:%d]: [%s] evict only supports 'on' and 'off'.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "evict-high-water")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] evict-high-water expects a number.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            global.nuster.cache.evict_high_water = atoi(args[cur_arg]);
+
+            if(global.nuster.cache.evict_high_water <= 0) {
+                global.nuster.cache.evict_high_water = NST_DEFAULT_EVICT_HIGH_WATER;
+            }
+
+            if(global.nuster.cache.evict_high_water > 100) {
+                global.nuster.cache.evict_high_water = 100;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "hugepage")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] hugepage expects 'on' or 'off' as argument.\n",
                         file, line, args[0]);
 
                 err_code |= ERR_ALERT | ERR_FATAL;
@@ -582,10 +975,17 @@ nuster_parse_global_cache(const char *file, int line, char **args) {
                 goto out;
             }
 
-            global.nuster.cache.disk_cleaner = atoi(args[cur_arg]);
+            if(!strcmp(args[cur_arg], "off")) {
+                global.nuster.cache.hugepage = NST_STATUS_OFF;
+            } else if(!strcmp(args[cur_arg], "on")) {
+                global.nuster.cache.hugepage = NST_STATUS_ON;
+            } else {
+                ha_alert("parsing [%s:%d]: [%s] hugepage only supports 'on' and 'off'.\n",
+                        file, line, args[0]);
 
-            if(global.nuster.cache.disk_cleaner <= 0) {
-                global.nuster.cache.disk_cleaner = NST_DEFAULT_DISK_CLEANER;
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
             }
 
             cur_arg++;
@@ -593,11 +993,11 @@ nuster_parse_global_cache(const char *file, int line, char **args) {
             continue;
         }
 
-        if(!strcmp(args[cur_arg], "disk-loader")) {
+        if(!strcmp(args[cur_arg], "prefault")) {
             cur_arg++;
 
             if(*args[cur_arg] == 0) {
-                ha_alert("parsing [%s:%d]: [%s] disk-loader expects a number.\n",
+                ha_alert("parsing [%s:%d]: [%s] prefault expects 'on' or 'off' as argument.\n",
                         file, line, args[0]);
 
                 err_code |= ERR_ALERT | ERR_FATAL;
@@ -605,10 +1005,17 @@ nuster_parse_global_cache(const char *file, int line, char **args) {
                 goto out;
             }
 
-            global.nuster.cache.disk_loader = atoi(args[cur_arg]);
+            if(!strcmp(args[cur_arg], "off")) {
+                global.nuster.cache.prefault = NST_STATUS_OFF;
+            } else if(!strcmp(args[cur_arg], "on")) {
+                global.nuster.cache.prefault = NST_STATUS_ON;
+            } else {
+                ha_alert("parsing [%s:%d]: [%s] prefault only supports 'on' and 'off'.\n",
+                        file, line, args[0]);
 
-            if(global.nuster.cache.disk_loader <= 0) {
-                global.nuster.cache.disk_loader = NST_DEFAULT_DISK_LOADER;
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
             }
 
             cur_arg++;
@@ -616,11 +1023,13 @@ nuster_parse_global_cache(const char *file, int line, char **args) {
             continue;
         }
 
-        if(!strcmp(args[cur_arg], "disk-saver")) {
+        if(!strcmp(args[cur_arg], "numa")) {
+            char  *end;
+
             cur_arg++;
 
             if(*args[cur_arg] == 0) {
-                ha_alert("parsing [%s:%d]: [%s] disk-saver expects a number.\n",
+                ha_alert("parsing [%s:%d]: [%s] numa expects 'off', 'interleave' or a node.\n",
                         file, line, args[0]);
 
                 err_code |= ERR_ALERT | ERR_FATAL;
@@ -628,10 +1037,23 @@ nuster_parse_global_cache(const char *file, int line, char **args) {
                 goto out;
             }
 
-            global.nuster.cache.disk_saver = atoi(args[cur_arg]);
+            if(!strcmp(args[cur_arg], "off")) {
+                global.nuster.cache.numa = NST_SHMEM_NUMA_OFF;
+            } else if(!strcmp(args[cur_arg], "interleave")) {
+                global.nuster.cache.numa = NST_SHMEM_NUMA_INTERLEAVE;
+            } else {
+                global.nuster.cache.numa = strtol(args[cur_arg], &end, 10);
 
-            if(global.nuster.cache.disk_saver <= 0) {
-                global.nuster.cache.disk_saver = NST_DEFAULT_DISK_SAVER;
+                if(*end != 0 || global.nuster.cache.numa < 0
+                        || global.nuster.cache.numa >= NST_SHMEM_NUMA_NODES) {
+
+                    ha_alert("parsing [%s:%d]: [%s] numa expects 'off', 'interleave' or a node.\n",
+                            file, line, args[0]);
+
+                    err_code |= ERR_ALERT | ERR_FATAL;
+
+                    goto out;
+                }
             }
 
             cur_arg++;
@@ -639,29 +1061,22 @@ nuster_parse_global_cache(const char *file, int line, char **args) {
             continue;
         }
 
-        if(!strcmp(args[cur_arg], "clean-temp")) {
+        if(!strcmp(args[cur_arg], "pack-size")) {
             cur_arg++;
 
             if(*args[cur_arg] == 0) {
-                ha_alert("parsing [%s:%d]: [%s] expects 'on' or 'off' as argument.\n", file, line,
-                        args[0]);
+                ha_alert("parsing [%s:%d]: [%s] pack-size expects a number.\n",
+                        file, line, args[0]);
 
                 err_code |= ERR_ALERT | ERR_FATAL;
 
                 goto out;
             }
 
-            if(!strcmp(args[cur_arg], "off")) {
-                global.nuster.cache.clean_temp = NST_STATUS_OFF;
-            } else if(!strcmp(args[cur_arg], "on")) {
-                global.nuster.cache.clean_temp = NST_STATUS_ON;
-            } else {
-                ha_alert("parsing [%s:%d]: [%s] only supports 'on' and 'off'.\n", file, line,
-                        args[0]);
-
-                err_code |= ERR_ALERT | ERR_FATAL;
+            global.nuster.cache.pack_size = atoi(args[cur_arg]);
 
-                goto out;
+            if(global.nuster.cache.pack_size <= 0) {
+                global.nuster.cache.pack_size = 0;
             }
 
             cur_arg++;
@@ -743,6 +1158,29 @@ nuster_parse_global_nosql(const char *file, int line, char **args) {
             continue;
         }
 
+        if(!strcmp(args[cur_arg], "dict-locks")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] dict-locks expects a number.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            global.nuster.nosql.dict_locks = atoi(args[cur_arg]);
+
+            if(global.nuster.nosql.dict_locks <= 0) {
+                global.nuster.nosql.dict_locks = NST_DEFAULT_DICT_LOCKS;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
         if(!strcmp(args[cur_arg], "data-size")) {
             cur_arg++;
 
@@ -934,6 +1372,220 @@ nuster_parse_global_nosql(const char *file, int line, char **args) {
             continue;
         }
 
+        if(!strcmp(args[cur_arg], "disk-aio")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] disk-aio expects 'on', 'off' or 'threads'.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            if(!strcmp(args[cur_arg], "off")) {
+                global.nuster.nosql.disk_aio = NST_AIO_ENGINE_NONE;
+            } else if(!strcmp(args[cur_arg], "on")) {
+                global.nuster.nosql.disk_aio = NST_AIO_ENGINE_URING;
+            } else if(!strcmp(args[cur_arg], "threads")) {
+                global.nuster.nosql.disk_aio = NST_AIO_ENGINE_THREADS;
+            } else {
+                ha_alert("parsing [%s:%d]: [%s] disk-aio only supports 'on', 'off' and 'threads'.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "io-threads")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] io-threads expects a number.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            global.nuster.nosql.io_threads = atoi(args[cur_arg]);
+
+            if(global.nuster.nosql.io_threads <= 0) {
+                global.nuster.nosql.io_threads = NST_DEFAULT_IO_THREADS;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "disk-engine")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] disk-engine expects 'file' or 'log'.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            if(!strcmp(args[cur_arg], "file")) {
+                global.nuster.nosql.disk_engine = NST_DISK_ENGINE_FILE;
+            } else if(!strcmp(args[cur_arg], "log")) {
+                global.nuster.nosql.disk_engine = NST_DISK_ENGINE_LOG;
+            } else {
+                ha_alert("parsing [%s:%d]: [%s] disk-engine only supports 'file' and 'log'.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "disk-index")) {
+            uint32_t  interval;
+            int       ret;
+
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] disk-index expects a time.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            ret = nst_parse_time(args[cur_arg], strlen(args[cur_arg]), &interval);
+
+            if(ret == NST_TIME_ERR) {
+                ha_alert("parsing [%s:%d]: [%s] invalid disk-index.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            } else if(ret == NST_TIME_OVER) {
+                interval = INT_MAX;
+            }
+
+            global.nuster.nosql.disk_index = interval;
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "loader-threads")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] loader-threads expects a number.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            global.nuster.nosql.loader_threads = atoi(args[cur_arg]);
+
+            if(global.nuster.nosql.loader_threads <= 0) {
+                global.nuster.nosql.loader_threads = NST_DEFAULT_LOADER_THREADS;
+            }
+
+            if(global.nuster.nosql.loader_threads > NST_DISK_LOADERS_MAX) {
+                global.nuster.nosql.loader_threads = NST_DISK_LOADERS_MAX;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "disk-direct")) {
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] disk-direct expects a size.\n", file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            if(nst_parse_size(args[cur_arg], &global.nuster.nosql.disk_direct)) {
+
+                ha_alert("parsing [%s:%d]: [%s] invalid disk-direct, expects [m|M|g|G].\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
+        if(!strcmp(args[cur_arg], "disk-sync")) {
+            uint32_t  interval;
+            int       ret;
+
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                ha_alert("parsing [%s:%d]: [%s] disk-sync expects none, always or a time.\n",
+                        file, line, args[0]);
+
+                err_code |= ERR_ALERT | ERR_FATAL;
+
+                goto out;
+            }
+
+            if(!strcmp(args[cur_arg], "none")) {
+                global.nuster.nosql.disk_sync = NST_DISK_SYNC_NONE;
+            } else if(!strcmp(args[cur_arg], "always")) {
+                global.nuster.nosql.disk_sync = NST_DISK_SYNC_ALWAYS;
+            } else {
+                ret = nst_parse_time(args[cur_arg], strlen(args[cur_arg]), &interval);
+
+                if(ret == NST_TIME_ERR) {
+                    ha_alert("parsing [%s:%d]: [%s] invalid disk-sync.\n",
+                            file, line, args[0]);
+
+                    err_code |= ERR_ALERT | ERR_FATAL;
+
+                    goto out;
+                } else if(ret == NST_TIME_OVER) {
+                    interval = INT_MAX;
+                }
+
+                global.nuster.nosql.disk_sync = interval;
+            }
+
+            cur_arg++;
+
+            continue;
+        }
+
         ha_alert("parsing [%s:%d]: [%s] Unrecognized '%s'.\n", file, line, args[0], args[cur_arg]);
 
         err_code |= ERR_ALERT | ERR_FATAL;
@@ -1073,12 +1725,12 @@ nst_parse_proxy_rule(char **args, int section, hpx_proxy_t *proxy, hpx_proxy_t *
     char               *key  = NULL;
     char               *code = NULL;
 
-    int      memory, disk, ttl, etag, last_modified, wait, stale, inactive;
+    int      memory, disk, ttl, etag, last_modified, wait, stale, inactive, admission;
     uint8_t  extend[4] = { -1 };
     int      cur_arg   = 2;
     int      ret;
 
-    memory = disk = etag = last_modified = wait = stale = inactive = -1;
+    memory = disk = etag = last_modified = wait = stale = inactive = admission = -1;
     ttl = -2;
 
     if(proxy == defpx || !(proxy->cap & PR_CAP_BE)) {
@@ -1311,6 +1963,42 @@ nst_parse_proxy_rule(char **args, int section, hpx_proxy_t *proxy, hpx_proxy_t *
             continue;
         }
 
+        if(!strcmp(args[cur_arg], "admission")) {
+
+            if(admission != -1) {
+                memprintf(err, "[%s.%s]: admission already specified.", args[1], name);
+
+                goto out;
+            }
+
+            if(proxy->nuster.mode != NST_MODE_CACHE) {
+                memprintf(err, "[%s.%s]: admission is only supported by cache.", args[1], name);
+
+                goto out;
+            }
+
+            cur_arg++;
+
+            if(*args[cur_arg] == 0) {
+                memprintf(err, "[%s.%s]: admission expects [on|off], default off.", args[1], name);
+
+                goto out;
+            }
+
+            if(!strcmp(args[cur_arg], "on")) {
+                admission = NST_STATUS_ON;
+            } else if(!strcmp(args[cur_arg], "off")) {
+                admission = NST_STATUS_OFF;
+            } else {
+                memprintf(err, "[%s.%s]: admission expects [on|off], default off.", args[1], name);
+
+                goto out;
+            }
+
+            cur_arg++;
+            continue;
+        }
+
         if(!strcmp(args[cur_arg], "extend")) {
 
             if(extend[0] != 0xFF) {
@@ -1604,6 +2292,8 @@ nst_parse_proxy_rule(char **args, int section, hpx_proxy_t *proxy, hpx_proxy_t *
     rule->stale    = stale;
     rule->inactive = inactive == -1 ? 0 : inactive;
 
+    rule->admission = admission == -1 ? NST_STATUS_OFF : admission;
+
     rule->cond = cond;
 
     LIST_INIT(&rule->list);
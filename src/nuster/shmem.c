@@ -11,19 +11,113 @@
  */
 
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+#include <haproxy/global.h>
 #include <haproxy/tools.h>
 
 #include <nuster/shctx.h>
 #include <nuster/shmem.h>
 
+static nst_shmem_t  *nst_shmem_zone[NST_SHMEM_CACHE_ZONES];
+static int           nst_shmem_zones = 0;
+
+static THREAD_LOCAL nst_shmem_cache_t
+    nst_shmem_cache[NST_SHMEM_CACHE_ZONES][NST_SHMEM_CLASSES];
+
+/* set by the worker threads once forked, see _nst_shmem_cache_limit */
+static THREAD_LOCAL int  nst_shmem_cache_on;
+
+/*
+ * map size bytes, with huge pages if asked: MAP_HUGETLB first, then
+ * MADV_HUGEPAGE if no huge page is reserved. size may be rounded up.
+ */
+static uint8_t *
+_nst_shmem_map(uint64_t *size, int hugepage, int *backing) {
+    uint8_t   *p;
+
+    *backing = NST_SHMEM_BACKING_NORMAL;
+
+#ifdef MAP_HUGETLB
+    if(hugepage) {
+        uint64_t  huge = (*size + NST_SHMEM_HUGEPAGE_SIZE - 1) / NST_SHMEM_HUGEPAGE_SIZE
+            * NST_SHMEM_HUGEPAGE_SIZE;
+
+        p = mmap(NULL, huge, PROT_READ|PROT_WRITE, MAP_ANON|MAP_SHARED|MAP_HUGETLB, -1, 0);
+
+        if(p != MAP_FAILED) {
+            *size    = huge;
+            *backing = NST_SHMEM_BACKING_HUGETLB;
+
+            return p;
+        }
+    }
+#endif
+
+    p = mmap(NULL, *size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_SHARED, -1, 0);
+
+    if(p == MAP_FAILED) {
+        return NULL;
+    }
+
+#ifdef MADV_HUGEPAGE
+    if(hugepage && madvise(p, *size, MADV_HUGEPAGE) == 0) {
+        *backing = NST_SHMEM_BACKING_TRANSPARENT;
+    }
+#endif
+
+    return p;
+}
+
+/*
+ * bind to a node, or interleave across online nodes, before any page is
+ * touched. return the policy applied
+ */
+static int
+_nst_shmem_numa(uint8_t *p, uint64_t size, int numa) {
+#if defined(__linux__) && defined(SYS_mbind)
+    unsigned long  mask = 0;
+    char           path[64];
+    int            mode, i;
+
+    if(numa == NST_SHMEM_NUMA_OFF) {
+        return numa;
+    }
+
+    if(numa == NST_SHMEM_NUMA_INTERLEAVE) {
+        mode = 3;   /* MPOL_INTERLEAVE */
+
+        for(i = 0; i < NST_SHMEM_NUMA_NODES; i++) {
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", i);
+
+            if(access(path, F_OK) == 0) {
+                mask |= 1UL << i;
+            }
+        }
+    } else {
+        mode = 2;   /* MPOL_BIND */
+        mask = 1UL << numa;
+    }
+
+    if(mask && syscall(SYS_mbind, p, size, mode, &mask, NST_SHMEM_NUMA_NODES + 1, 0) == 0) {
+        return numa;
+    }
+#endif
+
+    return NST_SHMEM_NUMA_OFF;
+}
+
 nst_shmem_t *
-nst_shmem_create(char *name, uint64_t size, uint32_t block_size, uint32_t chunk_size) {
+nst_shmem_create(char *name, uint64_t size, uint32_t block_size, uint32_t chunk_size, int flags,
+        int numa) {
+
     uint8_t      *p;
     nst_shmem_t  *shmem;
-    uint64_t      n;
+    uint64_t      n, s, c, i;
     uint8_t      *begin, *end;
-    uint32_t      bitmap_size;
+    uint32_t      bitmap_size, summary_size;
+    int           backing;
 
     if(block_size < NST_SHMEM_BLOCK_MIN_SIZE) {
         block_size = NST_SHMEM_BLOCK_MIN_SIZE;
@@ -68,14 +162,23 @@ nst_shmem_create(char *name, uint64_t size, uint32_t block_size, uint32_t chunk_
     size = (size + block_size - 1) / block_size * block_size;
 
     /* create shared memory */
-    p = (uint8_t *) mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_SHARED, -1, 0);
+    p = _nst_shmem_map(&size, flags & NST_SHMEM_HUGEPAGE, &backing);
 
-    if(p == MAP_FAILED) {
+    if(p == NULL) {
         fprintf(stderr, "Out of memory when initialization.\n");
 
         return NULL;
     }
 
+    numa = _nst_shmem_numa(p, size, numa);
+
+    if(flags & NST_SHMEM_PREFAULT) {
+
+        for(n = 0; n < size; n += NST_SHMEM_BLOCK_MIN_SIZE) {
+            p[n] = 0;
+        }
+    }
+
     shmem = (nst_shmem_t *)p;
 
     /* init header */
@@ -89,6 +192,10 @@ nst_shmem_create(char *name, uint64_t size, uint32_t block_size, uint32_t chunk_
     shmem->chunk_size = chunk_size;
     shmem->size       = size;
     shmem->used       = 0;
+    shmem->zone       = -1;
+    shmem->backing    = backing;
+    shmem->numa       = numa;
+    shmem->prefault   = !!(flags & NST_SHMEM_PREFAULT);
 
     p += sizeof(nst_shmem_t);
 
@@ -100,8 +207,37 @@ nst_shmem_create(char *name, uint64_t size, uint32_t block_size, uint32_t chunk_
     for(n = NST_SHMEM_BLOCK_MIN_SHIFT; (1ULL << n) < block_size; n++) { }
 
     shmem->block_shift = n;
-    shmem->chunks      = n - shmem->chunk_shift + 1;
-    shmem->chunk       = (nst_shmem_ctrl_t **)p;
+    shmem->chunks      = 0;
+
+    /* chunk classes */
+    for(s = 1ULL << shmem->chunk_shift; s <= block_size; s <<= 1) {
+
+        for(i = 1; i < 4 && s > (1ULL << shmem->chunk_shift); i++) {
+            c = s / 2 + i * s / 8;
+
+            if(s / 8 % NST_SHMEM_CHUNK_MIN_SIZE == 0 && block_size / c > block_size / s) {
+                shmem->class_size[shmem->chunks++] = c;
+            }
+        }
+
+        shmem->class_size[shmem->chunks++] = s;
+    }
+
+    for(n = 1; n <= shmem->block_shift - shmem->chunk_shift; n++) {
+        s = 1ULL << (shmem->chunk_shift + n);
+
+        for(i = 0; i < 4; i++) {
+            c = s / 2 + (i + 1) * s / 8;
+
+            for(shmem->class_of[n][i] = 0;
+                    shmem->class_size[shmem->class_of[n][i]] < c;
+                    shmem->class_of[n][i]++) { }
+        }
+    }
+
+    memset(shmem->stats, 0, sizeof(shmem->stats));
+
+    shmem->chunk = (nst_shmem_ctrl_t **)p;
 
     p += shmem->chunks * sizeof(nst_shmem_ctrl_t *);
 
@@ -109,7 +245,10 @@ nst_shmem_create(char *name, uint64_t size, uint32_t block_size, uint32_t chunk_
     shmem->empty = NULL;
     shmem->full  = NULL;
 
-    bitmap_size = block_size / chunk_size / 8;
+    /* bitmap followed by its summary, in 64 bits words */
+    bitmap_size  = (block_size / chunk_size / 8 + 7) & ~7;
+    summary_size = (bitmap_size / 8 + 63) / 64 * 8;
+    bitmap_size += summary_size;
 
     /* set data begin */
     n = (shmem->stop - p) / (sizeof(nst_shmem_ctrl_t) + block_size + bitmap_size);
@@ -148,69 +287,75 @@ nst_shmem_create(char *name, uint64_t size, uint32_t block_size, uint32_t chunk_
 
     /* initialize block */
     for(n = 0; n < shmem->blocks; n++) {
-        shmem->block[n].info   = 0;
-        shmem->block[n].bitmap = shmem->bitmap + n * bitmap_size;
-        shmem->block[n].prev   = NULL;
-        shmem->block[n].next   = NULL;
+        shmem->block[n].info    = 0;
+        shmem->block[n].bitmap  = shmem->bitmap + n * bitmap_size;
+        shmem->block[n].summary = (uint64_t *)(shmem->block[n].bitmap
+                + bitmap_size - summary_size);
+        shmem->block[n].top     = 0;
+        shmem->block[n].count   = 0;
+        shmem->block[n].prev    = NULL;
+        shmem->block[n].next    = NULL;
+    }
+
+    if(nst_shmem_zones < NST_SHMEM_CACHE_ZONES) {
+        shmem->zone = nst_shmem_zones;
+
+        nst_shmem_zone[nst_shmem_zones++] = shmem;
     }
 
     return shmem;
 }
 
+/*
+ * mask of the n lowest bits
+ */
+static inline uint64_t
+_nst_shmem_mask(int n) {
+    return n >= 64 ? ~0ULL : (1ULL << n) - 1;
+}
+
 void *
 _nst_shmem_block_alloc(nst_shmem_t *shmem, nst_shmem_ctrl_t *block, int chunk_idx) {
 
-    int  chunk_size = 1<<(shmem->chunk_shift + chunk_idx);
+    int  chunk_size = shmem->class_size[chunk_idx];
     int  block_idx  = block - shmem->block;
     int  bits_need  = shmem->block_size / chunk_size;
     int  bits_idx   = 0;
-    int  i          = 0;
-    int  unset      = 1;
-    int  full       = 1;
+    int  full;
 
     shmem->used += chunk_size;
 
+    full = ++block->count == bits_need;
+
     /* use info, should not use anymore */
-    if(chunk_size * NST_SHMEM_INFO_BITMAP_BITS >= shmem->block_size) {
-        uint32_t  mask =  ~0U >> (NST_SHMEM_INFO_BITMAP_BITS - bits_need);
-        uint32_t  *v   = (uint32_t *)(&block->info) + 1;
-        uint32_t  t    = *v;
+    if(bits_need <= NST_SHMEM_INFO_BITMAP_BITS) {
+        uint32_t  *v = (uint32_t *)(&block->info) + 1;
+        uint32_t  t  = *v;
 
         /* get bits_idx */
         bits_idx = __builtin_ffs(~t) - 1;
         /* set rightmost 0 to 1 */
         *v  |= *v + 1;
-        full = (mask == *v);
     }
     /* use bitmap */
     else {
-        uint64_t  *begin;
+        uint64_t  *bitmap  = (uint64_t *)block->bitmap;
+        uint64_t  *summary = block->summary;
+        int        words   = (bits_need + 63) / 64;
+        int        s, w;
 
-        begin = (uint64_t *)block->bitmap;
-        i     = 0;
-        unset = 1;
+        /* first summary word, then bitmap word, with a free chunk */
+        s = __builtin_ffsll(~block->top) - 1;
+        w = s * 64 + __builtin_ffsll(~summary[s]) - 1;
 
-        for(i = 0; i < bits_need / 64; i++) {
-            uint64_t  *v = begin + i;
+        bits_idx    = w * 64 + __builtin_ffsll(~bitmap[w]) - 1;
+        bitmap[w]  |= bitmap[w] + 1;
 
-            if(*v == ~0ULL && unset) {
-                bits_idx += 64;
+        if(bitmap[w] == ~0ULL) {
+            summary[s] |= 1ULL << (w % 64);
 
-                continue;
-            }
-
-            if(unset) {
-                uint64_t  t = *v;
-
-                bits_idx += __builtin_ffsll(~t) - 1;
-                *v       |= *v + 1;
-                unset     = 0;
-            }
-
-            if(*v != ~0ULL) {
-                full = 0;
-
-                break;
+            if(summary[s] == _nst_shmem_mask(words - s * 64)) {
+                block->top |= 1ULL << s;
             }
         }
     }
@@ -245,13 +390,26 @@ void
 _nst_shmem_block_init(nst_shmem_t * shmem, nst_shmem_ctrl_t *block, int chunk_idx) {
     nst_shmem_ctrl_t  *chunk;
 
-    chunk       = shmem->chunk[chunk_idx];
-    block->info = 0;
+    int                bits  = shmem->block_size / shmem->class_size[chunk_idx];
+    int                words = (bits + 63) / 64;
+
+    chunk        = shmem->chunk[chunk_idx];
+    block->info  = 0;
+    block->top   = 0;
+    block->count = 0;
 
     _nst_shmem_block_set_type(block, chunk_idx);
     _nst_shmem_block_set_inited(block);
 
-    memset(block->bitmap, 0, shmem->block_size / shmem->chunk_size / 8);
+    if(bits > NST_SHMEM_INFO_BITMAP_BITS) {
+        memset(block->bitmap, 0, words * 8);
+        memset(block->summary, 0, (words + 63) / 64 * 8);
+
+        /* chunks beyond the block */
+        if(bits % 64) {
+            *((uint64_t *)block->bitmap + words - 1) = ~_nst_shmem_mask(bits % 64);
+        }
+    }
 
     block->prev = NULL;
     block->next = NULL;
@@ -265,16 +423,91 @@ _nst_shmem_block_init(nst_shmem_t * shmem, nst_shmem_ctrl_t *block, int chunk_id
     shmem->chunk[chunk_idx] = block;
 }
 
+static inline int
+_nst_shmem_chunk_idx(nst_shmem_t *shmem, int size) {
+    int  shift;
+
+    if(size <= 1 << shmem->chunk_shift) {
+        return 0;
+    }
+
+    /* size is in (2**(shift-1), 2**shift] */
+    shift = 32 - __builtin_clz(size - 1);
+
+    return shmem->class_of[shift - shmem->chunk_shift][((size - 1) >> (shift - 3)) & 3];
+}
+
+/*
+ * max number of chunks kept in the per-thread cache of chunk_idx, 0: no cache
+ * Only the worker threads cache chunks. Before the fork, the chunks cached
+ * would be copied to every process and lost, and the allocations made at init
+ * would not follow each other. The master only frees (cleaners, eviction,
+ * saver) or only allocates (loader) in its threads, so its chunks would be
+ * stranded in caches the workers cannot reach.
+ */
+static inline int
+_nst_shmem_cache_limit(nst_shmem_t *shmem, int chunk_idx) {
+    int  limit;
+
+    if(shmem->zone < 0 || !nst_shmem_cache_on) {
+        return 0;
+    }
+
+    limit = NST_SHMEM_CACHE_BYTES / shmem->class_size[chunk_idx];
+
+    return limit > NST_SHMEM_CACHE_CHUNKS ? NST_SHMEM_CACHE_CHUNKS : limit;
+}
+
+static inline nst_shmem_cache_t *
+_nst_shmem_cache_get(nst_shmem_t *shmem, int chunk_idx) {
+    return &nst_shmem_cache[shmem->zone][chunk_idx];
+}
+
+/*
+ * add the allocations counted by a per-thread cache to the zone, shmem locked
+ */
+static inline void
+_nst_shmem_cache_stats(nst_shmem_t *shmem, nst_shmem_cache_t *cache, int chunk_idx) {
+    shmem->stats[chunk_idx].allocs    += cache->allocs;
+    shmem->stats[chunk_idx].requested += cache->requested;
+
+    cache->allocs    = 0;
+    cache->requested = 0;
+}
+
+/*
+ * give back the oldest n chunks of a per-thread cache, shmem locked
+ */
+static void
+_nst_shmem_cache_flush(nst_shmem_t *shmem, int chunk_idx, int n) {
+    nst_shmem_cache_t  *cache = &nst_shmem_cache[shmem->zone][chunk_idx];
+    int                 i;
+
+    _nst_shmem_cache_stats(shmem, cache, chunk_idx);
+
+    if(n > cache->count) {
+        n = cache->count;
+    }
+
+    for(i = 0; i < n; i++) {
+        nst_shmem_free_locked(shmem, cache->chunk[i]);
+    }
+
+    cache->count -= n;
+
+    memmove(cache->chunk, cache->chunk + n, cache->count * sizeof(void *));
+}
+
 void *
 nst_shmem_alloc_locked(nst_shmem_t *shmem, int size) {
     nst_shmem_ctrl_t  *chunk, *block;
-    int                 i, chunk_idx = 0;
+    int                 chunk_idx;
 
     if(!size || size > shmem->block_size) {
         return NULL;
     }
 
-    for(i = (size - 1) >> (shmem->chunk_shift - 1); i >>= 1; chunk_idx++) {}
+    chunk_idx = _nst_shmem_chunk_idx(shmem, size);
 
     chunk = shmem->chunk[chunk_idx];
 
@@ -314,12 +547,112 @@ nst_shmem_alloc_locked(nst_shmem_t *shmem, int size) {
     return _nst_shmem_block_alloc(shmem, block, chunk_idx);
 }
 
+/*
+ * Takes consecutive blocks never used for size bytes, for a structure larger
+ * than a block which lives as long as the zone, it cannot be freed.
+ */
+void *
+nst_shmem_alloc_blocks(nst_shmem_t *shmem, uint64_t size) {
+    uint64_t   n = (size + shmem->block_size - 1) / shmem->block_size;
+    uint8_t   *p = NULL;
+    uint64_t   block_idx, i;
+
+    if(!size) {
+        return NULL;
+    }
+
+    nst_shctx_lock(shmem);
+
+    if(shmem->data.free + n * shmem->block_size <= shmem->data.end + shmem->block_size) {
+        p         = shmem->data.free;
+        block_idx = (p - shmem->data.begin) / shmem->block_size;
+
+        for(i = 0; i < n; i++) {
+            shmem->block[block_idx + i].info = 0;
+
+            _nst_shmem_block_set_inited(&shmem->block[block_idx + i]);
+        }
+
+        shmem->data.free += n * shmem->block_size;
+        shmem->used      += n * shmem->block_size;
+    }
+
+    nst_shctx_unlock(shmem);
+
+    return p;
+}
+
+/*
+ * Chunks are taken from the per-thread cache of the chunk class without any
+ * lock, the cache is refilled by half at once when empty.
+ */
 void *
 nst_shmem_alloc(nst_shmem_t *shmem, int size) {
-    void  *p;
+    nst_shmem_cache_t  *cache;
+    void               *p;
+    int                 chunk_idx, limit, i;
+
+    if(!size || size > shmem->block_size) {
+        return NULL;
+    }
+
+    chunk_idx = _nst_shmem_chunk_idx(shmem, size);
+    limit     = _nst_shmem_cache_limit(shmem, chunk_idx);
+
+    if(!limit) {
+        nst_shctx_lock(shmem);
+        p = nst_shmem_alloc_locked(shmem, size);
+
+        if(p) {
+            shmem->stats[chunk_idx].allocs++;
+            shmem->stats[chunk_idx].requested += size;
+        }
+
+        nst_shctx_unlock(shmem);
+
+        return p;
+    }
+
+    cache = _nst_shmem_cache_get(shmem, chunk_idx);
+
+    if(cache->count) {
+        cache->allocs++;
+        cache->requested += size;
+
+        return cache->chunk[--cache->count];
+    }
 
     nst_shctx_lock(shmem);
-    p = nst_shmem_alloc_locked(shmem, size);
+
+    _nst_shmem_cache_stats(shmem, cache, chunk_idx);
+
+    while(cache->count < (limit + 1) / 2) {
+        p = nst_shmem_alloc_locked(shmem, size);
+
+        if(!p) {
+            break;
+        }
+
+        cache->chunk[cache->count++] = p;
+    }
+
+    /* out of memory, give back what this thread holds and retry */
+    if(!cache->count) {
+
+        for(i = 0; i < shmem->chunks; i++) {
+            _nst_shmem_cache_flush(shmem, i, NST_SHMEM_CACHE_CHUNKS);
+        }
+
+        p = nst_shmem_alloc_locked(shmem, size);
+    } else {
+        p = cache->chunk[--cache->count];
+    }
+
+    if(p) {
+        shmem->stats[chunk_idx].allocs++;
+        shmem->stats[chunk_idx].requested += size;
+    }
+
     nst_shctx_unlock(shmem);
 
     return p;
@@ -329,7 +662,7 @@ void
 nst_shmem_free_locked(nst_shmem_t *shmem, void *p) {
     nst_shmem_ctrl_t  *chunk, *block;
     uint8_t             chunk_idx;
-    int                 block_idx, chunk_size, bits, bits_idx, empty, full;
+    int                 block_idx, chunk_size, bits_idx, empty, full;
 
     if((uint8_t *)p < shmem->data.begin || (uint8_t *)p >= shmem->data.free) {
         return;
@@ -339,45 +672,30 @@ nst_shmem_free_locked(nst_shmem_t *shmem, void *p) {
     block      = &shmem->block[block_idx];
     chunk_idx  = block->info & 0xFF;
     chunk      = shmem->chunk[chunk_idx];
-    chunk_size = 1<<(shmem->chunk_shift + chunk_idx);
-    bits       = shmem->block_size / chunk_size;
+    chunk_size = shmem->class_size[chunk_idx];
 
     bits_idx = ((uint8_t *)p - (shmem->data.begin + 1ULL * block_idx * shmem->block_size))
         / chunk_size;
 
     shmem->used -= chunk_size;
 
-    empty = 0;
+    empty = --block->count == 0;
     full  = _nst_shmem_block_is_full(block);
 
     _nst_shmem_block_clear_full(block);
 
     /* info used */
-    if(chunk_size * NST_SHMEM_INFO_BITMAP_BITS >= shmem->block_size) {
+    if(shmem->block_size / chunk_size <= NST_SHMEM_INFO_BITMAP_BITS) {
         block->info &= ~(1ULL << (bits_idx + 32));
-
-        if(!(block->info & 0xFFFFFFFF00000000ULL)) {
-            empty = 1;
-        }
     }
     /* bitmap used */
     else {
-        int  i;
-
-        *((uint64_t *)block->bitmap + bits_idx / 64 ) &= ~(1ULL<<(bits_idx % 64));
+        int  w = bits_idx / 64;
 
-        for(i = 0; i < bits / 64; i++) {
-
-            if(*((uint64_t *)block->bitmap + i) == 0) {
-                empty += 64;
-            }
-        }
+        *((uint64_t *)block->bitmap + w) &= ~(1ULL << (bits_idx % 64));
 
-        if(empty == bits) {
-            empty = 1;
-        } else {
-            empty = 0;
-        }
+        block->summary[w / 64] &= ~(1ULL << (w % 64));
+        block->top             &= ~(1ULL << (w / 64));
     }
 
     /*
@@ -467,15 +785,82 @@ nst_shmem_free_locked(nst_shmem_t *shmem, void *p) {
     }
 }
 
+/*
+ * Chunks are put back to the per-thread cache of the chunk class without any
+ * lock, half of the cache is flushed at once when full.
+ */
 void
 nst_shmem_free(nst_shmem_t *shmem, void *p) {
+    nst_shmem_cache_t  *cache;
+    int                 block_idx, chunk_idx, limit;
 
     if(p == NULL) {
         return;
     }
 
-    nst_shctx_lock(shmem);
-    nst_shmem_free_locked(shmem, p);
-    nst_shctx_unlock(shmem);
+    if((uint8_t *)p < shmem->data.begin || (uint8_t *)p >= shmem->data.free) {
+        return;
+    }
+
+    /* the block of an allocated chunk cannot change its chunk class */
+    block_idx = ((uint8_t *)p - shmem->data.begin) / shmem->block_size;
+    chunk_idx = shmem->block[block_idx].info & 0xFF;
+    limit     = _nst_shmem_cache_limit(shmem, chunk_idx);
+
+    if(!limit) {
+        nst_shctx_lock(shmem);
+        nst_shmem_free_locked(shmem, p);
+        nst_shctx_unlock(shmem);
+
+        return;
+    }
+
+    cache = _nst_shmem_cache_get(shmem, chunk_idx);
+
+    if(cache->count >= limit) {
+        nst_shctx_lock(shmem);
+        _nst_shmem_cache_flush(shmem, chunk_idx, (limit + 1) / 2);
+        nst_shctx_unlock(shmem);
+    }
+
+    cache->chunk[cache->count++] = p;
 }
 
+/*
+ * the worker threads cache chunks, not the master nor the threads it starts
+ */
+static int
+nst_shmem_init_per_thread() {
+    nst_shmem_cache_on = !master;
+
+    return 1;
+}
+
+/*
+ * give back the per-thread caches when a thread stops
+ */
+static void
+nst_shmem_deinit_per_thread() {
+    nst_shmem_t  *shmem;
+    int           i, j;
+
+    if(!nst_shmem_cache_on) {
+        return;
+    }
+
+    for(i = 0; i < nst_shmem_zones; i++) {
+        shmem = nst_shmem_zone[i];
+
+        nst_shctx_lock(shmem);
+
+        for(j = 0; j < shmem->chunks; j++) {
+            _nst_shmem_cache_flush(shmem, j, NST_SHMEM_CACHE_CHUNKS);
+        }
+
+        nst_shctx_unlock(shmem);
+    }
+}
+
+REGISTER_PER_THREAD_INIT(nst_shmem_init_per_thread);
+REGISTER_PER_THREAD_DEINIT(nst_shmem_deinit_per_thread);
+
@@ -0,0 +1,116 @@
+/*
+ * nuster sketch functions.
+ *
+ * Copyright (C) Jiang Wenyuan, < koubunen AT gmail DOT com >
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <nuster/nuster.h>
+
+/*
+ * counter of row i: h1 + i * h2, h2 is odd so rows never collide together
+ */
+static inline uint64_t
+_nst_sketch_idx(nst_sketch_t *sketch, uint64_t hash, int i) {
+    uint64_t  h1 = hash & 0xFFFFFFFF;
+    uint64_t  h2 = (hash >> 32) | 1;
+
+    return (h1 + i * h2) & (sketch->width - 1);
+}
+
+/*
+ * halve all counters so that old popularity fades out
+ */
+static void
+_nst_sketch_age(nst_sketch_t *sketch) {
+    uint64_t  idx;
+    int       i;
+
+    if(nst_shctx_trylock(sketch)) {
+        return;
+    }
+
+    if(sketch->additions >= sketch->sample) {
+
+        for(i = 0; i < NST_SKETCH_DEPTH; i++) {
+
+            for(idx = 0; idx < sketch->width; idx++) {
+                sketch->row[i][idx] >>= 1;
+            }
+        }
+
+        sketch->additions >>= 1;
+    }
+
+    nst_shctx_unlock(sketch);
+}
+
+/*
+ * width is rounded down to a power of 2, a row spans consecutive blocks
+ */
+int
+nst_sketch_init(nst_sketch_t *sketch, nst_shmem_t *shmem, uint64_t width) {
+    int  i;
+
+    while(width & (width - 1)) {
+        width &= width - 1;
+    }
+
+    if(!width) {
+        return NST_ERR;
+    }
+
+    for(i = 0; i < NST_SKETCH_DEPTH; i++) {
+        sketch->row[i] = nst_shmem_alloc_blocks(shmem, width);
+
+        if(!sketch->row[i]) {
+            return NST_ERR;
+        }
+
+        memset(sketch->row[i], 0, width);
+    }
+
+    sketch->width     = width;
+    sketch->additions = 0;
+    sketch->sample    = width * NST_SKETCH_SAMPLE_FACTOR;
+
+    return nst_shctx_init(sketch);
+}
+
+void
+nst_sketch_add(nst_sketch_t *sketch, uint64_t hash) {
+    uint8_t  *counter;
+    int       i;
+
+    for(i = 0; i < NST_SKETCH_DEPTH; i++) {
+        counter = &sketch->row[i][_nst_sketch_idx(sketch, hash, i)];
+
+        if(*counter < NST_SKETCH_COUNTER_MAX) {
+            (*counter)++;
+        }
+    }
+
+    if(__sync_add_and_fetch(&sketch->additions, 1) >= sketch->sample) {
+        _nst_sketch_age(sketch);
+    }
+}
+
+int
+nst_sketch_estimate(nst_sketch_t *sketch, uint64_t hash) {
+    int  i, freq, min = NST_SKETCH_COUNTER_MAX;
+
+    for(i = 0; i < NST_SKETCH_DEPTH; i++) {
+        freq = sketch->row[i][_nst_sketch_idx(sketch, hash, i)];
+
+        if(freq < min) {
+            min = freq;
+        }
+    }
+
+    return min;
+}
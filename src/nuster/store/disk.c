@@ -10,11 +10,30 @@
  *
  */
 
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
 #include <haproxy/tools.h>
 #include <haproxy/global.h>
 
 #include <nuster/nuster.h>
 
+/* an object read by a loader, not added to the dict yet */
+typedef struct nst_disk_item {
+    nst_key_t           key;
+    hpx_buffer_t        buf;
+    nst_http_txn_t      txn;
+    nst_rule_prop_t     prop;
+    char               *file;
+    uint64_t            base;
+    uint64_t            size;
+    uint64_t            id;
+    uint64_t            expire;
+    uint64_t            stripe;
+} nst_disk_item_t;
+
 int
 nst_disk_mkdir(char *path) {
     char  *p = path;
@@ -63,7 +82,7 @@ int
 nst_disk_read_meta(nst_disk_obj_t *obj) {
     int  ret;
 
-    ret = pread(obj->fd, obj->meta, NST_DISK_META_SIZE, 0);
+    ret = pread(obj->fd, obj->meta, NST_DISK_META_SIZE, obj->base);
 
     if(ret != NST_DISK_META_SIZE) {
         return NST_ERR;
@@ -92,7 +111,7 @@ nst_disk_read_key(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key) {
         return NST_ERR;
     }
 
-    ret = pread(obj->fd, key->data, key->size, NST_DISK_POS_KEY);
+    ret = pread(obj->fd, key->data, key->size, obj->base + NST_DISK_POS_KEY);
 
     if(ret != key->size) {
         nst_shmem_free(disk->shmem, key->data);
@@ -102,103 +121,92 @@ nst_disk_read_key(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key) {
 
     memcpy(key->uuid, obj->meta + NST_DISK_META_POS_UUID, 20);
 
+    key->flags = NST_KEY_UUID;
+
     key->hash = nst_disk_meta_get_hash(obj->meta);
 
     return NST_OK;
 }
 
-int
-nst_disk_read_proxy(nst_disk_obj_t *obj, hpx_ist_t proxy) {
-    int  ret, offset;
+/*
+ * reads len bytes at pos of the object, from its head if it has them
+ */
+static int
+_nst_disk_read(nst_disk_obj_t *obj, char *buf, int len, int pos) {
+    int  ret;
 
-    offset = nst_disk_pos_proxy(obj);
+    if(obj->head && pos >= NST_DISK_META_SIZE
+            && pos + len <= NST_DISK_META_SIZE + obj->head->data) {
 
-    ret = pread(obj->fd, proxy.ptr, proxy.len, offset);
+        memcpy(buf, obj->head->area + pos - NST_DISK_META_SIZE, len);
 
-    if(ret != proxy.len) {
-        return NST_ERR;
+        return NST_OK;
     }
 
-    return NST_OK;
-}
-
-int
-nst_disk_read_rule(nst_disk_obj_t *obj, hpx_ist_t rule) {
-    int  ret, offset;
-
-    offset = nst_disk_pos_rule(obj);
-
-    ret = pread(obj->fd, rule.ptr, rule.len, offset);
+    if(obj->pcache) {
+        ret = nst_pcache_read(obj->pcache, obj->fd, obj->id, obj->hits, buf, len, obj->base + pos);
+    } else {
+        ret = pread(obj->fd, buf, len, obj->base + pos);
+    }
 
-    if(ret != rule.len) {
+    if(ret != len) {
         return NST_ERR;
     }
 
     return NST_OK;
 }
 
-int
-nst_disk_read_host(nst_disk_obj_t *obj, hpx_ist_t host) {
-    int  ret, offset;
-
-    offset = nst_disk_pos_host(obj);
-
-    ret = pread(obj->fd, host.ptr, host.len, offset);
+/*
+ * disk-direct, the page cache of the worker replaces the kernel's, falls back
+ * to a buffered open on filesystems without O_DIRECT
+ */
+static int
+_nst_disk_file_open_direct(const char *pathname) {
+    int  fd = open(pathname, O_RDONLY | O_DIRECT);
 
-    if(ret != host.len) {
-        return NST_ERR;
+    if(fd == -1 && errno == EINVAL) {
+        fd = open(pathname, O_RDONLY);
     }
 
-    return NST_OK;
+    return fd;
 }
 
 int
-nst_disk_read_path(nst_disk_obj_t *obj, hpx_ist_t path) {
-    int  ret, offset;
-
-    offset = nst_disk_pos_path(obj);
+nst_disk_read_proxy(nst_disk_obj_t *obj, hpx_ist_t proxy) {
+    return _nst_disk_read(obj, proxy.ptr, proxy.len, nst_disk_pos_proxy(obj));
+}
 
-    ret = pread(obj->fd, path.ptr, path.len, offset);
+int
+nst_disk_read_rule(nst_disk_obj_t *obj, hpx_ist_t rule) {
+    return _nst_disk_read(obj, rule.ptr, rule.len, nst_disk_pos_rule(obj));
+}
 
-    if(ret != path.len) {
-        return NST_ERR;
-    }
+int
+nst_disk_read_host(nst_disk_obj_t *obj, hpx_ist_t host) {
+    return _nst_disk_read(obj, host.ptr, host.len, nst_disk_pos_host(obj));
+}
 
-    return NST_OK;
+int
+nst_disk_read_path(nst_disk_obj_t *obj, hpx_ist_t path) {
+    return _nst_disk_read(obj, path.ptr, path.len, nst_disk_pos_path(obj));
 }
 
 int
 nst_disk_read_etag(nst_disk_obj_t *obj, hpx_ist_t etag) {
-    int  ret, offset;
-
-    offset = nst_disk_pos_etag(obj);
-
-    ret = pread(obj->fd, etag.ptr, etag.len, offset);
-
-    if(ret != etag.len) {
-        return NST_ERR;
-    }
-
-    return NST_OK;
+    return _nst_disk_read(obj, etag.ptr, etag.len, nst_disk_pos_etag(obj));
 }
 
 int
 nst_disk_read_last_modified(nst_disk_obj_t *obj, hpx_ist_t last_modified) {
-    int  ret, offset;
-
-    offset = nst_disk_pos_last_modified(obj);
-
-    ret = pread(obj->fd, last_modified.ptr, last_modified.len, offset);
-
-    if(ret != last_modified.len) {
-        return NST_ERR;
-    }
-
-    return NST_OK;
+    return _nst_disk_read(obj, last_modified.ptr, last_modified.len, nst_disk_pos_last_modified(obj));
 }
 
 int
-nst_disk_init(nst_disk_t *disk, hpx_ist_t root, nst_shmem_t *shmem, int clean_temp) {
+nst_disk_init(nst_disk_t *disk, hpx_ist_t root, nst_shmem_t *shmem, int clean_temp,
+        int engine) {
+
+    disk->engine   = engine;
+    disk->index.fd = -1;
 
     if(root.len) {
         disk->shmem = shmem;
@@ -247,237 +255,402 @@ nst_disk_init(nst_disk_t *disk, hpx_ist_t root, nst_shmem_t *shmem, int clean_te
 
             closedir(tmp);
         }
+
+        if(engine == NST_DISK_ENGINE_LOG && nst_disk_log_init(disk) != NST_OK) {
+            return NST_ERR;
+        }
     }
 
     return NST_OK;
 }
 
-#ifdef USE_THREAD
-void *nst_disk_load_thread(void *data) {
-    nst_core_t  *core = (nst_core_t *)data;
+const char *
+nst_disk_engine(int engine) {
 
-    if(core->root.len == 0) {
-        return NULL;
+    if(engine == NST_DISK_ENGINE_LOG) {
+        return "log";
     }
 
-    while(!core->store.disk.loaded) {
-        nst_disk_load(core);
+    return "file";
+}
+
+/*
+ * reads the object at obj->base of obj->fd, or the one at data if it is
+ * already in memory, into an item to be added to the dict
+ */
+static int
+_nst_disk_obj_parse(nst_core_t *core, nst_disk_obj_t *obj, char *data, nst_disk_item_t *item) {
+    nst_key_t        *key  = &item->key;
+    hpx_buffer_t     *buf  = &item->buf;
+    nst_http_txn_t   *txn  = &item->txn;
+    nst_rule_prop_t  *prop = &item->prop;
+    uint64_t          ttl_extend;
+    int               stale_prop, stale, expired;
+
+    key->data = NULL;
+    buf->area = NULL;
+
+    if(data) {
+        memcpy(obj->meta, data, NST_DISK_META_SIZE);
+
+        if(memcmp(obj->meta, "NUSTER", 6) != 0 || obj->meta[7] != NST_DISK_VERSION) {
+            goto err;
+        }
+    } else if(nst_disk_read_meta(obj) != NST_OK) {
+        goto err;
     }
 
-    return NULL;
-}
-#endif
+    stale_prop = nst_disk_meta_get_stale(obj->meta);
+    stale      = nst_disk_meta_check_stale(obj->meta) != NST_OK;
+    expired    = nst_disk_meta_check_expire(obj->meta) != NST_OK;
 
-void
-nst_disk_load(nst_core_t *core) {
+    if(expired && (stale_prop == 0 || (stale_prop > 0 && stale))) {
+        goto err;
+    }
 
-    if(core->root.len && !core->store.disk.loaded) {
-        hpx_ist_t        root;
-        nst_disk_obj_t   obj;
-        nst_dirent_t     *de;
-        nst_key_t        key = { .data = NULL };
-        hpx_buffer_t     buf = { .area = NULL };
-        nst_http_txn_t   txn;
-        nst_rule_prop_t  prop;
-        uint64_t         start, ttl_extend, expire;
-        char            *file;
-        int              len, ret, stale_prop, stale, expired;
+    if(data) {
+        key->size = nst_disk_meta_get_key_len(obj->meta);
+        key->data = nst_shmem_alloc(core->shmem, key->size);
 
-        root = core->root;
-        file = core->store.disk.file;
+        if(!key->data) {
+            goto err;
+        }
 
-        start  = nst_time_now_ms();
+        memcpy(key->data, data + NST_DISK_POS_KEY, key->size);
+        memcpy(key->uuid, obj->meta + NST_DISK_META_POS_UUID, NST_KEY_UUID_LEN);
 
-        if(core->store.disk.dir) {
+        key->flags = NST_KEY_UUID;
 
-            while((de = readdir(core->store.disk.dir)) != NULL) {
+        key->hash = nst_disk_meta_get_hash(obj->meta);
+    } else if(nst_disk_read_key(&core->store.disk, obj, key) != NST_OK) {
+        goto err;
+    }
 
-                if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
-                    continue;
-                }
+    prop->pid.len              = nst_disk_meta_get_proxy_len(obj->meta);
+    prop->rid.len              = nst_disk_meta_get_rule_len(obj->meta);
+    txn->req.host.len          = nst_disk_meta_get_host_len(obj->meta);
+    txn->req.path.len          = nst_disk_meta_get_path_len(obj->meta);
+    txn->res.etag.len          = nst_disk_meta_get_etag_len(obj->meta);
+    txn->res.last_modified.len = nst_disk_meta_get_last_modified_len(obj->meta);
 
-                len = strlen(de->d_name);
+    buf->size = prop->pid.len + prop->rid.len + txn->req.host.len + txn->req.path.len
+        + txn->res.etag.len + txn->res.last_modified.len;
 
-                if(len != NST_DISK_FILE_LEN) {
-                    chunk_reset(&trash);
-                    chunk_memcat(&trash, file, nst_disk_path_base_len(root));
-                    chunk_memcat(&trash, "/", 1);
-                    chunk_memcat(&trash, de->d_name, len);
-                    trash.area[trash.data++] = '\0';
+    buf->data = 0;
+    buf->area = nst_shmem_alloc(core->shmem, buf->size);
 
-                    remove(trash.area);
+    if(!buf->area) {
+        goto err;
+    }
 
-                    continue;
-                }
+    /* proxy, rule, host, path, etag and last-modified follow each other */
+    if(data) {
+        memcpy(buf->area, data + nst_disk_pos_proxy(obj), buf->size);
+    } else if(pread(obj->fd, buf->area, buf->size, obj->base + nst_disk_pos_proxy(obj))
+            != buf->size) {
 
-                memcpy(file + nst_disk_path_base_len(root), "/", 1);
-                memcpy(file + nst_disk_path_base_len(root) + 1, de->d_name, NST_DISK_FILE_LEN);
+        goto err;
+    }
 
-                obj.fd = nst_disk_file_open(file);
+    prop->pid.ptr = buf->area + buf->data;
+    buf->data    += prop->pid.len;
 
-                if(obj.fd == -1) {
-                    continue;
-                }
+    prop->rid.ptr = buf->area + buf->data;
+    buf->data    += prop->rid.len;
 
-                if(nst_disk_read_meta(&obj) != NST_OK) {
-                    goto err;
-                }
+    ttl_extend          = nst_disk_meta_get_ttl_extend(obj->meta);
+    prop->ttl           = ttl_extend >> 32;
+    prop->extend[0]     = *( uint8_t *)(&ttl_extend);
+    prop->extend[1]     = *((uint8_t *)(&ttl_extend) + 1);
+    prop->extend[2]     = *((uint8_t *)(&ttl_extend) + 2);
+    prop->extend[3]     = *((uint8_t *)(&ttl_extend) + 3);
+    prop->etag          = nst_disk_meta_get_etag_prop(obj->meta);
+    prop->last_modified = nst_disk_meta_get_last_modified_prop(obj->meta);
+    prop->stale         = nst_disk_meta_get_stale(obj->meta);
+    prop->inactive      = nst_disk_meta_get_inactive(obj->meta);
 
-                stale_prop = nst_disk_meta_get_stale(obj.meta);
-                stale      = nst_disk_meta_check_stale(obj.meta) != NST_OK;
-                expired    = nst_disk_meta_check_expire(obj.meta) != NST_OK;
+    txn->req.host.ptr = buf->area + buf->data;
+    buf->data        += txn->req.host.len;
 
-                if(expired && (stale_prop == 0 || (stale_prop > 0 && stale))) {
-                    goto err;
-                }
+    txn->req.path.ptr = buf->area + buf->data;
+    buf->data        += txn->req.path.len;
 
-                if(nst_disk_read_key(&core->store.disk, &obj, &key) != NST_OK) {
-                    goto err;
-                }
+    txn->res.etag.ptr = buf->area + buf->data;
+    buf->data        += txn->res.etag.len;
 
-                prop.pid.len              = nst_disk_meta_get_proxy_len(obj.meta);
-                prop.rid.len              = nst_disk_meta_get_rule_len(obj.meta);
-                txn.req.host.len          = nst_disk_meta_get_host_len(obj.meta);
-                txn.req.path.len          = nst_disk_meta_get_path_len(obj.meta);
-                txn.res.etag.len          = nst_disk_meta_get_etag_len(obj.meta);
-                txn.res.last_modified.len = nst_disk_meta_get_last_modified_len(obj.meta);
+    txn->res.last_modified.ptr = buf->area + buf->data;
+    buf->data                 += txn->res.last_modified.len;
 
-                buf.size = prop.pid.len + prop.rid.len + txn.req.host.len + txn.req.path.len
-                    + txn.res.etag.len + txn.res.last_modified.len;
+    txn->res.header_len  = nst_disk_meta_get_header_len(obj->meta);
+    txn->res.payload_len = nst_disk_meta_get_payload_len(obj->meta);
 
-                buf.data = 0;
-                buf.area = nst_shmem_alloc(core->shmem, buf.size);
+    item->expire = nst_disk_meta_get_expire(obj->meta);
+    item->file   = obj->file;
+    item->base   = obj->base;
+    item->size   = obj->size;
+    item->id     = nst_disk_meta_get_id(obj->meta);
 
-                if(!buf.area) {
-                    goto err;
-                }
+    return NST_OK;
 
-                prop.pid.ptr = buf.area + buf.data;
+err:
+    nst_shmem_free(core->shmem, key->data);
+    nst_shmem_free(core->shmem, buf->area);
 
-                if(nst_disk_read_proxy(&obj, prop.pid) != NST_OK) {
-                    goto err;
-                }
+    return NST_ERR;
+}
 
-                buf.data += prop.pid.len;
+/*
+ * adds a parsed item to the dict, its stripe must be locked
+ */
+static int
+_nst_disk_obj_insert(nst_core_t *core, nst_disk_item_t *item) {
+    int  ret;
 
-                prop.rid.ptr = buf.area + buf.data;
+    ret = nst_dict_set_from_disk(&core->dict, &item->buf, &item->key, &item->txn, &item->prop,
+            item->file, item->base, item->size, item->id, item->expire);
 
-                if(nst_disk_read_rule(&obj, prop.rid) != NST_OK) {
-                    goto err;
-                }
+    if(ret != NST_OK) {
+        nst_shmem_free(core->shmem, item->key.data);
+        nst_shmem_free(core->shmem, item->buf.area);
 
-                ttl_extend         = nst_disk_meta_get_ttl_extend(obj.meta);
-                prop.ttl           = ttl_extend >> 32;
-                prop.extend[0]     = *( uint8_t *)(&ttl_extend);
-                prop.extend[1]     = *((uint8_t *)(&ttl_extend) + 1);
-                prop.extend[2]     = *((uint8_t *)(&ttl_extend) + 2);
-                prop.extend[3]     = *((uint8_t *)(&ttl_extend) + 3);
-                prop.etag          = nst_disk_meta_get_etag_prop(obj.meta);
-                prop.last_modified = nst_disk_meta_get_last_modified_prop(obj.meta);
-                prop.stale         = nst_disk_meta_get_stale(obj.meta);
-                prop.inactive      = nst_disk_meta_get_inactive(obj.meta);
+        return NST_ERR;
+    }
 
-                buf.data += prop.rid.len;
+    __atomic_add_fetch(&core->store.disk.load_count, 1, __ATOMIC_RELAXED);
 
-                txn.req.host.ptr = buf.area + buf.data;
+    return NST_OK;
+}
 
-                if(nst_disk_read_host(&obj, txn.req.host) != NST_OK) {
-                    goto err;
-                }
+/*
+ * adds the object at obj->base of obj->fd to the dict, or the one at data if
+ * it is already in memory
+ */
+int
+nst_disk_obj_load(nst_core_t *core, nst_disk_obj_t *obj, char *data) {
+    nst_disk_item_t  item;
+    int              ret;
 
-                buf.data += txn.req.host.len;
+    if(_nst_disk_obj_parse(core, obj, data, &item) != NST_OK) {
+        return NST_ERR;
+    }
 
-                txn.req.path.ptr = buf.area + buf.data;
+    nst_dict_lock(&core->dict, item.key.hash);
 
-                if(nst_disk_read_path(&obj, txn.req.path) != NST_OK) {
-                    goto err;
-                }
+    ret = _nst_disk_obj_insert(core, &item);
 
-                buf.data += txn.req.path.len;
+    nst_dict_unlock(&core->dict, item.key.hash);
 
-                txn.res.etag.ptr = buf.area + buf.data;
+    return ret;
+}
 
-                if(nst_disk_read_etag(&obj, txn.res.etag) != NST_OK) {
-                    goto err;
-                }
+static int
+_nst_disk_item_cmp(const void *a, const void *b) {
+    uint64_t  sa = ((nst_disk_item_t *)a)->stripe;
+    uint64_t  sb = ((nst_disk_item_t *)b)->stripe;
 
-                buf.data += txn.res.etag.len;
+    return sa < sb ? -1 : sa > sb;
+}
 
-                txn.res.last_modified.ptr = buf.area + buf.data;
+/*
+ * the items are sorted by lock stripe, each stripe is locked once
+ */
+static void
+_nst_disk_load_batch(nst_core_t *core, nst_disk_item_t *item, int n) {
+    nst_dict_t       *dict = &core->dict;
+    nst_dict_lock_t  *lock = NULL;
+    int               i;
 
-                if(nst_disk_read_last_modified(&obj, txn.res.last_modified) != NST_OK) {
-                    goto err;
-                }
+    for(i = 0; i < n; i++) {
+        item[i].stripe = item[i].key.hash & (dict->locks - 1);
+    }
 
-                buf.data += txn.res.last_modified.len;
+    qsort(item, n, sizeof(*item), _nst_disk_item_cmp);
 
-                txn.res.header_len  = nst_disk_meta_get_header_len(obj.meta);
-                txn.res.payload_len = nst_disk_meta_get_payload_len(obj.meta);
+    for(i = 0; i < n; i++) {
 
-                expire = nst_disk_meta_get_expire(obj.meta);
+        if(nst_dict_stripe(dict, item[i].key.hash) != lock) {
 
-                nst_shctx_lock(&core->dict);
+            if(lock) {
+                nst_shctx_unlock(lock);
+            }
 
-                ret = nst_dict_set_from_disk(&core->dict, &buf, &key, &txn, &prop, file, expire);
+            lock = nst_dict_stripe(dict, item[i].key.hash);
 
-                nst_shctx_unlock(&core->dict);
+            nst_shctx_lock(lock);
+        }
 
-                if(ret != NST_OK) {
-                    goto err;
-                }
+        if(_nst_disk_obj_insert(core, &item[i]) != NST_OK) {
+            remove(item[i].file);
+        }
+    }
 
-                close(obj.fd);
+    if(lock) {
+        nst_shctx_unlock(lock);
+    }
+}
 
-                if(nst_time_now_ms() - start >= 300) {
-                    break;
-                }
+/*
+ * loader threads claim the directories one by one
+ */
+static void *
+_nst_disk_load_thread(void *data) {
+    nst_core_t       *core = data;
+    nst_disk_t       *disk = &core->store.disk;
+    hpx_ist_t         root = core->root;
+    nst_disk_item_t   item[NST_DISK_LOAD_BATCH];
+    nst_disk_obj_t    obj  = { .base = 0, .size = 0 };
+    nst_dirent_t     *de;
+    struct stat       st;
+    DIR              *dir;
+    char             *path, *files, *file;
+    int               idx, len, n = 0;
+
+    len   = nst_disk_path_file_len(root) + 1;
+    path  = malloc(len);
+    files = malloc(len * NST_DISK_LOAD_BATCH);
+
+    if(!path || !files) {
+        free(path);
+        free(files);
+
+        return NULL;
+    }
+
+    while((idx = __atomic_fetch_add(&disk->load_idx, 1, __ATOMIC_RELAXED)) < 16 * 16) {
+        dir = nst_disk_opendir_by_idx(root, path, idx);
+
+        while(dir && (de = readdir(dir)) != NULL) {
+
+            if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+                continue;
             }
 
-            if(de == NULL) {
-                core->store.disk.idx++;
-                closedir(core->store.disk.dir);
-                core->store.disk.dir = NULL;
+            file = files + len * n;
+
+            if(strlen(de->d_name) != NST_DISK_FILE_LEN) {
+                snprintf(file, len, "%s/%s", path, de->d_name);
+
+                remove(file);
+
+                continue;
             }
-        } else {
-            core->store.disk.dir = nst_disk_opendir_by_idx(core->root, file, core->store.disk.idx);
 
-            if(!core->store.disk.dir) {
-                core->store.disk.idx++;
+            /* already loaded from the index */
+            if(disk->index.mtime && fstatat(dirfd(dir), de->d_name, &st, 0) == 0
+                    && st.st_mtime < disk->index.mtime) {
+
+                continue;
+            }
+
+            sprintf(file, "%s/%s", path, de->d_name);
+
+            obj.file = file;
+            obj.fd   = nst_disk_file_open(file);
+
+            if(obj.fd == -1) {
+                continue;
+            }
+
+            if(_nst_disk_obj_parse(core, &obj, NULL, &item[n]) != NST_OK) {
+                remove(file);
+            } else {
+                n++;
+            }
+
+            close(obj.fd);
+
+            if(n == NST_DISK_LOAD_BATCH) {
+                _nst_disk_load_batch(core, item, n);
+
+                n = 0;
             }
         }
 
-        if(core->store.disk.idx == 16 * 16) {
-            core->store.disk.loaded = 1;
-            core->store.disk.idx    = 0;
+        if(n) {
+            _nst_disk_load_batch(core, item, n);
+
+            n = 0;
         }
 
+        if(dir) {
+            closedir(dir);
+        }
+
+        __atomic_add_fetch(&disk->load_dirs, 1, __ATOMIC_RELAXED);
+    }
+
+    free(path);
+    free(files);
+
+    return NULL;
+}
+
+static void
+_nst_disk_load_file(nst_core_t *core) {
+    nst_disk_t  *disk = &core->store.disk;
+    pthread_t    thread[NST_DISK_LOADERS_MAX];
+    int          i, n = 0;
+
+    if(!core->root.len || disk->loaded) {
         return;
+    }
 
-err:
+    /* the calling thread is one of the loaders */
+    for(i = 1; i < disk->loaders; i++) {
 
-        if(file) {
-            remove(file);
+        if(pthread_create(&thread[n], NULL, _nst_disk_load_thread, core) == 0) {
+            n++;
         }
+    }
 
-        if(obj.fd) {
-            close(obj.fd);
+    _nst_disk_load_thread(core);
+
+    for(i = 0; i < n; i++) {
+        pthread_join(thread[i], NULL);
+    }
+
+    disk->loaded = 1;
+}
+
+void
+nst_disk_load(nst_core_t *core) {
+    nst_disk_t  *disk = &core->store.disk;
+
+    if(!disk->load_start) {
+        disk->load_start = nst_time_now_ms();
+
+        if(disk->engine == NST_DISK_ENGINE_FILE) {
+            nst_disk_index_load(core);
         }
+    }
 
-        nst_shmem_free(core->shmem, key.data);
-        nst_shmem_free(core->shmem, buf.area);
+    if(disk->engine == NST_DISK_ENGINE_LOG) {
+        nst_disk_log_load(core);
+    } else {
+        _nst_disk_load_file(core);
+    }
 
+    if(disk->loaded) {
+        disk->load_time  = nst_time_now_ms() - disk->load_start;
+        disk->index.time = nst_time_now_ms();
     }
 }
 
 void
 nst_disk_cleanup(nst_core_t *core) {
-    nst_disk_obj_t  obj;
+    nst_disk_obj_t  obj = { .base = 0 };
     nst_dirent_t   *de;
     hpx_ist_t       root;
     uint64_t        start;
     char           *file;
     int             len;
 
+    if(core->store.disk.engine == NST_DISK_ENGINE_LOG) {
+        nst_disk_log_compact(core);
+
+        return;
+    }
+
     root = core->root;
     file = core->store.disk.file;
 
@@ -602,28 +775,8 @@ nst_disk_purge_by_key(nst_disk_obj_t *obj, nst_key_t *key, hpx_ist_t root) {
     return ret;
 }
 
-/*
- * -1: error
- *  0: not found
- *  1: ok
- */
-int
-nst_disk_purge_by_path(char *path) {
-    int  ret = remove(path);
-
-    if(ret == 0) {
-        return 1;
-    } else {
-        if(errno == ENOENT) {
-            return 0;
-        } else {
-            return -1;
-        }
-    }
-}
-
 void
-nst_disk_update_expire(char *file, uint64_t expire) {
+nst_disk_update_expire(char *file, uint64_t base, uint64_t expire) {
     int  fd;
 
     fd = open(file, O_WRONLY);
@@ -632,12 +785,12 @@ nst_disk_update_expire(char *file, uint64_t expire) {
         return;
     }
 
-    pwrite(fd, &expire, 8, NST_DISK_META_POS_EXPIRE);
+    pwrite(fd, &expire, 8, base + NST_DISK_META_POS_EXPIRE);
 
     close(fd);
 }
 
-static void
+void
 nst_disk_meta_init(char *p, uint64_t hash, uint64_t expire, uint64_t header_len,
         uint64_t payload_len, uint64_t key_len, nst_http_txn_t *txn, nst_rule_prop_t *prop) {
 
@@ -676,13 +829,21 @@ int
 nst_disk_obj_create(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key, nst_http_txn_t *txn,
         nst_rule_prop_t *prop) {
 
-    obj->file = NULL;
-    obj->fd   = -1;
+    obj->file    = NULL;
+    obj->fd      = -1;
+    obj->base    = 0;
+    obj->size    = 0;
+    obj->wlen    = 0;
+    obj->writes  = 0;
+    obj->written = 0;
+
+    /* without it, every append is a write */
+    obj->wbuf    = malloc(NST_DISK_WBUF_SIZE);
 
     obj->file = nst_shmem_alloc(disk->shmem, nst_disk_path_file_len(disk->root));
 
     if(!obj->file) {
-        return NST_ERR;
+        goto err;
     }
 
     sprintf(obj->file, "%s/.tmp/%020"PRIx64"%020"PRIu64, disk->root.ptr, ha_random64(),
@@ -695,6 +856,7 @@ nst_disk_obj_create(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key, nst_h
     }
 
     nst_disk_meta_init(obj->meta, key->hash, 0, 0, 0, key->size, txn, prop);
+    nst_disk_meta_set_id(obj->meta, ha_random64() | 1);
 
     if(nst_disk_write_key(obj, key) != NST_OK) {
         goto err;
@@ -727,19 +889,116 @@ nst_disk_obj_create(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key, nst_h
     return NST_OK;
 
 err:
+    nst_disk_obj_abort(disk, obj);
 
-    if(obj->fd != -1) {
-        close(obj->fd);
-        obj->fd = -1;
+    return NST_ERR;
+}
+
+int
+nst_disk_obj_flush(nst_disk_obj_t *obj) {
+    ssize_t  ret;
+
+    if(!obj->wlen) {
+        return NST_OK;
     }
 
-    if(obj->file) {
-        remove(obj->file);
-        nst_shmem_free(disk->shmem, obj->file);
-        obj->file = NULL;
+    ret = pwrite(obj->fd, obj->wbuf, obj->wlen, obj->wpos);
+
+    obj->writes++;
+
+    if(ret != obj->wlen) {
+        return NST_ERR;
     }
 
-    return NST_ERR;
+    obj->written += obj->wlen;
+    obj->wlen     = 0;
+
+    return NST_OK;
+}
+
+/*
+ * writes the meta of a finished object, along with what is still buffered
+ * in a single write if the buffer follows it, as it does for small objects
+ */
+static int
+_nst_disk_obj_write_meta(nst_disk_obj_t *obj) {
+    struct iovec  iov[2];
+    ssize_t       ret;
+
+    if(!obj->wlen || obj->wpos != NST_DISK_META_SIZE) {
+
+        if(nst_disk_obj_flush(obj) != NST_OK) {
+            return NST_ERR;
+        }
+
+        iov[1].iov_len = 0;
+    } else {
+        iov[1].iov_base = obj->wbuf;
+        iov[1].iov_len  = obj->wlen;
+    }
+
+    iov[0].iov_base = obj->meta;
+    iov[0].iov_len  = NST_DISK_META_SIZE;
+
+    ret = pwritev(obj->fd, iov, iov[1].iov_len ? 2 : 1, 0);
+
+    obj->writes++;
+
+    if(ret != NST_DISK_META_SIZE + iov[1].iov_len) {
+        return NST_ERR;
+    }
+
+    obj->written += ret;
+    obj->wlen     = 0;
+
+    return NST_OK;
+}
+
+/*
+ * disk-sync always, the object is synced before it is published, the
+ * latency of the sync is that of the commit
+ */
+void
+nst_disk_obj_sync(nst_disk_t *disk, int fd) {
+    uint64_t  start;
+
+    if(disk->sync != NST_DISK_SYNC_ALWAYS) {
+        return;
+    }
+
+    start = nst_time_now_us();
+
+    fdatasync(fd);
+
+    if(disk->commit_latency) {
+        nst_stats_update_latency(disk->commit_latency, nst_time_now_us() - start);
+    }
+}
+
+/*
+ * disk-sync TIME, called by the master, syncs the filesystem of the root at
+ * once, committing all the objects written since the last sync
+ */
+void
+nst_disk_sync(nst_disk_t *disk) {
+    uint64_t  start = nst_time_now_us();
+    int       fd;
+
+    disk->sync_time = start / 1000;
+
+    fd = open(disk->root.ptr, O_RDONLY | O_DIRECTORY);
+
+    if(fd == -1) {
+        return;
+    }
+
+    syncfs(fd);
+
+    close(fd);
+
+    if(disk->commit_latency) {
+        nst_stats_update_latency(disk->commit_latency, nst_time_now_us() - start);
+    }
 }
 
 int
@@ -748,15 +1007,23 @@ nst_disk_obj_finish(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key, nst_h
 
     char  *p, *old_file, *new_file;
 
-    nst_disk_meta_set_uuid(obj->meta, key->uuid);
+    nst_disk_meta_set_uuid(obj->meta, nst_key_uuid(key));
     nst_disk_meta_set_expire(obj->meta, expire);
     nst_disk_meta_set_header_len(obj->meta, txn->res.header_len);
     nst_disk_meta_set_payload_len(obj->meta, txn->res.payload_len);
 
-    if(nst_disk_write_meta(obj) != NST_OK) {
+    if(_nst_disk_obj_write_meta(obj) != NST_OK) {
         goto err;
     }
 
+    nst_disk_obj_wbuf_free(disk, obj);
+
+    if(disk->engine == NST_DISK_ENGINE_LOG) {
+        return nst_disk_log_append(disk, obj);
+    }
+
+    nst_disk_obj_sync(disk, obj->fd);
+
     p = trash.area;
 
     nst_key_uuid_stringify(key, p);
@@ -786,39 +1053,87 @@ nst_disk_obj_finish(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key, nst_h
     return NST_OK;
 
 err:
-    if(obj->fd != -1) {
-        close(obj->fd);
-        obj->fd = -1;
-    }
-
-    if(obj->file) {
-        remove(obj->file);
-        nst_shmem_free(disk->shmem, obj->file);
-        obj->file = NULL;
-    }
+    nst_disk_obj_abort(disk, obj);
 
     return NST_ERR;
 }
 
+/*
+ * reads the meta and the head of an object with a single preadv, or a single
+ * read of the page cache, and checks that it is the object of key
+ */
 int
-nst_disk_obj_valid(nst_disk_obj_t *obj, nst_key_t *key) {
-    hpx_buffer_t  *buf;
-    int            ret;
+nst_disk_obj_valid(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key) {
+    struct iovec   iov[2];
+    uint64_t       end;
+    char          *p;
+    int            ret, len;
 
-    buf = get_trash_chunk();
+    obj->pcache = disk->pcache;
 
-    obj->fd = nst_disk_file_open(obj->file);
+    if(obj->pcache) {
+        obj->fd = _nst_disk_file_open_direct(obj->file);
+    } else {
+        obj->fd = nst_disk_file_open(obj->file);
+    }
 
     if(obj->fd == -1) {
         goto err;
     }
 
-    ret = pread(obj->fd, obj->meta, NST_DISK_META_SIZE, 0);
+    if(!obj->head) {
+        obj->head = alloc_trash_chunk();
+    }
+
+    len = 0;
+    end = nst_disk_obj_end(obj);
 
-    if(ret != NST_DISK_META_SIZE) {
+    if(obj->head) {
+        len = NST_DISK_HEAD_SIZE - NST_DISK_META_SIZE;
+
+        if(end && end - obj->base < NST_DISK_HEAD_SIZE) {
+            len = end - obj->base - NST_DISK_META_SIZE;
+        }
+
+        obj->head->data = 0;
+    }
+
+    if(obj->pcache && obj->head) {
+        ret = nst_pcache_read(obj->pcache, obj->fd, obj->id, obj->hits, obj->head->area,
+                NST_DISK_META_SIZE + len, obj->base);
+
+        if(ret >= NST_DISK_META_SIZE) {
+            memcpy(obj->meta, obj->head->area, NST_DISK_META_SIZE);
+            memmove(obj->head->area, obj->head->area + NST_DISK_META_SIZE,
+                    ret - NST_DISK_META_SIZE);
+        }
+    } else if(obj->pcache) {
+        ret = nst_pcache_read(obj->pcache, obj->fd, obj->id, obj->hits, obj->meta,
+                NST_DISK_META_SIZE, obj->base);
+    } else {
+        iov[0].iov_base = obj->meta;
+        iov[0].iov_len  = NST_DISK_META_SIZE;
+        iov[1].iov_base = obj->head ? obj->head->area : NULL;
+        iov[1].iov_len  = len;
+
+        ret = preadv(obj->fd, iov, len ? 2 : 1, obj->base);
+    }
+
+    if(ret < NST_DISK_META_SIZE) {
         goto err;
     }
 
+    if(obj->head) {
+        obj->head->data = ret - NST_DISK_META_SIZE;
+
+        /* a short read found the end of the file */
+        if(ret < NST_DISK_META_SIZE + len) {
+            end = obj->base + ret;
+        }
+    }
+
+    obj->end = end;
+
     if(memcmp(obj->meta, "NUSTER", 6) !=0) {
         goto err;
     }
@@ -833,20 +1148,27 @@ nst_disk_obj_valid(nst_disk_obj_t *obj, nst_key_t *key) {
         goto err;
     }
 
-    ret = pread(obj->fd, buf->area, key->size, NST_DISK_POS_KEY);
+    p = get_trash_chunk()->area;
 
-    if(ret != key->size) {
+    if(_nst_disk_read(obj, p, key->size, NST_DISK_POS_KEY) != NST_OK) {
         goto err;
     }
 
-    if(memcmp(key->data, buf->area, key->size) != 0) {
+    if(memcmp(key->data, p, key->size) != 0) {
         goto err;
     }
 
+    /* the blocks of a hit found by nst_disk_obj_exists are cached too */
+    obj->id = nst_disk_meta_get_id(obj->meta);
+
     return NST_OK;
 
 err:
-    close(obj->fd);
+    if(obj->fd != -1) {
+        close(obj->fd);
+    }
+
+    nst_disk_obj_head_free(obj);
 
     return NST_ERR;
 }
@@ -856,11 +1178,19 @@ nst_disk_obj_exists(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key) {
     hpx_buffer_t  *buf1, *buf2;
     char          *p;
 
+    /* only the index knows where an object of a segment is */
+    if(disk->engine == NST_DISK_ENGINE_LOG) {
+        return NST_ERR;
+    }
+
     buf1 = get_trash_chunk();
     buf2 = get_trash_chunk();
     p    = buf1->area;
 
     obj->file = buf2->area;
+    obj->base = 0;
+    obj->id   = 0;
+    obj->hits = 0;
 
     nst_key_uuid_stringify(key, p);
 
@@ -868,10 +1198,83 @@ nst_disk_obj_exists(nst_disk_t *disk, nst_disk_obj_t *obj, nst_key_t *key) {
 
     sprintf(obj->file, "%s/%c/%c%c/%s", disk->root.ptr, p[0], p[0], p[1], p);
 
-    if(nst_disk_obj_valid(obj, key) == NST_OK) {
+    if(nst_disk_obj_valid(disk, obj, key) == NST_OK) {
         return NST_OK;
     }
 
     return NST_ERR;
 }
 
+/*
+ * reads up to len bytes at offset of the object of a disk applet, through the
+ * page cache with disk-direct, else as nst_aio_read does
+ */
+int
+nst_disk_applet_read(hpx_appctx_t *appctx, char **buf, int len, uint64_t offset) {
+    nst_pcache_t  *pcache = appctx->ctx.nuster.store.disk.pcache;
+
+    if(!pcache) {
+        return nst_aio_read(appctx->ctx.nuster.store.disk.aio, appctx->ctx.nuster.store.disk.fd,
+                buf, len, offset);
+    }
+
+    if(len > global.tune.bufsize) {
+        len = global.tune.bufsize;
+    }
+
+    *buf = get_trash_chunk()->area;
+
+    return nst_pcache_read(pcache, appctx->ctx.nuster.store.disk.fd,
+            appctx->ctx.nuster.store.disk.id, appctx->ctx.nuster.store.disk.hits, *buf, len,
+            offset);
+}
+
+#if defined(USE_LINUX_SPLICE)
+/*
+ * moves up to len bytes at offset of fd to pipe without copying them to user
+ * space, returns the bytes moved or -1
+ */
+int
+nst_disk_splice(int fd, struct pipe *pipe, uint64_t offset, uint64_t len) {
+    loff_t  off = offset;
+    int     ret;
+
+    if(len > NST_DISK_SPLICE_MAX) {
+        len = NST_DISK_SPLICE_MAX;
+    }
+
+    ret = splice(fd, &off, pipe->prod, NULL, len, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+
+    if(ret > 0) {
+        pipe->data += ret;
+    }
+
+    return ret;
+}
+#endif
+
+/*
+ * removes the object of an entry from the disk
+ */
+void
+nst_disk_obj_remove(nst_disk_t *disk, char *file, uint64_t base, uint64_t size) {
+
+    if(disk->engine == NST_DISK_ENGINE_LOG) {
+        nst_disk_log_remove(disk, file, base, size);
+    } else {
+        nst_disk_file_remove(file);
+    }
+}
+
+/*
+ * the object of an entry freed from the dict is left on the disk, the file
+ * engine's cleaner removes it once expired, the log engine's compaction
+ * accounts it as dead
+ */
+void
+nst_disk_obj_release(nst_disk_t *disk, char *file, uint64_t size) {
+
+    if(disk->engine == NST_DISK_ENGINE_LOG) {
+        nst_disk_log_release(disk, file, size);
+    }
+}
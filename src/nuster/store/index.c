@@ -0,0 +1,415 @@
+/*
+ * nuster store disk index snapshot functions.
+ *
+ * Copyright (C) Jiang Wenyuan, < koubunen AT gmail DOT com >
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <sys/mman.h>
+
+#include <import/xxhash.h>
+
+#include <haproxy/tools.h>
+#include <haproxy/global.h>
+
+#include <nuster/nuster.h>
+
+
+static char *
+_nst_disk_index_path(nst_disk_t *disk, const char *dir) {
+    hpx_buffer_t  *buf = get_trash_chunk();
+
+    chunk_printf(buf, "%s%sindex", disk->root.ptr, dir);
+
+    return buf->area;
+}
+
+static void
+_nst_disk_index_abort(nst_disk_t *disk) {
+    nst_disk_index_t  *index = &disk->index;
+
+    close(index->fd);
+    remove(_nst_disk_index_path(disk, "/.tmp/"));
+
+    free(index->buf);
+
+    index->fd  = -1;
+    index->buf = NULL;
+}
+
+static int
+_nst_disk_index_begin(nst_core_t *core) {
+    nst_disk_t        *disk  = &core->store.disk;
+    nst_disk_index_t  *index = &disk->index;
+    char               header[NST_DISK_INDEX_HEADER_SIZE] = { 0 };
+
+    index->buf = malloc(NST_DISK_INDEX_BUFSIZE);
+
+    if(!index->buf) {
+        return NST_ERR;
+    }
+
+    index->fd = open(_nst_disk_index_path(disk, "/.tmp/"), O_CREAT | O_TRUNC | O_WRONLY, 0600);
+
+    if(index->fd == -1) {
+        free(index->buf);
+        index->buf = NULL;
+
+        return NST_ERR;
+    }
+
+    /* written once all the records are */
+    if(write(index->fd, header, sizeof(header)) != sizeof(header)) {
+        _nst_disk_index_abort(disk);
+
+        return NST_ERR;
+    }
+
+    index->idx     = 0;
+    index->version = core->dict.rehash.version;
+    index->count   = 0;
+    index->len     = 0;
+    index->start   = nst_time_now_ms();
+    index->size    = NST_DISK_INDEX_BUFSIZE;
+    index->data    = 0;
+
+    XXH64_reset(&index->check, 0);
+
+    return NST_OK;
+}
+
+static int
+_nst_disk_index_flush(nst_disk_index_t *index) {
+    char     *p   = index->buf;
+    uint64_t  len = index->data;
+    ssize_t   ret;
+
+    XXH64_update(&index->check, p, len);
+
+    while(len) {
+        ret = write(index->fd, p, len);
+
+        if(ret <= 0) {
+            return NST_ERR;
+        }
+
+        p   += ret;
+        len -= ret;
+    }
+
+    index->len += index->data;
+    index->data = 0;
+
+    return NST_OK;
+}
+
+static int
+_nst_disk_index_entry(nst_dict_entry_t *entry) {
+
+    if(!entry->store.disk.file) {
+        return 0;
+    }
+
+    return entry->state == NST_DICT_ENTRY_STATE_VALID
+        || entry->state == NST_DICT_ENTRY_STATE_REFRESH
+        || entry->state == NST_DICT_ENTRY_STATE_UPDATE
+        || entry->state == NST_DICT_ENTRY_STATE_STALE;
+}
+
+/*
+ * the record of a locked entry, its meta is rebuilt from the entry rather
+ * than read from its file
+ */
+static int
+_nst_disk_index_append(nst_disk_index_t *index, nst_dict_entry_t *entry) {
+    nst_disk_obj_t   obj;
+    nst_http_txn_t   txn;
+    uint64_t         len;
+    char            *p;
+
+    txn.req.host          = entry->host;
+    txn.req.path          = entry->path;
+    txn.res.etag          = entry->etag;
+    txn.res.last_modified = entry->last_modified;
+
+    memset(obj.meta, 0, NST_DISK_META_SIZE);
+
+    nst_disk_meta_init(obj.meta, entry->key.hash, entry->expire, entry->header_len,
+            entry->payload_len, entry->key.size, &txn, &entry->prop);
+
+    nst_disk_meta_set_uuid(obj.meta, nst_key_uuid(&entry->key));
+    nst_disk_meta_set_id(obj.meta, entry->store.disk.id);
+
+    len = NST_DISK_INDEX_RECORD_SIZE + nst_disk_pos_header(&obj);
+    len = (len + 7) & ~7ULL;
+
+    if(index->data + len > index->size) {
+        uint64_t  size = index->size * 2;
+
+        if(size < index->data + len) {
+            size = index->data + len;
+        }
+
+        p = realloc(index->buf, size);
+
+        if(!p) {
+            return NST_ERR;
+        }
+
+        index->buf  = p;
+        index->size = size;
+    }
+
+    p = index->buf + index->data;
+
+    memset(p, 0, len);
+
+    *(uint32_t *)p = len;
+
+    memcpy(p + NST_DISK_INDEX_RECORD_POS_FILE,
+            entry->store.disk.file + strlen(entry->store.disk.file) - NST_DISK_FILE_LEN,
+            NST_DISK_FILE_LEN);
+
+    p += NST_DISK_INDEX_RECORD_SIZE;
+
+    memcpy(p, obj.meta, NST_DISK_META_SIZE);
+    p += NST_DISK_META_SIZE;
+
+    memcpy(p, entry->key.data, entry->key.size);
+    p += entry->key.size;
+
+    memcpy(p, entry->prop.pid.ptr, entry->prop.pid.len);
+    p += entry->prop.pid.len;
+
+    memcpy(p, entry->prop.rid.ptr, entry->prop.rid.len);
+    p += entry->prop.rid.len;
+
+    memcpy(p, entry->host.ptr, entry->host.len);
+    p += entry->host.len;
+
+    memcpy(p, entry->path.ptr, entry->path.len);
+    p += entry->path.len;
+
+    memcpy(p, entry->etag.ptr, entry->etag.len);
+    p += entry->etag.len;
+
+    memcpy(p, entry->last_modified.ptr, entry->last_modified.len);
+
+    index->data += len;
+    index->count++;
+
+    return NST_OK;
+}
+
+static void
+_nst_disk_index_finish(nst_disk_t *disk) {
+    nst_disk_index_t  *index = &disk->index;
+    char               header[NST_DISK_INDEX_HEADER_SIZE] = { 0 };
+    char              *tmp;
+
+    if(_nst_disk_index_flush(index) != NST_OK) {
+        _nst_disk_index_abort(disk);
+
+        return;
+    }
+
+    memcpy(header, "NSTINDEX", 8);
+
+    *(uint32_t *)(header + NST_DISK_INDEX_HEADER_POS_VERSION)    = NST_DISK_INDEX_VERSION;
+    *(uint64_t *)(header + NST_DISK_INDEX_HEADER_POS_COUNT)      = index->count;
+    *(uint64_t *)(header + NST_DISK_INDEX_HEADER_POS_START)      = index->start;
+    *(uint64_t *)(header + NST_DISK_INDEX_HEADER_POS_LEN)        = index->len;
+    *(uint64_t *)(header + NST_DISK_INDEX_HEADER_POS_BODY_CHECK) = XXH64_digest(&index->check);
+    *(uint64_t *)(header + NST_DISK_INDEX_HEADER_POS_CHECK)      =
+        XXH64(header, NST_DISK_INDEX_HEADER_POS_CHECK, 0);
+
+    if(pwrite(index->fd, header, sizeof(header), 0) != sizeof(header) || fsync(index->fd) != 0) {
+        _nst_disk_index_abort(disk);
+
+        return;
+    }
+
+    close(index->fd);
+    free(index->buf);
+
+    index->fd  = -1;
+    index->buf = NULL;
+
+    tmp = strdup(_nst_disk_index_path(disk, "/.tmp/"));
+
+    if(!tmp || rename(tmp, _nst_disk_index_path(disk, "/")) != 0) {
+
+        if(tmp) {
+            remove(tmp);
+        }
+    }
+
+    free(tmp);
+}
+
+/*
+ * walks one slot of the dict, the snapshot is started on the first call and
+ * renamed into place once the last slot is walked
+ */
+void
+nst_disk_index_save(nst_core_t *core) {
+    nst_disk_t        *disk  = &core->store.disk;
+    nst_disk_index_t  *index = &disk->index;
+    nst_dict_t        *dict  = &core->dict;
+    nst_dict_entry_t  *entry;
+    uint64_t           idx;
+    int                ret   = NST_OK;
+
+    if(!core->root.len || !disk->loaded || disk->engine != NST_DISK_ENGINE_FILE) {
+        return;
+    }
+
+    if(index->fd == -1 && _nst_disk_index_begin(core) != NST_OK) {
+        index->time = nst_time_now_ms();
+
+        return;
+    }
+
+    idx = index->idx;
+
+    if(idx >= nst_dict_slots(dict)) {
+        _nst_disk_index_finish(disk);
+
+        index->time = nst_time_now_ms();
+
+        return;
+    }
+
+    nst_dict_lock(dict, idx);
+
+    /* slots changed as the dict was resized, start over */
+    if(index->version != dict->rehash.version) {
+        nst_dict_unlock(dict, idx);
+
+        _nst_disk_index_abort(disk);
+
+        return;
+    }
+
+    entry = *nst_dict_slot(dict, idx);
+
+    while(entry && ret == NST_OK) {
+
+        if(_nst_disk_index_entry(entry)) {
+            ret = _nst_disk_index_append(index, entry);
+        }
+
+        entry = entry->next;
+    }
+
+    nst_dict_unlock(dict, idx);
+
+    index->idx++;
+
+    if(ret == NST_OK && index->data >= NST_DISK_INDEX_BUFSIZE) {
+        ret = _nst_disk_index_flush(index);
+    }
+
+    if(ret != NST_OK) {
+        _nst_disk_index_abort(disk);
+
+        index->time = nst_time_now_ms();
+    }
+}
+
+/*
+ * adds the objects of the snapshot to the dict, files modified since it was
+ * started are left to the directory scan
+ */
+int
+nst_disk_index_load(nst_core_t *core) {
+    nst_disk_t      *disk = &core->store.disk;
+    nst_disk_obj_t   obj  = { .fd = -1, .base = 0, .size = 0 };
+    struct stat      st;
+    uint64_t         len, start, loaded = 0;
+    uint32_t         record;
+    char            *map, *p, *end;
+    int              fd;
+
+    fd = open(_nst_disk_index_path(disk, "/"), O_RDONLY);
+
+    if(fd == -1) {
+        return NST_ERR;
+    }
+
+    if(fstat(fd, &st) != 0 || st.st_size < NST_DISK_INDEX_HEADER_SIZE) {
+        close(fd);
+
+        return NST_ERR;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if(map == MAP_FAILED) {
+        return NST_ERR;
+    }
+
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    len   = *(uint64_t *)(map + NST_DISK_INDEX_HEADER_POS_LEN);
+    start = *(uint64_t *)(map + NST_DISK_INDEX_HEADER_POS_START);
+
+    if(memcmp(map, "NSTINDEX", 8) != 0
+            || *(uint32_t *)(map + NST_DISK_INDEX_HEADER_POS_VERSION) != NST_DISK_INDEX_VERSION
+            || *(uint64_t *)(map + NST_DISK_INDEX_HEADER_POS_CHECK)
+                != XXH64(map, NST_DISK_INDEX_HEADER_POS_CHECK, 0)
+            || len != st.st_size - NST_DISK_INDEX_HEADER_SIZE
+            || *(uint64_t *)(map + NST_DISK_INDEX_HEADER_POS_BODY_CHECK)
+                != XXH64(map + NST_DISK_INDEX_HEADER_SIZE, len, 0)) {
+
+        munmap(map, st.st_size);
+
+        return NST_ERR;
+    }
+
+    p   = map + NST_DISK_INDEX_HEADER_SIZE;
+    end = p + len;
+
+    while(p < end) {
+        record = *(uint32_t *)p;
+
+        if(record % 8 || record < NST_DISK_INDEX_RECORD_SIZE + NST_DISK_META_SIZE
+                || record > end - p) {
+
+            break;
+        }
+
+        memcpy(obj.meta, p + NST_DISK_INDEX_RECORD_SIZE, NST_DISK_META_SIZE);
+
+        if(NST_DISK_INDEX_RECORD_SIZE + nst_disk_pos_header(&obj) > record) {
+            break;
+        }
+
+        obj.file = disk->file;
+
+        sprintf(obj.file, "%s/%c/%c%c/%.*s", disk->root.ptr,
+                p[NST_DISK_INDEX_RECORD_POS_FILE], p[NST_DISK_INDEX_RECORD_POS_FILE],
+                p[NST_DISK_INDEX_RECORD_POS_FILE + 1], NST_DISK_FILE_LEN,
+                p + NST_DISK_INDEX_RECORD_POS_FILE);
+
+        if(nst_disk_obj_load(core, &obj, p + NST_DISK_INDEX_RECORD_SIZE) == NST_OK) {
+            loaded++;
+        }
+
+        p += record;
+    }
+
+    munmap(map, st.st_size);
+
+    disk->indexed     = loaded;
+    disk->index.mtime = start / 1000 - NST_DISK_INDEX_MARGIN;
+
+    return NST_OK;
+}
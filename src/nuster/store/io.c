@@ -0,0 +1,198 @@
+/*
+ * nuster background disk pass functions.
+ *
+ * Copyright (C) Jiang Wenyuan, < koubunen AT gmail DOT com >
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <pthread.h>
+
+#include <haproxy/global.h>
+#include <haproxy/errors.h>
+#include <haproxy/chunk.h>
+
+#include <nuster/nuster.h>
+
+static void
+_nst_io_run(nst_io_job_t *job) {
+    nst_core_t  *core  = job->core;
+    uint64_t     start = nst_time_now_ms();
+    int          count = job->count;
+
+    switch(job->type) {
+        case NST_IO_JOB_SAVER:
+
+            while(core->store.disk.loaded && count--) {
+                nst_store_memory_sync_disk(core);
+
+                if(nst_time_now_ms() - start >= NST_IO_SLICE_MS) {
+                    break;
+                }
+            }
+
+            break;
+        case NST_IO_JOB_CLEANER:
+
+            while(core->store.disk.loaded && count--) {
+                nst_disk_cleanup(core);
+
+                if(nst_time_now_ms() - start >= NST_IO_SLICE_MS) {
+                    break;
+                }
+            }
+
+            break;
+        case NST_IO_JOB_LOADER:
+
+            while(core->root.len && !core->store.disk.loaded) {
+                nst_disk_load(core);
+            }
+
+            break;
+        case NST_IO_JOB_INDEX:
+
+            do {
+                nst_disk_index_save(core);
+            } while(core->store.disk.index.fd != -1
+                    && nst_time_now_ms() - start < NST_IO_SLICE_MS);
+
+            break;
+        case NST_IO_JOB_SYNC:
+            nst_disk_sync(&core->store.disk);
+
+            break;
+    }
+}
+
+static void *
+_nst_io_thread(void *data) {
+    nst_io_t      *io = data;
+    nst_io_job_t  *job;
+
+    /* the disk functions use the trash chunks */
+    if(!alloc_trash_buffers_per_thread()) {
+        ha_alert("nuster io: failed to allocate the trash buffers.\n");
+
+        return NULL;
+    }
+
+    while(1) {
+        pthread_mutex_lock(&io->mutex);
+
+        while(!io->head) {
+            pthread_cond_wait(&io->cond, &io->mutex);
+        }
+
+        job = io->head;
+
+        io->head = job->next;
+
+        if(!io->head) {
+            io->tail = NULL;
+        }
+
+        pthread_mutex_unlock(&io->mutex);
+
+        _nst_io_run(job);
+
+        __atomic_store_n(&job->queued, 0, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+static void
+_nst_io_start(nst_io_t *io) {
+    pthread_t  thread;
+    int        i;
+
+    io->started = 1;
+
+    for(i = 0; i < io->threads; i++) {
+
+        if(pthread_create(&thread, NULL, _nst_io_thread, io) != 0) {
+            ha_warning("nuster io: only %d of %d threads started.\n", i, io->threads);
+
+            io->threads = i;
+
+            break;
+        }
+
+        pthread_detach(thread);
+    }
+}
+
+int
+nst_io_init(nst_io_t *io, nst_core_t *core, int threads) {
+    int  i;
+
+    for(i = 0; i < NST_IO_JOBS; i++) {
+        io->job[i].next   = NULL;
+        io->job[i].core   = core;
+        io->job[i].type   = i;
+        io->job[i].count  = 0;
+        io->job[i].queued = 0;
+    }
+
+#ifndef USE_THREAD
+    /* THREAD_LOCAL data would be shared with the main thread, run in place */
+    threads = 0;
+#endif
+
+    io->head    = NULL;
+    io->tail    = NULL;
+    io->threads = threads;
+    io->started = 0;
+
+    if(pthread_mutex_init(&io->mutex, NULL) || pthread_cond_init(&io->cond, NULL)) {
+        return NST_ERR;
+    }
+
+    return NST_OK;
+}
+
+/*
+ * called by the poll loop, only queues the job if it is not already queued
+ */
+void
+nst_io_submit(nst_io_t *io, int type, int count) {
+    nst_io_job_t  *job = &io->job[type];
+
+    if(__atomic_load_n(&job->queued, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    if(!io->started) {
+        _nst_io_start(io);
+    }
+
+    job->next  = NULL;
+    job->count = count;
+
+    /* no thread at all, run it in place rather than never */
+    if(!io->threads) {
+        _nst_io_run(job);
+
+        return;
+    }
+
+    job->queued = 1;
+
+    pthread_mutex_lock(&io->mutex);
+
+    if(io->tail) {
+        io->tail->next = job;
+    } else {
+        io->head = job;
+    }
+
+    io->tail = job;
+
+    pthread_cond_signal(&io->cond);
+    pthread_mutex_unlock(&io->mutex);
+}
@@ -0,0 +1,691 @@
+/*
+ * nuster store disk log engine functions.
+ *
+ * Copyright (C) Jiang Wenyuan, < koubunen AT gmail DOT com >
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <sys/syscall.h>
+#include <sys/mman.h>
+
+#include <import/xxhash.h>
+
+#include <haproxy/tools.h>
+#include <haproxy/global.h>
+
+#include <nuster/nuster.h>
+
+#if defined(__linux__) && defined(__NR_copy_file_range)
+#define NST_DISK_LOG_USE_COPY_FILE_RANGE
+#endif
+
+
+static uint64_t
+_nst_disk_log_checksum(char *p, int len) {
+    return XXH64(p, len, NST_DISK_LOG_MAGIC);
+}
+
+static nst_disk_segment_t *
+_nst_disk_log_segment(nst_disk_t *disk, char *file) {
+    long  id = strtol(file + disk->root.len + 5, NULL, 16);
+
+    if(id < 0 || id >= NST_DISK_LOG_SEGMENTS) {
+        return NULL;
+    }
+
+    return &disk->log->segment[id];
+}
+
+static void
+_nst_disk_log_record_init(char *p, uint64_t len, uint64_t hash, uint32_t state) {
+    memset(p, 0, NST_DISK_LOG_RECORD_SIZE);
+
+    *(uint32_t *)(p)                                 = NST_DISK_LOG_MAGIC;
+    *(uint32_t *)(p + NST_DISK_LOG_RECORD_POS_STATE) = state;
+    *(uint64_t *)(p + NST_DISK_LOG_RECORD_POS_LEN)   = len;
+    *(uint64_t *)(p + NST_DISK_LOG_RECORD_POS_HASH)  = hash;
+
+    *(uint64_t *)(p + NST_DISK_LOG_RECORD_POS_CHECK) =
+        _nst_disk_log_checksum(p + NST_DISK_LOG_RECORD_POS_LEN, 16);
+}
+
+static int
+_nst_disk_log_record_check(char *p) {
+
+    if(*(uint32_t *)p != NST_DISK_LOG_MAGIC) {
+        return NST_ERR;
+    }
+
+    if(*(uint64_t *)(p + NST_DISK_LOG_RECORD_POS_CHECK)
+            != _nst_disk_log_checksum(p + NST_DISK_LOG_RECORD_POS_LEN, 16)) {
+
+        return NST_ERR;
+    }
+
+    return NST_OK;
+}
+
+static int
+_nst_disk_log_header_check(char *p, uint64_t id) {
+
+    if(memcmp(p, "NUSTLOG", 8) != 0) {
+        return NST_ERR;
+    }
+
+    if(*(uint32_t *)(p + NST_DISK_LOG_HEADER_POS_VERSION) != NST_DISK_LOG_VERSION) {
+        return NST_ERR;
+    }
+
+    if(*(uint64_t *)(p + NST_DISK_LOG_HEADER_POS_ID) != id) {
+        return NST_ERR;
+    }
+
+    if(*(uint64_t *)(p + NST_DISK_LOG_HEADER_POS_CHECK)
+            != _nst_disk_log_checksum(p, NST_DISK_LOG_HEADER_POS_CHECK)) {
+
+        return NST_ERR;
+    }
+
+    return NST_OK;
+}
+
+/*
+ * copies len bytes between two files, in the kernel when possible
+ */
+static int
+_nst_disk_log_copy(int in, uint64_t in_offset, int out, uint64_t out_offset, uint64_t len) {
+    hpx_buffer_t  *buf;
+    int64_t        src = in_offset, dst = out_offset;
+    ssize_t        ret;
+
+#ifdef NST_DISK_LOG_USE_COPY_FILE_RANGE
+    while(len) {
+        ret = syscall(__NR_copy_file_range, in, &src, out, &dst, len, 0);
+
+        if(ret <= 0) {
+            break;
+        }
+
+        len -= ret;
+    }
+#endif
+
+    /* unsupported by the filesystem or the kernel */
+    buf = get_trash_chunk();
+
+    while(len) {
+        ret = pread(in, buf->area, len < buf->size ? len : buf->size, src);
+
+        if(ret <= 0) {
+            return NST_ERR;
+        }
+
+        if(pwrite(out, buf->area, ret, dst) != ret) {
+            return NST_ERR;
+        }
+
+        src += ret;
+        dst += ret;
+        len -= ret;
+    }
+
+    return NST_OK;
+}
+
+/*
+ * creates a segment in a free slot, the log must be locked
+ */
+static int
+_nst_disk_log_create(nst_disk_t *disk) {
+    nst_disk_segment_t  *seg = NULL;
+    char                 header[NST_DISK_LOG_HEADER_SIZE];
+    char                *tmp;
+    int                  id, fd, ok;
+
+    for(id = 0; id < NST_DISK_LOG_SEGMENTS; id++) {
+
+        if(disk->log->segment[id].state == NST_DISK_SEGMENT_FREE) {
+            seg = &disk->log->segment[id];
+
+            break;
+        }
+    }
+
+    if(!seg) {
+        return -1;
+    }
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, "NUSTLOG", 8);
+
+    *(uint32_t *)(header + NST_DISK_LOG_HEADER_POS_VERSION) = NST_DISK_LOG_VERSION;
+    *(uint64_t *)(header + NST_DISK_LOG_HEADER_POS_ID)      = id;
+    *(uint64_t *)(header + NST_DISK_LOG_HEADER_POS_CTIME)   = nst_time_now_ms();
+    *(uint64_t *)(header + NST_DISK_LOG_HEADER_POS_CHECK)   =
+        _nst_disk_log_checksum(header, NST_DISK_LOG_HEADER_POS_CHECK);
+
+    tmp = get_trash_chunk()->area;
+
+    sprintf(tmp, "%s/.tmp/segment-%08x", disk->root.ptr, id);
+
+    fd = open(tmp, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+
+    if(fd == -1) {
+        return -1;
+    }
+
+    ok = pwrite(fd, header, sizeof(header), 0) == sizeof(header) && fsync(fd) == 0;
+
+    close(fd);
+
+    if(!ok || rename(tmp, seg->file) != 0) {
+        remove(tmp);
+
+        return -1;
+    }
+
+    seg->size    = NST_DISK_LOG_HEADER_SIZE;
+    seg->invalid = 0;
+    seg->state   = NST_DISK_SEGMENT_ACTIVE;
+
+    return id;
+}
+
+/*
+ * reserves len bytes at the end of the active segment, which is sealed and
+ * replaced by a new one once full. Returns the segment id, or -1.
+ */
+static int
+_nst_disk_log_reserve(nst_disk_t *disk, uint64_t len, uint64_t *offset) {
+    nst_disk_log_t      *log = disk->log;
+    nst_disk_segment_t  *seg;
+    int                  id;
+
+    nst_shctx_lock(log);
+
+    id = log->active;
+
+    if(id != -1) {
+        seg = &log->segment[id];
+
+        if(seg->size > NST_DISK_LOG_HEADER_SIZE
+                && seg->size + len > NST_DISK_LOG_SEGMENT_SIZE) {
+
+            seg->state = NST_DISK_SEGMENT_SEALED;
+            id         = -1;
+        }
+    }
+
+    if(id == -1) {
+        id = _nst_disk_log_create(disk);
+
+        log->active = id;
+    }
+
+    if(id != -1) {
+        seg = &log->segment[id];
+
+        *offset    = seg->size;
+        seg->size += len;
+    }
+
+    nst_shctx_unlock(log);
+
+    return id;
+}
+
+static void
+_nst_disk_log_mark_dead(int fd, uint64_t base) {
+    uint32_t  state = NST_DISK_LOG_RECORD_DEAD;
+
+    pwrite(fd, &state, 4, base - NST_DISK_LOG_RECORD_SIZE + NST_DISK_LOG_RECORD_POS_STATE);
+}
+
+int
+nst_disk_log_init(nst_disk_t *disk) {
+    nst_disk_log_t  *log;
+    char            *file;
+    int              len, i;
+
+    len = nst_disk_path_segment_len(disk->root) + 1;
+
+    /* larger than a shmem block, shared with the workers as well */
+    log = mmap(NULL, sizeof(*log) + len * NST_DISK_LOG_SEGMENTS, PROT_READ | PROT_WRITE,
+            MAP_ANON | MAP_SHARED, -1, 0);
+
+    if(log == MAP_FAILED) {
+        return NST_ERR;
+    }
+
+    file = (char *)(log + 1);
+
+    if(nst_shctx_init(log) != NST_OK) {
+        return NST_ERR;
+    }
+
+    log->active = -1;
+
+    sprintf(file, "%s/log", disk->root.ptr);
+
+    if(nst_disk_mkdir(file) != NST_OK) {
+        fprintf(stderr, "Create `%s` failed\n", file);
+
+        return NST_ERR;
+    }
+
+    for(i = 0; i < NST_DISK_LOG_SEGMENTS; i++) {
+        log->segment[i].file = file + i * len;
+
+        sprintf(log->segment[i].file, "%s/log/%08x", disk->root.ptr, i);
+
+        /* not appended to before it is loaded */
+        if(access(log->segment[i].file, F_OK) == 0) {
+            log->segment[i].state = NST_DISK_SEGMENT_SEALED;
+        }
+    }
+
+    disk->log = log;
+
+    return NST_OK;
+}
+
+/*
+ * loads one segment per call, its records are checked in order and the
+ * segment is truncated at the first incomplete one
+ */
+void
+nst_disk_log_load(nst_core_t *core) {
+    nst_disk_t          *disk = &core->store.disk;
+    nst_disk_segment_t  *seg;
+    nst_disk_obj_t       obj  = { .base = 0 };
+    char                 header[NST_DISK_LOG_HEADER_SIZE];
+    char                 record[NST_DISK_LOG_RECORD_SIZE];
+    struct stat          st;
+    uint64_t             offset, len;
+
+    if(!core->root.len || disk->loaded) {
+        return;
+    }
+
+    if(disk->idx == NST_DISK_LOG_SEGMENTS) {
+        disk->loaded = 1;
+        disk->idx    = 0;
+
+        return;
+    }
+
+    seg = &disk->log->segment[disk->idx];
+
+    if(seg->state != NST_DISK_SEGMENT_SEALED) {
+        disk->idx++;
+
+        return;
+    }
+
+    obj.file = seg->file;
+    obj.fd   = open(seg->file, O_RDWR);
+
+    if(obj.fd == -1) {
+        goto free;
+    }
+
+    if(fstat(obj.fd, &st) != 0
+            || pread(obj.fd, header, sizeof(header), 0) != sizeof(header)
+            || _nst_disk_log_header_check(header, disk->idx) != NST_OK) {
+
+        close(obj.fd);
+        remove(seg->file);
+
+        goto free;
+    }
+
+    offset       = NST_DISK_LOG_HEADER_SIZE;
+    seg->invalid = 0;
+
+    while(offset + NST_DISK_LOG_RECORD_SIZE <= st.st_size) {
+
+        if(pread(obj.fd, record, sizeof(record), offset) != sizeof(record)
+                || _nst_disk_log_record_check(record) != NST_OK) {
+
+            break;
+        }
+
+        len = *(uint64_t *)(record + NST_DISK_LOG_RECORD_POS_LEN);
+
+        if(offset + NST_DISK_LOG_RECORD_SIZE + len > st.st_size) {
+            break;
+        }
+
+        obj.base = offset + NST_DISK_LOG_RECORD_SIZE;
+        obj.size = NST_DISK_LOG_RECORD_SIZE + len;
+
+        if(*(uint32_t *)(record + NST_DISK_LOG_RECORD_POS_STATE) != NST_DISK_LOG_RECORD_LIVE
+                || nst_disk_obj_load(core, &obj, NULL) != NST_OK) {
+
+            seg->invalid += obj.size;
+        }
+
+        offset += obj.size;
+    }
+
+    /* drop an incomplete tail */
+    if(offset < st.st_size && ftruncate(obj.fd, offset) != 0) {
+        offset = st.st_size;
+    }
+
+    close(obj.fd);
+
+    seg->size = offset;
+    disk->idx++;
+
+    return;
+
+free:
+    seg->size  = 0;
+    seg->state = NST_DISK_SEGMENT_FREE;
+    disk->idx++;
+}
+
+/*
+ * appends the temp file of a finished object to the active segment, the
+ * object is copied first and its record header written last
+ */
+int
+nst_disk_log_append(nst_disk_t *disk, nst_disk_obj_t *obj) {
+    nst_disk_segment_t  *seg = NULL;
+    char                 record[NST_DISK_LOG_RECORD_SIZE];
+    struct stat          st;
+    uint64_t             offset = 0, len = 0;
+    int                  id, fd = -1;
+
+    if(fstat(obj->fd, &st) != 0) {
+        goto err;
+    }
+
+    len = st.st_size;
+    id  = _nst_disk_log_reserve(disk, NST_DISK_LOG_RECORD_SIZE + len, &offset);
+
+    if(id == -1) {
+        goto err;
+    }
+
+    seg = &disk->log->segment[id];
+    fd  = open(seg->file, O_WRONLY);
+
+    if(fd == -1) {
+        goto err;
+    }
+
+    if(_nst_disk_log_copy(obj->fd, 0, fd, offset + NST_DISK_LOG_RECORD_SIZE, len) != NST_OK) {
+        goto err;
+    }
+
+    _nst_disk_log_record_init(record, len, nst_disk_meta_get_hash(obj->meta),
+            NST_DISK_LOG_RECORD_LIVE);
+
+    if(pwrite(fd, record, sizeof(record), offset) != sizeof(record)) {
+        goto err;
+    }
+
+    nst_disk_obj_sync(disk, fd);
+
+    close(fd);
+    close(obj->fd);
+    obj->fd = -1;
+
+    remove(obj->file);
+    nst_shmem_free(disk->shmem, obj->file);
+
+    obj->file = seg->file;
+    obj->base = offset + NST_DISK_LOG_RECORD_SIZE;
+    obj->size = NST_DISK_LOG_RECORD_SIZE + len;
+
+    return NST_OK;
+
+err:
+
+    if(seg) {
+
+        /* a dead record keeps the rest of the segment readable */
+        if(fd != -1) {
+            _nst_disk_log_record_init(record, len, 0, NST_DISK_LOG_RECORD_DEAD);
+            pwrite(fd, record, sizeof(record), offset);
+            close(fd);
+        }
+
+        __sync_add_and_fetch(&seg->invalid, NST_DISK_LOG_RECORD_SIZE + len);
+    }
+
+    nst_disk_obj_abort(disk, obj);
+
+    return NST_ERR;
+}
+
+void
+nst_disk_log_release(nst_disk_t *disk, char *file, uint64_t size) {
+    nst_disk_segment_t  *seg = _nst_disk_log_segment(disk, file);
+
+    if(seg) {
+        __sync_add_and_fetch(&seg->invalid, size);
+    }
+}
+
+void
+nst_disk_log_remove(nst_disk_t *disk, char *file, uint64_t base, uint64_t size) {
+    int  fd;
+
+    fd = open(file, O_WRONLY);
+
+    if(fd != -1) {
+        _nst_disk_log_mark_dead(fd, base);
+        close(fd);
+    }
+
+    nst_disk_log_release(disk, file, size);
+}
+
+/*
+ * moves a live record of a segment being compacted to the active segment,
+ * unless no entry refers to it anymore
+ */
+static int
+_nst_disk_log_move(nst_core_t *core, nst_disk_obj_t *obj, uint64_t *moved) {
+    nst_disk_t          *disk = &core->store.disk;
+    nst_dict_entry_t    *entry;
+    nst_disk_segment_t  *seg;
+    nst_key_t            key;
+    char                 record[NST_DISK_LOG_RECORD_SIZE];
+    uint64_t             offset, len, base;
+    int                  id, fd, ret = NST_ERR;
+
+    if(nst_disk_read_meta(obj) != NST_OK) {
+        return NST_OK;
+    }
+
+    if(nst_disk_read_key(disk, obj, &key) != NST_OK) {
+        return NST_ERR;
+    }
+
+    nst_dict_lock(&core->dict, key.hash);
+
+    entry = nst_dict_get_disk(&core->dict, &key, obj->file, obj->base);
+
+    nst_dict_unlock(&core->dict, key.hash);
+
+    if(!entry) {
+        ret = NST_OK;
+
+        goto out;
+    }
+
+    len = obj->size - NST_DISK_LOG_RECORD_SIZE;
+    id  = _nst_disk_log_reserve(disk, obj->size, &offset);
+
+    if(id == -1) {
+        goto out;
+    }
+
+    seg  = &disk->log->segment[id];
+    base = offset + NST_DISK_LOG_RECORD_SIZE;
+    fd   = open(seg->file, O_WRONLY);
+
+    if(fd == -1) {
+        __sync_add_and_fetch(&seg->invalid, obj->size);
+
+        goto out;
+    }
+
+    _nst_disk_log_record_init(record, len, key.hash, NST_DISK_LOG_RECORD_LIVE);
+
+    if(_nst_disk_log_copy(obj->fd, obj->base, fd, base, len) != NST_OK
+            || pwrite(fd, record, sizeof(record), offset) != sizeof(record)) {
+
+        _nst_disk_log_record_init(record, len, 0, NST_DISK_LOG_RECORD_DEAD);
+        pwrite(fd, record, sizeof(record), offset);
+        close(fd);
+
+        __sync_add_and_fetch(&seg->invalid, obj->size);
+
+        goto out;
+    }
+
+    nst_dict_lock(&core->dict, key.hash);
+
+    entry = nst_dict_get_disk(&core->dict, &key, obj->file, obj->base);
+
+    if(entry) {
+        entry->store.disk.file = seg->file;
+        entry->store.disk.base = base;
+
+        /* extended while copied */
+        if(entry->expire != nst_disk_meta_get_expire(obj->meta)) {
+            nst_disk_update_expire(entry->store.disk.file, base, entry->expire);
+        }
+    }
+
+    nst_dict_unlock(&core->dict, key.hash);
+
+    if(entry) {
+        _nst_disk_log_mark_dead(obj->fd, obj->base);
+
+        *moved += obj->size;
+    } else {
+        _nst_disk_log_mark_dead(fd, base);
+
+        __sync_add_and_fetch(&seg->invalid, obj->size);
+    }
+
+    close(fd);
+
+    ret = NST_OK;
+
+out:
+    nst_shmem_free(disk->shmem, key.data);
+
+    return ret;
+}
+
+/*
+ * compacts the sealed segment with the highest ratio of dead bytes, if above
+ * NST_DISK_LOG_COMPACT_RATIO: the records still referred to by the dict are
+ * moved to the active segment, then the segment is removed
+ */
+void
+nst_disk_log_compact(nst_core_t *core) {
+    nst_disk_t          *disk = &core->store.disk;
+    nst_disk_log_t      *log  = disk->log;
+    nst_disk_segment_t  *seg  = NULL, *s;
+    nst_disk_obj_t       obj  = { .base = 0 };
+    char                 record[NST_DISK_LOG_RECORD_SIZE];
+    uint64_t             offset, moved = 0;
+    int                  i;
+
+    if(!core->root.len || !disk->loaded) {
+        return;
+    }
+
+    nst_shctx_lock(log);
+
+    for(i = 0; i < NST_DISK_LOG_SEGMENTS; i++) {
+        s = &log->segment[i];
+
+        if(s->state != NST_DISK_SEGMENT_SEALED) {
+            continue;
+        }
+
+        if(s->invalid * 100 < s->size * NST_DISK_LOG_COMPACT_RATIO) {
+            continue;
+        }
+
+        if(!seg || s->invalid * seg->size > seg->invalid * s->size) {
+            seg = s;
+        }
+    }
+
+    if(seg) {
+        seg->state = NST_DISK_SEGMENT_COMPACTING;
+    }
+
+    nst_shctx_unlock(log);
+
+    if(!seg) {
+        return;
+    }
+
+    obj.file = seg->file;
+    obj.fd   = open(seg->file, O_RDWR);
+
+    if(obj.fd != -1) {
+        offset = NST_DISK_LOG_HEADER_SIZE;
+
+        while(offset + NST_DISK_LOG_RECORD_SIZE <= seg->size) {
+
+            if(pread(obj.fd, record, sizeof(record), offset) != sizeof(record)
+                    || _nst_disk_log_record_check(record) != NST_OK) {
+
+                break;
+            }
+
+            obj.base = offset + NST_DISK_LOG_RECORD_SIZE;
+            obj.size = NST_DISK_LOG_RECORD_SIZE
+                + *(uint64_t *)(record + NST_DISK_LOG_RECORD_POS_LEN);
+
+            offset += obj.size;
+
+            if(*(uint32_t *)(record + NST_DISK_LOG_RECORD_POS_STATE) != NST_DISK_LOG_RECORD_LIVE) {
+                continue;
+            }
+
+            /* retried by a later pass */
+            if(_nst_disk_log_move(core, &obj, &moved) != NST_OK) {
+                close(obj.fd);
+
+                nst_shctx_lock(log);
+                seg->state = NST_DISK_SEGMENT_SEALED;
+                nst_shctx_unlock(log);
+
+                return;
+            }
+        }
+
+        close(obj.fd);
+    }
+
+    /* removed before the slot can be reused */
+    remove(seg->file);
+
+    nst_shctx_lock(log);
+
+    log->compacted += seg->size > moved ? seg->size - moved : 0;
+
+    seg->size    = 0;
+    seg->invalid = 0;
+    seg->state   = NST_DISK_SEGMENT_FREE;
+
+    nst_shctx_unlock(log);
+}
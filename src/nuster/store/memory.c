@@ -22,18 +22,70 @@ nst_memory_init(nst_memory_t *mem, nst_shmem_t *shmem) {
     mem->tail    = NULL;
     mem->count   = 0;
     mem->invalid = 0;
+    mem->evicted = 0;
+    mem->dict    = NULL;
 
     return nst_shctx_init(mem);
 }
 
+static inline uint32_t
+_nst_memory_item_blksz(nst_memory_item_t *item) {
+    hpx_htx_blk_type_t  type = (item->info >> 28);
+
+    if(type == HTX_BLK_HDR || type == HTX_BLK_TLR) {
+        return (item->info & 0xff) + ((item->info >> 8) & 0xfffff);
+    }
+
+    return item->info & 0xfffffff;
+}
+
+/* size of an item in a packed object, items are 8 bytes aligned */
+static inline uint32_t
+_nst_memory_item_packsz(uint32_t len) {
+    return (sizeof(nst_memory_item_t) + len + 7) & ~7;
+}
+
+/*
+ * free the items of an object, returns the number of bytes freed
+ */
+static uint64_t
+_nst_memory_obj_free_items(nst_memory_t *mem, nst_memory_obj_t *obj) {
+    nst_memory_item_t  *item, *tmp;
+    uint64_t            freed = 0;
+
+    item      = obj->item;
+    obj->item = NULL;
+
+    if(obj->packed) {
+
+        for(tmp = item; tmp; tmp = tmp->next) {
+            freed += sizeof(*tmp) + _nst_memory_item_blksz(tmp);
+        }
+
+        if(item) {
+            nst_shmem_free(mem->shmem, item);
+        }
+
+        return freed;
+    }
+
+    while(item) {
+        tmp    = item;
+        item   = item->next;
+        freed += sizeof(*tmp) + _nst_memory_item_blksz(tmp);
+
+        nst_shmem_free(mem->shmem, tmp);
+    }
+
+    return freed;
+}
+
 /*
  * free invalid nst_memory_object
  */
 void
 nst_memory_cleanup(nst_memory_t *mem) {
-    nst_memory_obj_t   *obj  = NULL;
-    nst_memory_item_t  *item = NULL;
-    nst_memory_item_t  *tmp;
+    nst_memory_obj_t  *obj = NULL;
 
     nst_shctx_lock(mem);
 
@@ -63,14 +115,7 @@ nst_memory_cleanup(nst_memory_t *mem) {
     }
 
     if(obj) {
-        item = obj->item;
-
-        while(item) {
-            tmp  = item;
-            item = item->next;
-
-            nst_shmem_free(mem->shmem, tmp);
-        }
+        _nst_memory_obj_free_items(mem, obj);
 
         nst_shmem_free(mem->shmem, obj);
 
@@ -81,12 +126,28 @@ nst_memory_cleanup(nst_memory_t *mem) {
     nst_shctx_unlock(mem);
 }
 
+/*
+ * evict cold objects and retry once if the memory zone is full
+ */
+void *
+nst_memory_alloc(nst_memory_t *mem, int size) {
+    void  *p;
+
+    p = nst_shmem_alloc(mem->shmem, size);
+
+    if(!p && mem->dict && nst_dict_evict(mem->dict, mem->shmem->block_size)) {
+        p = nst_shmem_alloc(mem->shmem, size);
+    }
+
+    return p;
+}
+
 /*
  * create a new nst_memory_object and insert it to nst_memory list
  */
 nst_memory_obj_t *
 nst_memory_obj_create(nst_memory_t *mem) {
-    nst_memory_obj_t  *obj = nst_shmem_alloc(mem->shmem, sizeof(*obj));
+    nst_memory_obj_t  *obj = nst_memory_alloc(mem, sizeof(*obj));
 
     if(obj) {
         memset(obj, 0, sizeof(*obj));
@@ -118,16 +179,64 @@ nst_memory_obj_create(nst_memory_t *mem) {
     return obj;
 }
 
+/*
+ * move the items staged in pack to the chain of obj, once the object turns
+ * out to be too big to be packed
+ */
+static int
+_nst_memory_obj_unpack(nst_memory_t *mem, nst_memory_obj_t *obj, nst_memory_item_t **tail,
+        hpx_buffer_t *pack) {
+
+    nst_memory_item_t  *item;
+    uint32_t            offset, blksz;
+    int                 ret = NST_OK;
+
+    for(offset = 0; offset < pack->data && ret == NST_OK; offset += _nst_memory_item_packsz(blksz)) {
+        item  = (nst_memory_item_t *)(pack->area + offset);
+        blksz = _nst_memory_item_blksz(item);
+        ret   = nst_memory_obj_append(mem, obj, tail, NULL, item->data, blksz, item->info);
+    }
+
+    nst_memory_pack_free(pack);
+
+    return ret;
+}
+
+/*
+ * append a htx block to obj, it is staged in pack if pack is not NULL and
+ * has been initialized, and allocated from the memory zone otherwise
+ */
 int
 nst_memory_obj_append(nst_memory_t *mem, nst_memory_obj_t *obj, nst_memory_item_t **tail,
-        const char *buf, uint32_t len, uint32_t info) {
+        hpx_buffer_t *pack, const char *buf, uint32_t len, uint32_t info) {
 
     nst_memory_item_t  *item;
+    uint32_t            size;
 
     if(obj->invalid) {
         return NST_ERR;
     }
 
+    if(pack && pack->area) {
+        size = _nst_memory_item_packsz(len);
+
+        if(pack->data + size <= pack->size) {
+            item = (nst_memory_item_t *)(pack->area + pack->data);
+
+            memcpy(item->data, buf, len);
+
+            item->info  = info;
+            item->next  = NULL;
+            pack->data += size;
+
+            return NST_OK;
+        }
+
+        if(_nst_memory_obj_unpack(mem, obj, tail, pack) != NST_OK) {
+            return NST_ERR;
+        }
+    }
+
     item = nst_memory_alloc_item(mem, len);
 
     if(!item) {
@@ -143,10 +252,11 @@ nst_memory_obj_append(nst_memory_t *mem, nst_memory_obj_t *obj, nst_memory_item_
     item->info = info;
     item->next = NULL;
 
+    /* followers may read it as soon as it is linked */
     if(*tail) {
-        (*tail)->next = item;
+        __atomic_store_n(&(*tail)->next, item, __ATOMIC_RELEASE);
     } else {
-        obj->item = item;
+        __atomic_store_n(&obj->item, item, __ATOMIC_RELEASE);
     }
 
     *tail = item;
@@ -154,108 +264,262 @@ nst_memory_obj_append(nst_memory_t *mem, nst_memory_obj_t *obj, nst_memory_item_
     return NST_OK;
 }
 
-void
-nst_store_memory_sync_disk(nst_core_t *core) {
-    nst_dict_entry_t   *entry;
-    nst_disk_obj_t      data = { .file = NULL };
+/*
+ * copy the items staged in pack to a single chunk, so that the object is
+ * allocated once and read sequentially
+ */
+int
+nst_memory_obj_pack(nst_memory_t *mem, nst_memory_obj_t *obj, hpx_buffer_t *pack) {
+    nst_memory_item_t  *item;
+    uint32_t            offset, size;
+    char               *p;
+
+    if(!pack->area) {
+        return obj->invalid ? NST_ERR : NST_OK;
+    }
+
+    p = obj->invalid || !pack->data ? NULL : nst_memory_alloc(mem, pack->data);
+
+    if(!p) {
+        nst_memory_pack_free(pack);
+
+        if(!obj->invalid) {
+            obj->invalid = 1;
+
+            nst_memory_incr_invalid(mem);
+        }
+
+        return NST_ERR;
+    }
+
+    memcpy(p, pack->area, pack->data);
+
+    for(offset = 0; offset < pack->data; offset += size) {
+        item = (nst_memory_item_t *)(p + offset);
+        size = _nst_memory_item_packsz(_nst_memory_item_blksz(item));
+
+        item->next = offset + size < pack->data ? (nst_memory_item_t *)(p + offset + size) : NULL;
+    }
+
+    obj->packed = 1;
+
+    __atomic_store_n(&obj->item, (nst_memory_item_t *)p, __ATOMIC_RELEASE);
+
+    nst_memory_pack_free(pack);
+
+    return NST_OK;
+}
+
+/*
+ * invalidate an object which has been removed from dict, its items are freed
+ * at once unless it is being used, returns the number of bytes freed
+ */
+uint64_t
+nst_memory_obj_evict(nst_memory_t *mem, nst_memory_obj_t *obj) {
+    uint64_t  freed = 0;
+
+    nst_shctx_lock(mem);
+
+    obj->invalid = 1;
+
+    mem->invalid++;
+    mem->evicted++;
+
+    if(!obj->clients) {
+        freed = _nst_memory_obj_free_items(mem, obj);
+    }
+
+    nst_shctx_unlock(mem);
+
+    return freed;
+}
+
+/*
+ * write obj of a pinned entry to a new disk object
+ */
+static int
+_nst_store_memory_write(nst_core_t *core, nst_dict_entry_t *entry, nst_memory_obj_t *obj,
+        uint64_t expire, nst_disk_obj_t *data) {
+
     nst_memory_item_t  *item;
     nst_http_txn_t      txn;
     hpx_htx_blk_type_t  type;
-    uint64_t            start;
     uint32_t            blksz, info;
-    int                 ret;
 
+    txn.req.host          = entry->host;
+    txn.req.path          = entry->path;
+    txn.res.etag          = entry->etag;
+    txn.res.last_modified = entry->last_modified;
+    txn.res.header_len    = 0;
+    txn.res.payload_len   = 0;
+
+    if(nst_disk_obj_create(&core->store.disk, data, &entry->key, &txn, &entry->prop) != NST_OK) {
+        return NST_ERR;
+    }
+
+    item = obj->item;
+
+    while(item) {
+        info  = item->info;
+        type  = (info >> 28);
+        blksz = _nst_memory_item_blksz(item);
+
+        if(type == HTX_BLK_RES_SL || type == HTX_BLK_HDR || type == HTX_BLK_EOH) {
+            txn.res.header_len += 4 + blksz;
+        }
+
+        if(type == HTX_BLK_DATA) {
+            txn.res.payload_len += blksz;
+        }
+
+        if(type != HTX_BLK_DATA) {
+
+            if(nst_disk_obj_append(&core->store.disk, data, (char *)&info, 4) != NST_OK) {
+                return NST_ERR;
+            }
+        }
+
+        if(nst_disk_obj_append(&core->store.disk, data, item->data, blksz) != NST_OK) {
+            return NST_ERR;
+        }
+
+        item = item->next;
+    }
+
+    return nst_disk_obj_finish(&core->store.disk, data, &entry->key, &txn, expire);
+}
+
+/*
+ * Save the disk sync entries of one dict slot. The entries and their memory
+ * objects are pinned under the lock, written without it, then the files are
+ * published under the lock again, unless the entry changed meanwhile.
+ */
+void
+nst_store_memory_sync_disk(nst_core_t *core) {
+    nst_dict_t         *dict = &core->dict;
+    nst_dict_entry_t   *entry;
+    nst_dict_entry_t   *batch[NST_STORE_SYNC_BATCH];
+    nst_memory_obj_t   *obj[NST_STORE_SYNC_BATCH];
+    uint64_t            expire[NST_STORE_SYNC_BATCH];
+    nst_disk_obj_t      data[NST_STORE_SYNC_BATCH];
+    uint64_t            start, held, saved = 0;
+    uint64_t            idx, slots;
+    int                 i, n = 0;
 
     if(!core->root.len || !core->store.disk.loaded) {
         return;
     }
 
-    if(!core->dict.used) {
+    if(!dict->used) {
         return;
     }
 
-    start = nst_time_now_ms();
+    start = nst_time_now_us();
+
+    /* the saver runs on an io thread, tables may be switched meanwhile */
+    idx = dict->sync_idx;
 
-    nst_shctx_lock(&core->dict);
+    nst_dict_lock(dict, idx);
 
-    entry = core->dict.entry[core->dict.sync_idx];
+    slots = nst_dict_slots(dict);
 
-    while(entry) {
+    /* slots changed as the dict was resized, start over */
+    if(dict->sync_version != dict->rehash.version || idx >= slots) {
+        nst_dict_unlock(dict, idx);
+
+        dict->sync_version = dict->rehash.version;
+        dict->sync_idx     = 0;
+
+        return;
+    }
+
+    entry = *nst_dict_slot(dict, idx);
+
+    while(entry && n < NST_STORE_SYNC_BATCH) {
 
         if(nst_dict_entry_valid(entry)
                 && nst_store_disk_sync(entry->prop.store)
-                && entry->store.disk.file == NULL) {
+                && entry->store.disk.file == NULL
+                && entry->store.memory.obj
+                && !entry->pinned) {
 
-            txn.req.host          = entry->host;
-            txn.req.path          = entry->path;
-            txn.res.etag          = entry->etag;
-            txn.res.last_modified = entry->last_modified;
-            txn.res.header_len    = 0;
-            txn.res.payload_len   = 0;
+            nst_memory_obj_attach(&core->store.memory, entry->store.memory.obj);
 
-            ret = nst_disk_obj_create(&core->store.disk, &data, &entry->key, &txn, &entry->prop);
+            entry->pinned = 1;
 
-            if(ret != NST_OK) {
-                goto next;
-            }
+            batch[n]  = entry;
+            obj[n]    = entry->store.memory.obj;
+            expire[n] = entry->expire;
+            n++;
+        }
+
+        entry = entry->next;
+    }
+
+    nst_dict_unlock(dict, idx);
 
-            entry->store.disk.file = data.file;
+    held = nst_time_now_us() - start;
+
+    /* the rest of the slot is saved by the next call */
+    if(entry == NULL) {
+        idx++;
+    }
 
-            item = entry->store.memory.obj->item;
+    /* if we have checked the whole dict */
+    if(idx >= slots) {
+        idx = 0;
+    }
 
-            while(item) {
-                info  = item->info;
-                type  = (info >> 28);
-                blksz = ((type == HTX_BLK_HDR || type == HTX_BLK_TLR)
-                        ? (info & 0xff) + ((info >> 8) & 0xfffff)
-                        : info & 0xfffffff);
+    dict->sync_idx = idx;
 
-                if(type == HTX_BLK_RES_SL || type == HTX_BLK_HDR || type == HTX_BLK_EOH) {
-                    txn.res.header_len += 4 + blksz;
-                }
+    for(i = 0; i < n; i++) {
 
-                if(type == HTX_BLK_DATA) {
-                    txn.res.payload_len += blksz;
-                }
+        if(_nst_store_memory_write(core, batch[i], obj[i], expire[i], &data[i]) != NST_OK) {
+            data[i].file = NULL;
+        }
+    }
 
-                if(type != HTX_BLK_DATA) {
-                    ret = nst_disk_obj_append(&core->store.disk, &data, (char *)&info, 4);
+    for(i = 0; i < n; i++) {
+        entry = batch[i];
+        start = nst_time_now_us();
 
-                    if(ret != NST_OK) {
-                        goto next;
-                    }
+        nst_dict_lock(dict, entry->key.hash);
 
-                }
+        if(data[i].file && entry->store.disk.file == NULL
+                && nst_dict_entry_valid(entry) && entry->store.memory.obj == obj[i]) {
 
-                ret = nst_disk_obj_append(&core->store.disk, &data, item->data, blksz);
+            nst_dict_entry_set_disk(dict, entry, &data[i]);
 
-                if(ret != NST_OK) {
-                    goto next;
-                }
+            data[i].file = NULL;
 
-                item = item->next;
+            /* extended meanwhile */
+            if(entry->expire != expire[i]) {
+                nst_disk_update_expire(entry->store.disk.file, entry->store.disk.base,
+                        entry->expire);
             }
 
-            nst_disk_obj_finish(&core->store.disk, &data, &entry->key, &txn, entry->expire);
+            saved++;
+        } else if(data[i].file && (entry->store.disk.file == NULL
+                    || core->store.disk.engine == NST_DISK_ENGINE_LOG)) {
+
+            /* otherwise the file engine wrote to the entry's file */
+            nst_disk_obj_remove(&core->store.disk, data[i].file, data[i].base, data[i].size);
         }
-next:
 
-        entry = entry->next;
+        entry->pinned = 0;
 
-        if(nst_time_now_ms() - start >= 10) {
-            break;
-        }
-    }
+        nst_dict_unlock(dict, entry->key.hash);
 
-    if(entry == NULL) {
-        core->dict.sync_idx++;
-    }
+        held += nst_time_now_us() - start;
 
-    /* if we have checked the whole dict */
-    if(core->dict.sync_idx == core->dict.size) {
-        core->dict.sync_idx = 0;
+        nst_memory_obj_detach(&core->store.memory, obj[i]);
+
+        if(data[i].file) {
+            nst_disk_file_free(&core->store.disk, data[i].file);
+        }
     }
 
-    nst_shctx_unlock(&core->dict);
+    __sync_add_and_fetch(&dict->sync_lock_us, held);
+    __sync_add_and_fetch(&dict->sync_saved, saved);
 }
 
@@ -0,0 +1,286 @@
+/*
+ * nuster disk page cache functions.
+ *
+ * Copyright (C) Jiang Wenyuan, < koubunen AT gmail DOT com >
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <haproxy/global.h>
+#include <haproxy/errors.h>
+
+#include <nuster/nuster.h>
+
+/* aligned buffer of the misses of a thread */
+static THREAD_LOCAL char  *_nst_pcache_buf = NULL;
+
+static inline uint64_t
+_nst_pcache_hash(nst_pcache_t *pcache, uint64_t id, uint64_t offset) {
+    uint64_t  h = id ^ (offset / NST_PCACHE_BLOCK_SIZE * 0x9E3779B97F4A7C15ULL);
+
+    return (h ^ (h >> 29)) & pcache->mask;
+}
+
+static nst_pcache_block_t *
+_nst_pcache_lookup(nst_pcache_t *pcache, uint64_t id, uint64_t offset) {
+    nst_pcache_block_t  *block = pcache->table[_nst_pcache_hash(pcache, id, offset)];
+
+    while(block) {
+
+        if(block->id == id && block->offset == offset) {
+            return block;
+        }
+
+        block = block->next;
+    }
+
+    return NULL;
+}
+
+static void
+_nst_pcache_unlink(nst_pcache_t *pcache, nst_pcache_block_t *block) {
+    nst_pcache_block_t  **prev = &pcache->table[_nst_pcache_hash(pcache, block->id, block->offset)];
+
+    while(*prev) {
+
+        if(*prev == block) {
+            *prev = block->next;
+
+            break;
+        }
+
+        prev = &(*prev)->next;
+    }
+
+    block->id   = 0;
+    block->next = NULL;
+}
+
+/*
+ * the next block without passes left, the hand takes one from the others
+ */
+static nst_pcache_block_t *
+_nst_pcache_victim(nst_pcache_t *pcache) {
+    nst_pcache_block_t  *block;
+
+    while(1) {
+        block = &pcache->block[pcache->hand];
+
+        pcache->hand = (pcache->hand + 1) % pcache->count;
+
+        if(!block->id) {
+            pcache->used++;
+
+            return block;
+        }
+
+        if(block->ref == 0) {
+            _nst_pcache_unlink(pcache, block);
+
+            return block;
+        }
+
+        block->ref--;
+    }
+}
+
+/*
+ * the more an entry is accessed, the more passes its blocks start with
+ */
+static inline int
+_nst_pcache_ref(uint64_t hits) {
+    return 1 + (hits >= 4) + (hits >= 64);
+}
+
+/*
+ * caches the blocks read at offset, only counted if the id is 0
+ */
+static void
+_nst_pcache_insert(nst_pcache_t *pcache, uint64_t id, uint64_t hits, char *data, int len,
+        uint64_t offset) {
+
+    nst_pcache_block_t  *block;
+    uint64_t             idx;
+    int                  sz;
+
+    pthread_mutex_lock(&pcache->mutex);
+
+    while(len > 0) {
+        sz = len < NST_PCACHE_BLOCK_SIZE ? len : NST_PCACHE_BLOCK_SIZE;
+
+        pcache->misses++;
+
+        if(id && !_nst_pcache_lookup(pcache, id, offset)) {
+            block = _nst_pcache_victim(pcache);
+            idx   = _nst_pcache_hash(pcache, id, offset);
+
+            block->id     = id;
+            block->offset = offset;
+            block->len    = sz;
+            block->ref    = _nst_pcache_ref(hits);
+            block->next   = pcache->table[idx];
+
+            pcache->table[idx] = block;
+
+            memcpy(block->data, data, sz);
+        }
+
+        data   += NST_PCACHE_BLOCK_SIZE;
+        offset += NST_PCACHE_BLOCK_SIZE;
+        len    -= sz;
+    }
+
+    pthread_mutex_unlock(&pcache->mutex);
+}
+
+nst_pcache_t *
+nst_pcache_create(uint64_t size) {
+    nst_pcache_t  *pcache;
+    uint64_t       i, count, buckets;
+
+    count = size / NST_PCACHE_BLOCK_SIZE;
+
+    if(count == 0) {
+        return NULL;
+    }
+
+    buckets = 1;
+
+    while(buckets < count) {
+        buckets <<= 1;
+    }
+
+    pcache = calloc(1, sizeof(*pcache));
+
+    if(!pcache) {
+        return NULL;
+    }
+
+    pcache->block = calloc(count, sizeof(*pcache->block));
+    pcache->table = calloc(buckets, sizeof(*pcache->table));
+
+    if(!pcache->block || !pcache->table
+            || posix_memalign((void **)&pcache->data, NST_PCACHE_BLOCK_SIZE,
+                count * NST_PCACHE_BLOCK_SIZE) != 0
+            || pthread_mutex_init(&pcache->mutex, NULL) != 0) {
+
+        free(pcache->block);
+        free(pcache->table);
+        free(pcache);
+
+        return NULL;
+    }
+
+    for(i = 0; i < count; i++) {
+        pcache->block[i].data = pcache->data + i * NST_PCACHE_BLOCK_SIZE;
+    }
+
+    pcache->count = count;
+    pcache->mask  = buckets - 1;
+
+    return pcache;
+}
+
+/*
+ * Reads len bytes at offset of the object id to buf, from the cached blocks
+ * or else by aligned reads which are cached, an id of 0 is read but not
+ * cached. Returns the number of bytes read, less at the end of the file, or
+ * -1 on error.
+ */
+int
+nst_pcache_read(nst_pcache_t *pcache, int fd, uint64_t id, uint64_t hits, char *buf, int len,
+        uint64_t offset) {
+
+    nst_pcache_block_t  *block;
+    uint64_t             pos, start;
+    int                  done, skip, sz, ret, n;
+
+    done = 0;
+
+    while(done < len) {
+        pos   = offset + done;
+        start = pos & ~((uint64_t)NST_PCACHE_BLOCK_SIZE - 1);
+        skip  = pos - start;
+
+        if(id) {
+            pthread_mutex_lock(&pcache->mutex);
+
+            block = _nst_pcache_lookup(pcache, id, start);
+
+            if(block) {
+                sz = block->len - skip;
+
+                if(sz > len - done) {
+                    sz = len - done;
+                }
+
+                if(sz > 0) {
+                    memcpy(buf + done, block->data + skip, sz);
+                    done += sz;
+                }
+
+                if(block->ref < NST_PCACHE_REF_MAX) {
+                    block->ref++;
+                }
+
+                pcache->hits++;
+
+                n = block->len;
+
+                pthread_mutex_unlock(&pcache->mutex);
+
+                /* the end of the file */
+                if(n < NST_PCACHE_BLOCK_SIZE && skip + sz >= n) {
+                    break;
+                }
+
+                continue;
+            }
+
+            pthread_mutex_unlock(&pcache->mutex);
+        }
+
+        if(!_nst_pcache_buf && posix_memalign((void **)&_nst_pcache_buf, NST_PCACHE_BLOCK_SIZE,
+                    NST_PCACHE_READ_BLOCKS * NST_PCACHE_BLOCK_SIZE) != 0) {
+
+            _nst_pcache_buf = NULL;
+
+            return -1;
+        }
+
+        n = (skip + len - done + NST_PCACHE_BLOCK_SIZE - 1) / NST_PCACHE_BLOCK_SIZE;
+
+        if(n > NST_PCACHE_READ_BLOCKS) {
+            n = NST_PCACHE_READ_BLOCKS;
+        }
+
+        ret = pread(fd, _nst_pcache_buf, n * NST_PCACHE_BLOCK_SIZE, start);
+
+        if(ret < 0) {
+            return -1;
+        }
+
+        _nst_pcache_insert(pcache, id, hits, _nst_pcache_buf, ret, start);
+
+        sz = ret - skip;
+
+        if(sz > len - done) {
+            sz = len - done;
+        }
+
+        if(sz > 0) {
+            memcpy(buf + done, _nst_pcache_buf + skip, sz);
+            done += sz;
+        }
+
+        if(ret < n * NST_PCACHE_BLOCK_SIZE) {
+            break;
+        }
+    }
+
+    return done;
+}
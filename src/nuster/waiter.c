@@ -0,0 +1,190 @@
+/*
+ * nuster waiter functions.
+ *
+ * Copyright (C) Jiang Wenyuan, < koubunen AT gmail DOT com >
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <haproxy/task.h>
+
+#include <nuster/nuster.h>
+
+void
+nst_waiter_init(nst_waiter_t *waiter, struct task *task) {
+    LIST_INIT(&waiter->list);
+
+    waiter->task  = task;
+    waiter->claim = 0;
+    waiter->pass  = 0;
+}
+
+nst_waiters_t *
+nst_waiters_create() {
+    nst_waiters_t  *waiters;
+    int             i;
+
+    waiters = calloc(1, sizeof(*waiters));
+
+    if(!waiters) {
+        return NULL;
+    }
+
+    if(pthread_mutex_init(&waiters->mutex, NULL) != 0) {
+        free(waiters);
+
+        return NULL;
+    }
+
+    for(i = 0; i < NST_WAITER_BUCKETS; i++) {
+        LIST_INIT(&waiters->bucket[i]);
+        LIST_INIT(&waiters->claim[i]);
+    }
+
+    return waiters;
+}
+
+/*
+ * parks the task until the hash is woken, the caller holds the dict lock of
+ * the entry so that it cannot be done before
+ */
+void
+nst_waiters_add(nst_waiters_t *waiters, nst_waiter_t *waiter, uint64_t hash) {
+
+    pthread_mutex_lock(&waiters->mutex);
+
+    if(LIST_ISEMPTY(&waiter->list)) {
+        waiter->hash = hash;
+
+        LIST_ADDQ(&waiters->bucket[hash % NST_WAITER_BUCKETS], &waiter->list);
+
+        waiters->parked++;
+    }
+
+    pthread_mutex_unlock(&waiters->mutex);
+}
+
+/*
+ * always locked, a waker may be waking the task of the waiter
+ */
+void
+nst_waiters_del(nst_waiters_t *waiters, nst_waiter_t *waiter) {
+
+    if(!waiters) {
+        return;
+    }
+
+    pthread_mutex_lock(&waiters->mutex);
+
+    LIST_DEL_INIT(&waiter->list);
+
+    pthread_mutex_unlock(&waiters->mutex);
+}
+
+static int
+_nst_waiters_wake(nst_waiters_t *waiters, uint64_t hash, int pass) {
+    nst_waiter_t  *waiter, *back;
+    int            n = 0;
+
+    list_for_each_entry_safe(waiter, back, &waiters->bucket[hash % NST_WAITER_BUCKETS], list) {
+
+        if(waiter->hash == hash) {
+            LIST_DEL_INIT(&waiter->list);
+
+            waiter->pass |= pass;
+
+            task_wakeup(waiter->task, TASK_WOKEN_MSG);
+
+            n++;
+        }
+    }
+
+    waiters->woken += n;
+
+    return n;
+}
+
+/*
+ * wakes and removes all the waiters of the hash, returns their number
+ */
+int
+nst_waiters_wake(nst_waiters_t *waiters, uint64_t hash) {
+    int  n;
+
+    pthread_mutex_lock(&waiters->mutex);
+
+    n = _nst_waiters_wake(waiters, hash, 0);
+
+    pthread_mutex_unlock(&waiters->mutex);
+
+    return n;
+}
+
+/*
+ * claims the hash for the stream which is going to create its entry and
+ * returns NST_OK, or parks the task until the claim is released and returns
+ * NST_ERR if another stream holds it
+ */
+int
+nst_waiters_claim(nst_waiters_t *waiters, nst_waiter_t *waiter, uint64_t hash) {
+    nst_waiter_t  *claim;
+    int            ret = NST_OK;
+
+    pthread_mutex_lock(&waiters->mutex);
+
+    list_for_each_entry(claim, &waiters->claim[hash % NST_WAITER_BUCKETS], list) {
+
+        if(claim->hash == hash) {
+            ret = NST_ERR;
+
+            break;
+        }
+    }
+
+    /* still parked if it was rechecked before being woken */
+    LIST_DEL_INIT(&waiter->list);
+
+    waiter->hash = hash;
+
+    if(ret == NST_OK) {
+        LIST_ADDQ(&waiters->claim[hash % NST_WAITER_BUCKETS], &waiter->list);
+
+        waiter->claim = 1;
+    } else {
+        LIST_ADDQ(&waiters->bucket[hash % NST_WAITER_BUCKETS], &waiter->list);
+
+        waiters->parked++;
+    }
+
+    pthread_mutex_unlock(&waiters->mutex);
+
+    return ret;
+}
+
+/*
+ * releases the claim of the stream if it holds one, the waiters of the claim
+ * check the entry again and go to the backend without claiming if there is
+ * still none, so that a response which is not cached is not fetched one
+ * request after another
+ */
+void
+nst_waiters_release(nst_waiters_t *waiters, nst_waiter_t *waiter) {
+
+    if(!waiters || !waiter->claim) {
+        return;
+    }
+
+    pthread_mutex_lock(&waiters->mutex);
+
+    LIST_DEL_INIT(&waiter->list);
+
+    waiter->claim = 0;
+
+    _nst_waiters_wake(waiters, waiter->hash, 1);
+
+    pthread_mutex_unlock(&waiters->mutex);
+}
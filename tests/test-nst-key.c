@@ -0,0 +1,267 @@
+/*
+ * Tests of the nuster key functions of src/nuster/key.c.
+ *
+ * Compile from the nuster directory with :
+ *   cc -Iinclude -O2 -o test-nst-key tests/test-nst-key.c src/sha1.c src/xxhash.c
+ * and run it without argument, it exits with 1 on failure.
+ *   ./test-nst-key
+ *
+ * Keys are built by nst_key_build with the default key, method.scheme.host.uri.
+ * The uuid, computed once a disk file name needs it, must be the SHA-1 of the
+ * key as it was computed for every request before, must survive
+ * nst_key_reset_flag, which the WAIT state uses, and must be computed again
+ * once the key is built again.
+ *
+ * Keys up to NST_KEY_POOL_SIZE bytes must be taken from the key pool and
+ * given back to it by nst_key_free, larger ones must be allocated with malloc
+ * and released with free, never put in the pool.
+ *
+ * The pool and the functions of the elements not used by the default key are
+ * stubbed, so are the debug functions.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "../src/nuster/key.c"
+
+struct global      global;
+THREAD_LOCAL struct buffer  trash;
+int                mem_poison_byte = -1;
+
+static char        chunk[16384];
+static int         err;
+
+const struct ist   http_known_methods[HTTP_METH_OTHER] = {
+    [HTTP_METH_OPTIONS] = IST("OPTIONS"),
+    [HTTP_METH_GET]     = IST("GET"),
+    [HTTP_METH_HEAD]    = IST("HEAD"),
+    [HTTP_METH_POST]    = IST("POST"),
+    [HTTP_METH_PUT]     = IST("PUT"),
+    [HTTP_METH_DELETE]  = IST("DELETE"),
+    [HTTP_METH_TRACE]   = IST("TRACE"),
+    [HTTP_METH_CONNECT] = IST("CONNECT"),
+};
+
+struct buffer *
+get_trash_chunk(void) {
+    static struct buffer  buf;
+
+    buf = b_make(chunk, sizeof(chunk), 0, 0);
+
+    return &buf;
+}
+
+void *
+__pool_refill_alloc(struct pool_head *pool, unsigned int avail) {
+    void  *ptr = malloc(pool->size + POOL_EXTRA);
+
+    if(ptr) {
+        pool->allocated++;
+        pool->used++;
+    }
+
+    return ptr;
+}
+
+void
+create_pool_callback(struct pool_head **ptr, char *name, unsigned int size) {
+    *ptr = calloc(1, sizeof(**ptr));
+
+    /* freed items are kept in the free list */
+    (*ptr)->size     = size;
+    (*ptr)->minavail = 1024;
+}
+
+void nst_debug_beg(hpx_stream_t *s, const char *fmt, ...) { }
+void nst_debug_add(const char *fmt, ...) { }
+void nst_debug_end(const char *fmt, ...) { }
+
+int chunk_printf(struct buffer *chk, const char *fmt, ...) { return 0; }
+int chunk_appendf(struct buffer *chk, const char *fmt, ...) { return 0; }
+struct htx htx_empty = { .size = 0 };
+
+int
+http_find_header(const struct htx *htx, const struct ist name, struct http_hdr_ctx *ctx,
+        int full) {
+
+    return 0;
+}
+
+char *
+http_extract_cookie_value(char *hdr, const char *hdr_end, char *cookie_name,
+        size_t cookie_name_l, int list, char **value, size_t *value_l) {
+
+    return NULL;
+}
+
+int
+nst_http_find_param(char *query_beg, char *query_end, char *name, char **value, int *value_len) {
+    return NST_ERR;
+}
+
+#define CHECK(cond, ...) do {                                                   \
+    if(!(cond)) {                                                               \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);                         \
+        fprintf(stderr, __VA_ARGS__);                                           \
+        fprintf(stderr, "\n");                                                  \
+        err = 1;                                                                \
+    }                                                                           \
+} while(0)
+
+static nst_key_element_t   method = { .type = NST_KEY_ELEMENT_METHOD };
+static nst_key_element_t   scheme = { .type = NST_KEY_ELEMENT_SCHEME };
+static nst_key_element_t   host   = { .type = NST_KEY_ELEMENT_HOST };
+static nst_key_element_t   uri    = { .type = NST_KEY_ELEMENT_URI };
+static nst_key_element_t  *elements[] = { &method, &scheme, &host, &uri, NULL };
+
+static nst_rule_key_t      rule_key = { .data = elements };
+static nst_rule_t          rule     = { .key  = &rule_key };
+
+static int
+build(nst_key_t *key, const char *h, const char *u) {
+    nst_http_txn_t  txn;
+
+    memset(&txn, 0, sizeof(txn));
+
+    txn.req.scheme = SCH_HTTPS;
+    txn.req.host   = ist(h);
+    txn.req.uri    = ist(u);
+
+    return nst_key_build(NULL, NULL, &rule, &txn, key, HTTP_METH_GET);
+}
+
+static void
+test_uuid(const char *h, const char *u) {
+    unsigned char  eager[NST_KEY_UUID_LEN];
+    char           str[NST_KEY_UUID_LEN * 2 + 1], hex[NST_KEY_UUID_LEN * 2 + 1];
+    blk_SHA_CTX    ctx;
+    nst_key_t      key;
+    int            i;
+
+    memset(&key, 0, sizeof(key));
+
+    if(build(&key, h, u) != NST_OK) {
+        CHECK(0, "%s%s: nst_key_build failed", h, u);
+
+        return;
+    }
+
+    CHECK(!(key.flags & NST_KEY_UUID), "%s%s: uuid computed by nst_key_build", h, u);
+
+    /* as it was computed for every request */
+    blk_SHA1_Init(&ctx);
+    blk_SHA1_Update(&ctx, key.data, key.size);
+    blk_SHA1_Final(eager, &ctx);
+
+    CHECK(!memcmp(nst_key_uuid(&key), eager, NST_KEY_UUID_LEN), "%s%s: uuid differs", h, u);
+    CHECK(key.flags & NST_KEY_UUID, "%s%s: uuid not flagged", h, u);
+
+    nst_key_memory_set_checked(&key);
+    nst_key_disk_set_checked(&key);
+    nst_key_reset_flag(&key);
+
+    CHECK(key.flags == NST_KEY_UUID, "%s%s: flags %#x after reset", h, u, key.flags);
+    CHECK(!memcmp(nst_key_uuid(&key), eager, NST_KEY_UUID_LEN),
+            "%s%s: uuid differs after reset", h, u);
+
+    for(i = 0; i < NST_KEY_UUID_LEN; i++) {
+        sprintf(hex + i * 2, "%02x", eager[i]);
+    }
+
+    nst_key_uuid_stringify(&key, str);
+    str[NST_KEY_UUID_LEN * 2] = '\0';
+
+    CHECK(!strcmp(str, hex), "%s%s: uuid string %s, expected %s", h, u, str, hex);
+
+    nst_key_free(&key);
+
+    /* built again, the uuid of the new key is computed again */
+    if(build(&key, h, "/other") != NST_OK) {
+        CHECK(0, "%s/other: nst_key_build failed", h);
+
+        return;
+    }
+
+    CHECK(!(key.flags & NST_KEY_UUID), "%s/other: uuid of the previous key kept", h);
+    CHECK(memcmp(nst_key_uuid(&key), eager, NST_KEY_UUID_LEN), "%s/other: same uuid", h);
+
+    nst_key_free(&key);
+}
+
+/*
+ * the default key is "GET\0HTTPS\0" host "\0" uri "\0", 12 bytes and the uri
+ */
+static void
+test_pool(int size) {
+    struct pool_head  *pool = pool_head_nst_key;
+    unsigned int       used = pool->used;
+    void              *free_list;
+    char              *u;
+    nst_key_t          key;
+    int                pooled = size <= NST_KEY_POOL_SIZE;
+
+    u = malloc(size - 12 + 1);
+
+    memset(u, 'u', size - 12);
+    u[size - 12] = '\0';
+
+    memset(&key, 0, sizeof(key));
+
+    if(build(&key, "", u) != NST_OK) {
+        CHECK(0, "%d: nst_key_build failed", size);
+
+        free(u);
+
+        return;
+    }
+
+    CHECK(key.size == size, "%d: key of %u bytes", size, key.size);
+    CHECK(pool->used == used + pooled, "%d: %u pool items used, expected %u", size,
+            pool->used, used + pooled);
+
+    free_list = pool->free_list;
+
+    nst_key_free(&key);
+
+    CHECK(!key.data, "%d: data not reset by nst_key_free", size);
+    CHECK(pool->used == used, "%d: %u pool items used after free, expected %u", size,
+            pool->used, used);
+
+    if(pooled) {
+        CHECK(pool->free_list != free_list, "%d: not given back to the pool", size);
+    } else {
+        CHECK(pool->free_list == free_list, "%d: malloc'ed key put in the pool", size);
+    }
+
+    /* freed keys are skipped */
+    nst_key_free(&key);
+
+    CHECK(pool->used == used, "%d: %u pool items used after a second free", size, pool->used);
+
+    free(u);
+}
+
+int
+main(int argc, char **argv) {
+    create_pool_callback(&pool_head_nst_key, "nst_key", NST_KEY_POOL_SIZE);
+
+    test_uuid("www.example.com", "/static/images/logo.png?v=3");
+    test_uuid("", "");
+    test_uuid("www.example.com", "/api/v1/products?category=books&page=2&sort=price"
+            "&filter=aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+            "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+            "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+
+    test_pool(12);
+    test_pool(NST_KEY_POOL_SIZE);
+    test_pool(NST_KEY_POOL_SIZE + 1);
+    test_pool(4096);
+
+    if(!err) {
+        printf("OK\n");
+    }
+
+    return err;
+}
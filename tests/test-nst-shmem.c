@@ -0,0 +1,208 @@
+/*
+ * Micro-benchmark of the nuster shmem allocator, for every chunk class.
+ *
+ * Compile from the nuster directory with :
+ *   cc -Iinclude -O2 -o test-nst-shmem tests/test-nst-shmem.c
+ * The only optional argument is the block size, 2MB by default.
+ *   ./test-nst-shmem 16384
+ *
+ * For each chunk class a zone is filled up, half of the chunks are freed in
+ * random order, then allocated again and everything is freed. Locked
+ * functions are used so that the per-thread caches are not involved.
+ *
+ * A zone is then filled up with blocks after a multi-block allocation, which
+ * must span consecutive blocks that no other allocation gets.
+ */
+
+#include <sys/time.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "../src/nuster/shmem.c"
+
+#define ZONE_SIZE  (64 * 1024 * 1024)
+
+int  master;
+
+int
+strlcpy2(char *dst, const char *src, int size) {
+    snprintf(dst, size, "%s", src);
+
+    return strlen(dst);
+}
+
+void
+hap_register_per_thread_init(int (*fct)()) {
+}
+
+void
+hap_register_per_thread_deinit(void (*fct)()) {
+}
+
+static double
+now_ns() {
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int
+cmp_ptr(const void *a, const void *b) {
+    uintptr_t  x = *(uintptr_t *)a, y = *(uintptr_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+int
+main(int argc, char **argv) {
+    uint32_t      block_size = argc > 1 ? atoi(argv[1]) : NST_SHMEM_BLOCK_MAX_SIZE;
+    nst_shmem_t  *shmem;
+    void        **p, *t, *b;
+    uint64_t      chunk, c, n, i, j, max;
+    double        t0, t1, t2, t3;
+    int           err = 0;
+
+    printf("%10s %10s %12s %12s %12s\n", "chunk", "chunks", "alloc ns", "realloc ns",
+            "free ns");
+
+    for(c = 0; ; c++) {
+        shmem = nst_shmem_create("test", ZONE_SIZE, block_size, NST_SHMEM_CHUNK_MIN_SIZE, 0,
+                NST_SHMEM_NUMA_OFF);
+
+        if(!shmem) {
+            fprintf(stderr, "failed to create zone\n");
+
+            return 1;
+        }
+
+        if(c == shmem->chunks) {
+            munmap(shmem->start, shmem->size);
+
+            break;
+        }
+
+        chunk = shmem->class_size[c];
+
+        max = ZONE_SIZE / chunk;
+        p   = malloc(max * sizeof(void *));
+
+        /* fill up */
+        t0 = now_ns();
+
+        for(n = 0; n < max; n++) {
+            p[n] = nst_shmem_alloc_locked(shmem, chunk);
+
+            if(!p[n]) {
+                break;
+            }
+        }
+
+        t1 = now_ns();
+
+        /* every chunk must be unique */
+        qsort(p, n, sizeof(void *), cmp_ptr);
+
+        for(i = 1; i < n; i++) {
+
+            if((uint8_t *)p[i] < (uint8_t *)p[i - 1] + chunk) {
+                fprintf(stderr, "chunk %"PRIu64": overlap at %"PRIu64"\n", chunk, i);
+                err = 1;
+
+                break;
+            }
+        }
+
+        /* free half in random order, then allocate again */
+        srand(chunk);
+
+        for(i = n - 1; i > 0; i--) {
+            j    = rand() % (i + 1);
+            t    = p[i];
+            p[i] = p[j];
+            p[j] = t;
+        }
+
+        for(i = 0; i < n / 2; i++) {
+            nst_shmem_free_locked(shmem, p[i]);
+        }
+
+        t2 = now_ns();
+
+        for(i = 0; i < n / 2; i++) {
+            p[i] = nst_shmem_alloc_locked(shmem, chunk);
+
+            if(!p[i]) {
+                fprintf(stderr, "chunk %"PRIu64": realloc failed at %"PRIu64"\n", chunk, i);
+                err = 1;
+
+                break;
+            }
+        }
+
+        t3 = now_ns();
+
+        for(i = 0; i < n / 2 && p[i]; i++) { }
+
+        for(j = 0; j < n; j++) {
+
+            if(j >= i && j < n / 2) {
+                continue;
+            }
+
+            nst_shmem_free_locked(shmem, p[j]);
+        }
+
+        t0 = (t1 - t0) / n;
+        t1 = (t3 - t2) / (n / 2 ? n / 2 : 1);
+        t2 = (now_ns() - t3) / n;
+
+        if(shmem->used) {
+            fprintf(stderr, "chunk %"PRIu64": %"PRIu64" bytes still used\n", chunk, shmem->used);
+            err = 1;
+        }
+
+        printf("%10"PRIu64" %10"PRIu64" %12.1f %12.1f %12.1f\n", chunk, n, t0, t1, t2);
+
+        free(p);
+        munmap(shmem->start, shmem->size);
+    }
+
+    shmem = nst_shmem_create("test", ZONE_SIZE, block_size, NST_SHMEM_CHUNK_MIN_SIZE, 0,
+            NST_SHMEM_NUMA_OFF);
+
+    if(!shmem) {
+        fprintf(stderr, "failed to create zone\n");
+
+        return 1;
+    }
+
+    nst_shmem_alloc(shmem, NST_SHMEM_CHUNK_MIN_SIZE);
+
+    t = nst_shmem_alloc_blocks(shmem, 3ULL * shmem->block_size + 1);
+
+    if(!t || ((uint8_t *)t - shmem->data.begin) % shmem->block_size) {
+        fprintf(stderr, "blocks: %p is not a block\n", t);
+        err = 1;
+    }
+
+    for(n = 0; (b = nst_shmem_alloc(shmem, shmem->block_size)); n++) {
+
+        if((uint8_t *)b >= (uint8_t *)t && (uint8_t *)b < (uint8_t *)t + 4 * shmem->block_size) {
+            fprintf(stderr, "blocks: block %p allocated again\n", b);
+            err = 1;
+        }
+    }
+
+    if(n != shmem->blocks - 5) {
+        fprintf(stderr, "blocks: %"PRIu64" blocks left, expected %d\n", n, shmem->blocks - 5);
+        err = 1;
+    }
+
+    munmap(shmem->start, shmem->size);
+
+    return err;
+}